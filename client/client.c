@@ -180,7 +180,7 @@ client_status_t client_stop(client_context_t* context)
     return CLIENT_STATUS_SUCCESS;
 }
 
-client_status_t client_send_pid_message(client_context_t* context, pid_t pid)
+static client_status_t client_send_pid_message_of_type(client_context_t* context, pid_t pid, message_type_t type)
 {
     if (!context)
     {
@@ -189,14 +189,16 @@ client_status_t client_send_pid_message(client_context_t* context, pid_t pid)
 
     for (int i = 0; i < context->port_count && (i == 0 || context->mode == CLIENT_MODE_FUZZ); i++)
     {
-        message_t* message = message_create(MESSAGE_TYPE_PID, sizeof(pid_t));
+        message_t* message = message_create(type, sizeof(pid_t));
         if (!message)
         {
-            DEBUG_LOG("client_send_pid_message: message_create failed");
+            DEBUG_LOG("client_send_pid_message_of_type: message_create failed");
             return CLIENT_STATUS_ERROR_MEMORY_ALLOC;
         }
-        message->header.type = MESSAGE_TYPE_PID;
+        message->header.type = type;
         message->header.length = sizeof(pid_t);
+        message->header.max_staleness_ms = CLIENT_MAX_STALENESS_MS;
+        message->header.flags = CLIENT_SCHEDSTAT ? MESSAGE_FLAG_SCHEDSTAT : 0;
         message->header.owner_addr = context->server_sockaddrs[i];
 
         message_write(message, (const uint8_t*)&pid, sizeof(pid_t));
@@ -204,7 +206,7 @@ client_status_t client_send_pid_message(client_context_t* context, pid_t pid)
         net_connection_status_t send_status = net_connection_send(context->connections[i], message);
         if (send_status != NET_CONNECTION_STATUS_SUCCESS)
         {
-            DEBUG_LOG("client_send_pid_message: net_connection_send failed: %d", send_status);
+            DEBUG_LOG("client_send_pid_message_of_type: net_connection_send failed: %d", send_status);
             return CLIENT_STATUS_ERROR_SEND_MESSAGE;
         }
     }
@@ -214,6 +216,16 @@ client_status_t client_send_pid_message(client_context_t* context, pid_t pid)
     return CLIENT_STATUS_SUCCESS;
 }
 
+client_status_t client_send_pid_message(client_context_t* context, pid_t pid)
+{
+    return client_send_pid_message_of_type(context, pid, MESSAGE_TYPE_PID);
+}
+
+client_status_t client_send_pid_delta_message(client_context_t* context, pid_t pid)
+{
+    return client_send_pid_message_of_type(context, pid, MESSAGE_TYPE_PID_DELTA);
+}
+
 void client_print_config(const char* server_addr, client_mode_t mode, int port_count, const int* ports, int pid_count, const int* pids)
 {
     printf("Server Address: %s\n", server_addr);
@@ -261,6 +273,8 @@ int client(int argc, char* argv[])
     int pid_count = CLIENT_NUM_PID;
     int pids[CLIENT_NUM_PID] = CLIENT_PID_ARRAY;
 
+    client_status_t (*send_pid_message)(client_context_t*, pid_t) = CLIENT_PID_DELTA ? client_send_pid_delta_message : client_send_pid_message;
+
     client_print_config(server_addr, mode, port_count, ports, pid_count, pids);
 
     client_context_t* context = client_create_context(mode, inet_addr(server_addr), port_count, ports);
@@ -283,7 +297,7 @@ int client(int argc, char* argv[])
     {
         case CLIENT_MODE_NORMAL:
         {
-            if (client_send_pid_message(context, pids[0]) != CLIENT_STATUS_SUCCESS)
+            if (send_pid_message(context, pids[0]) != CLIENT_STATUS_SUCCESS)
             {
                 fprintf(stderr, "Client context sending failed.\n");
                 goto client_cleanup_context;
@@ -297,7 +311,7 @@ int client(int argc, char* argv[])
             {
                 for (int i = 0; i < pid_count; i++)
                 {
-                    if (client_send_pid_message(context, pids[i]) != CLIENT_STATUS_SUCCESS)
+                    if (send_pid_message(context, pids[i]) != CLIENT_STATUS_SUCCESS)
                     {
                         fprintf(stderr, "Client context sending failed.\n");
                         goto client_cleanup_context;
@@ -48,4 +48,7 @@ client_status_t client_stop(client_context_t* context);
 // Function to send a message (PID) to server
 client_status_t client_send_pid_message(client_context_t* context, pid_t pid);
 
+// Function to send a message (PID) to server asking for cpu usage since previous request of the PID
+client_status_t client_send_pid_delta_message(client_context_t* context, pid_t pid);
+
 #endif    // CLIENT_H
\ No newline at end of file
@@ -13,5 +13,8 @@
 #define SERVER_PORT_ARRAY {SERVER_PORT, SERVER_PORT + 1, SERVER_PORT + 2, SERVER_PORT + 3, SERVER_PORT + 4}
 
 #define CLIENT_MODE CLIENT_MODE_NORMAL
+#define CLIENT_MAX_STALENESS_MS 0    // accept result measured up to this long ago (answered from server cache), 0 asks for new measurement
+#define CLIENT_PID_DELTA 0           // ask for cpu usage since previous request of pid instead of new measurement
+#define CLIENT_SCHEDSTAT 0           // ask for measurement with /proc/<pid>/schedstat over a window of 1-2 ms
 
 #endif    // CONFIG_H
\ No newline at end of file
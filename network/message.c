@@ -26,6 +26,8 @@ message_t* message_create(message_type_t type, uint32_t data_capacity)
     message->header.type = type;
     message->header.length = 0;
     message->header.capacity = data_capacity;
+    message->header.max_staleness_ms = 0;
+    message->header.flags = 0;
 
     return message;
 }
@@ -10,8 +10,11 @@ typedef enum message_type
 {
     MESSAGE_TYPE_NONE = 0,
     MESSAGE_TYPE_PID = 1,
+    MESSAGE_TYPE_PID_DELTA = 2,    // cpu usage since previous request of the pid, reply is "<cpu> <window_ms>"
 } message_type_t;
 
+#define MESSAGE_FLAG_SCHEDSTAT 1u    // requests: measure with /proc/<pid>/schedstat over a short window
+
 typedef enum message_status
 {
     MESSAGE_STATUS_SUCCESS = 0,
@@ -27,6 +30,8 @@ typedef struct message_header
     uint32_t length;    // The length of the message data (in bytes), not including the header
     struct sockaddr_in owner_addr;
     uint32_t capacity;
+    uint32_t max_staleness_ms;    // requests: result measured up to this long ago is accepted, 0 asks for new measurement
+    uint32_t flags;               // MESSAGE_FLAG_* bits
 } message_header_t;
 
 typedef struct message
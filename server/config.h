@@ -1,16 +1,42 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#define JOURNAL_MAX_SIZE 5 * 1024 * 1024    // needed for easy journal receiver in unix-socket connection
+#define JOURNAL_TRANSFER_CHUNK_SIZE 64 * 1024    // buffer size for journal transfer in unix-socket connection
+#define JOURNAL_TRANSFER_CONNECT_ATTEMPTS 20
+#define JOURNAL_TRANSFER_CONNECT_DELAY_US 100000
+#define JOURNAL_TRANSFER_URING 1        // write received journal to file with io_uring (registered buffers), falls back to splice
+#define JOURNAL_TRANSFER_DIRECT 0       // open file of io_uring receive with O_DIRECT, page cache is bypassed
+#define JOURNAL_TRANSFER_SPLICE 1       // write received journal to file with splice(2), falls back to recv and write
+#define JOURNAL_TRANSFER_FALLOCATE 1    // preallocate file for received journal
 
 // Server Configuration
 #define SERVER_NUM_WORKERS 5
 #define SERVER_ADDR "127.0.0.1"
 #define SERVER_BASE_PORT 5000
-#define SERVER_MAX_JOURNAL_SIZE 5 * 1024 * 1024
+#define SERVER_MAX_JOURNAL_SIZE 5 * 1024 * 1024    // default, can be set with <max_journal_size> argument
+#define SERVER_JOURNAL_OPTIONS (JOURNAL_OPTION_THP | JOURNAL_OPTION_POPULATE)    // journal_option_t flags
+#define SERVER_JOURNAL_SAMPLE_RATE 1000           // records per second written without sampling, 0 journals every request
+#define SERVER_JOURNAL_FOLD_WINDOW_MS 0           // fold repeated requests of the same pid and status within window into one record, 0 is off
+#define SERVER_JOURNAL_ERRORS_QUOTA_PERCENT 10    // share of journal for invalid requests, records above it are dropped
+#define SERVER_JOURNAL_SYSTEM_QUOTA_PERCENT 5     // share of journal for server messages
+#define SERVER_CPU_WINDOW_MS 20                   // measurement window of process cpu usage measured in place
+#define SERVER_CPU_MIN_WINDOW_MS 5                // first sample of adaptive window
+#define SERVER_CPU_MAX_WINDOW_MS 80               // adaptive window ends here even if accuracy target is not met, idle pids are measured this long (at most 255)
+#define SERVER_CPU_ACCURACY_PERCENT 50            // relative standard error of result which ends adaptive window (4 process ticks), 0 is fixed SERVER_CPU_WINDOW_MS
+#define SERVER_CPU_SCHEDSTAT_WINDOW_MS 2          // measurement window of requests with MESSAGE_FLAG_SCHEDSTAT
+#define SERVER_CPU_TASKSTATS 1                    // measure with TASKSTATS netlink if available and cheaper per sample than procfs
+#define SERVER_CPU_BACKEND_PROBE_SAMPLES 100      // samples of each backend compared at worker start
+#define SERVER_CPU_ENGINE_CAPACITY 4096           // measurements in flight per worker process
+#define SERVER_CPU_SAMPLES_CAPACITY 4096          // pids with last sample for delta requests per worker process
+#define SERVER_CPU_CACHE_CAPACITY 16384           // pids with recent result for requests with staleness bound, shared by workers
+#define SERVER_CPU_MISSING_TTL_MS 500             // pid which was not found is answered "not found" from cache for this long
+#define SERVER_CPU_ENGINE_IDLE_MS 1               // wait of worker loop for next measurement tick
+#define SERVER_MESSAGES_PER_POLL 100
 #define SERVER_UNIX_SOCKET_PATH "/tmp/server_unix_socket"
 
 // Journal Utility
 #define JOURNAL_FILE_PATH "note.txt"
+#define JOURNAL_ANALYZE_TOP_K 10             // pids in top of --analyze report
+#define JOURNAL_ANALYZE_BUCKET_SECONDS 60    // time histogram bucket of --analyze report
 
 #endif    // CONFIG_H
\ No newline at end of file
@@ -2,20 +2,389 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "crc32c.h"
 #include "utility.h"
 
+#define JOURNAL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define JOURNAL_HEADER_SIZE ((sizeof(journal_header_t) + 63) & ~(size_t)63)
+#define JOURNAL_INDEX_SIZE (JOURNAL_INDEX_CAPACITY * sizeof(journal_index_entry_t))
+#define JOURNAL_AGGREGATES_OFFSET (JOURNAL_HEADER_SIZE + JOURNAL_INDEX_SIZE)
+
+static void* journal_map(size_t* map_size, int* options)
+{
+    void* ptr = MAP_FAILED;
+
+    if (*options & JOURNAL_OPTION_HUGETLB)
+    {
+        // Huge pages are reserved on mmap, MAP_NORESERVE would turn lack of them into SIGBUS on write
+        size_t huge_size = (*map_size + JOURNAL_HUGE_PAGE_SIZE - 1) & ~((size_t)JOURNAL_HUGE_PAGE_SIZE - 1);
+        ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            *map_size = huge_size;
+            *options &= ~JOURNAL_OPTION_THP;
+            return ptr;
+        }
+
+        // No reserved huge pages: fall back to transparent huge pages
+        DEBUG_LOG("journal_map: MAP_HUGETLB failed, fallback to THP: %s\n", strerror(errno));
+        *options &= ~JOURNAL_OPTION_HUGETLB;
+        *options |= JOURNAL_OPTION_THP;
+    }
+
+    // Only reserve address space, pages are committed by kernel on first write
+    ptr = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return ptr;
+    }
+
+    if ((*options & JOURNAL_OPTION_THP) && madvise(ptr, *map_size, MADV_HUGEPAGE) != 0)
+    {
+        DEBUG_LOG("journal_map: madvise MADV_HUGEPAGE failed: %s\n", strerror(errno));
+        *options &= ~JOURNAL_OPTION_THP;
+    }
+
+    return ptr;
+}
+
+// Prefault pages after madvise, so that THP advice is applied to them (MAP_POPULATE would fault in small pages first)
+static void journal_prefault(void* ptr, size_t size)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+    {
+        return;
+    }
+    DEBUG_LOG("journal_prefault: MADV_POPULATE_WRITE failed, touching pages: %s\n", strerror(errno));
+#endif
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0)
+    {
+        page_size = 4096;
+    }
+
+    // Pages are shared with other processes, so touch without changing content
+    for (size_t offset = 0; offset < size; offset += (size_t)page_size)
+    {
+        __atomic_fetch_add((char*)ptr + offset, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// Lock journal mutex, recover it if its owner died: record is published only when size is advanced,
+// so a torn record of the dead owner is not visible to readers and is overwritten by the next write
+static int journal_lock(journal_t* journal)
+{
+    int result = pthread_mutex_lock(&journal->header->mutex);
+    if (result == EOWNERDEAD)
+    {
+        DEBUG_LOG("journal_lock: owner of journal mutex died, recovering\n");
+        result = pthread_mutex_consistent(&journal->header->mutex);
+    }
+
+    if (result != 0)
+    {
+        errno = result;
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint32_t journal_record_crc(const journal_record_t* record)
+{
+    uint32_t crc = crc32c(0, &record->size, sizeof(journal_record_t) - offsetof(journal_record_t, size));
+    return crc32c(crc, record + 1, record->size);
+}
+
+// Grow committed part of data area up to needed bytes plus one chunk ahead, so writes do not wait for page faults
+// Must be called under journal mutex
+static void journal_commit(journal_t* journal, size_t needed)
+{
+    journal_header_t* header = journal->header;
+
+    if (needed <= header->committed)
+    {
+        return;
+    }
+
+    size_t committed = (needed + JOURNAL_COMMIT_CHUNK_SIZE) / JOURNAL_COMMIT_CHUNK_SIZE * JOURNAL_COMMIT_CHUNK_SIZE;
+    if (committed > journal->max_size)
+    {
+        committed = journal->max_size;
+    }
+
+    if (journal->options & (JOURNAL_OPTION_POPULATE | JOURNAL_OPTION_MLOCK))
+    {
+        long page_size = sysconf(_SC_PAGESIZE);
+        size_t page_mask = (page_size > 0 ? (size_t)page_size : 4096) - 1;
+
+        size_t data_offset = (size_t)(journal->data - (char*)journal->journal_ptr);
+        size_t from = (data_offset + header->committed) & ~page_mask;
+        size_t to = data_offset + committed;
+        char* range = (char*)journal->journal_ptr + from;
+
+        if (journal->options & JOURNAL_OPTION_POPULATE)
+        {
+            journal_prefault(range, to - from);
+        }
+
+        if ((journal->options & JOURNAL_OPTION_MLOCK) && mlock(range, to - from) != 0)
+        {
+            DEBUG_LOG("journal_commit: mlock failed: %s\n", strerror(errno));
+            journal->options &= ~JOURNAL_OPTION_MLOCK;
+        }
+    }
+
+    header->committed = committed;
+}
+
+static int64_t journal_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Add index entry for record if interval is passed, make index twice sparser when it is full
+// Must be called under journal mutex
+static void journal_index_update(journal_t* journal, int64_t timestamp, size_t offset)
+{
+    journal_header_t* header = journal->header;
+
+    if (header->index_count > 0)
+    {
+        const journal_index_entry_t* last = &journal->index[header->index_count - 1];
+        if (header->records_since_index < header->index_record_interval && timestamp - last->timestamp < header->index_time_interval)
+        {
+            header->records_since_index++;
+            return;
+        }
+    }
+
+    if (header->index_count == JOURNAL_INDEX_CAPACITY)
+    {
+        for (size_t i = 0; i < JOURNAL_INDEX_CAPACITY / 2; i++)
+        {
+            journal->index[i] = journal->index[2 * i];
+        }
+        header->index_count = JOURNAL_INDEX_CAPACITY / 2;
+        header->index_record_interval *= 2;
+        header->index_time_interval *= 2;
+    }
+
+    journal->index[header->index_count].timestamp = timestamp;
+    journal->index[header->index_count].offset = offset;
+    header->index_count++;
+    header->records_since_index = 1;
+}
+
+// Offset of the last indexed record with timestamp less than t_from, records before it are out of range
+// Must be called under journal mutex
+static size_t journal_index_lookup(journal_t* journal, int64_t t_from)
+{
+    size_t low = 0;
+    size_t high = journal->header->index_count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (journal->index[middle].timestamp < t_from)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low == 0 ? 0 : journal->index[low - 1].offset;
+}
+
+// Bit positions of pid in bloom filter, taken from parts of one 64-bit hash
+static void journal_bloom_bits(int32_t pid, uint32_t bits[JOURNAL_BLOOM_HASHES])
+{
+    uint64_t hash = (uint64_t)(uint32_t)pid * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+
+    for (int i = 0; i < JOURNAL_BLOOM_HASHES; i++)
+    {
+        bits[i] = (uint32_t)(hash >> (i * 20)) % JOURNAL_BLOOM_BITS;
+    }
+}
+
+// Must be called under journal mutex
+static void journal_bloom_add(journal_block_t* block, int32_t pid)
+{
+    uint32_t bits[JOURNAL_BLOOM_HASHES];
+    journal_bloom_bits(pid, bits);
+
+    for (int i = 0; i < JOURNAL_BLOOM_HASHES; i++)
+    {
+        block->bloom[bits[i] / 8] |= (uint8_t)(1u << (bits[i] % 8));
+    }
+}
+
+static int journal_bloom_contains(const journal_block_t* block, int32_t pid)
+{
+    uint32_t bits[JOURNAL_BLOOM_HASHES];
+    journal_bloom_bits(pid, bits);
+
+    for (int i = 0; i < JOURNAL_BLOOM_HASHES; i++)
+    {
+        if (!(block->bloom[bits[i] / 8] & (1u << (bits[i] % 8))))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Aggregate table grows with journal, so a small journal does not carry megabytes of it
+static size_t journal_aggregate_capacity(size_t size)
+{
+    size_t capacity = JOURNAL_AGGREGATE_MAX_CAPACITY;
+    while (capacity > JOURNAL_AGGREGATE_MIN_CAPACITY && capacity * sizeof(journal_aggregate_t) > size / JOURNAL_AGGREGATE_SIZE_RATIO)
+    {
+        capacity /= 2;
+    }
+
+    return capacity;
+}
+
+static size_t journal_aggregate_slot(journal_t* journal, int32_t pid)
+{
+    return (size_t)(((uint32_t)pid * 0x9E3779B1u) >> 8) & (journal->aggregate_capacity - 1);
+}
+
+// Find aggregates of pid, add them if create is set and table has space
+// Must be called under journal mutex
+static journal_aggregate_t* journal_aggregate_find(journal_t* journal, int32_t pid, int create)
+{
+    size_t slot = journal_aggregate_slot(journal, pid);
+
+    for (size_t probe = 0; probe < journal->aggregate_capacity; probe++)
+    {
+        journal_aggregate_t* aggregate = &journal->aggregates[slot];
+        if (aggregate->count == 0)
+        {
+            // Keep table at most 3/4 full, so probe sequences stay short
+            if (!create || 4 * (journal->header->aggregate_count + 1) > 3 * journal->aggregate_capacity)
+            {
+                return NULL;
+            }
+            aggregate->pid = pid;
+            journal->header->aggregate_count++;
+            return aggregate;
+        }
+        if (aggregate->pid == pid)
+        {
+            return aggregate;
+        }
+        slot = (slot + 1) & (journal->aggregate_capacity - 1);
+    }
+
+    return NULL;
+}
+
+static size_t journal_aggregate_bin(double cpu)
+{
+    static const double bounds[JOURNAL_AGGREGATE_HISTOGRAM_BINS - 1] = JOURNAL_AGGREGATE_HISTOGRAM_BOUNDS;
+
+    size_t bin = 0;
+    while (bin < JOURNAL_AGGREGATE_HISTOGRAM_BINS - 1 && cpu >= bounds[bin])
+    {
+        bin++;
+    }
+
+    return bin;
+}
+
+// Must be called under journal mutex
+static void journal_aggregate_update(journal_t* journal, const journal_entry_t* entry, int64_t timestamp)
+{
+    if (entry->pid == JOURNAL_PID_NONE)
+    {
+        return;
+    }
+
+    journal_aggregate_t* aggregate = journal_aggregate_find(journal, entry->pid, 1);
+    if (!aggregate)
+    {
+        journal->header->aggregate_dropped++;
+        return;
+    }
+
+    int64_t start = timestamp - timestamp % JOURNAL_AGGREGATE_BUCKET_MS;
+    journal_aggregate_bucket_t* bucket = &aggregate->buckets[(size_t)(timestamp / JOURNAL_AGGREGATE_BUCKET_MS) % JOURNAL_AGGREGATE_BUCKETS];
+    if (bucket->start != start)
+    {
+        memset(bucket, 0, sizeof(*bucket));
+        bucket->start = start;
+    }
+
+    aggregate->count++;
+    aggregate->last_timestamp = timestamp;
+    bucket->count++;
+
+    if (entry->status != JOURNAL_RECORD_STATUS_OK)
+    {
+        return;
+    }
+
+    if (aggregate->cpu_count == 0 || entry->cpu < aggregate->cpu_min)
+    {
+        aggregate->cpu_min = entry->cpu;
+    }
+    if (aggregate->cpu_count == 0 || entry->cpu > aggregate->cpu_max)
+    {
+        aggregate->cpu_max = entry->cpu;
+    }
+    aggregate->cpu_count++;
+    aggregate->cpu_sum += entry->cpu;
+
+    if (bucket->cpu_count == 0 || entry->cpu > bucket->cpu_max)
+    {
+        bucket->cpu_max = entry->cpu;
+    }
+    bucket->cpu_count++;
+    bucket->cpu_sum += entry->cpu;
+    bucket->histogram[journal_aggregate_bin(entry->cpu)]++;
+}
+
 journal_t* journal_create(size_t size)
 {
-    if (size <= sizeof(size_t))
+    return journal_create_with_options(size, JOURNAL_OPTION_NONE);
+}
+
+journal_t* journal_create_with_options(size_t size, int options)
+{
+    // Blocks take 1/JOURNAL_BLOCK_SIZE of size per byte of journal_block_t, so SIZE_MAX / 2 leaves enough room for them
+    if (size <= sizeof(size_t) || size > SIZE_MAX / 2)
     {
-        DEBUG_LOG("journal_create failed: size is zero");
+        DEBUG_LOG("journal_create failed: invalid size %zu", size);
         return NULL;
     }
 
+    size_t aggregate_capacity = journal_aggregate_capacity(size);
+    size_t blocks_offset = JOURNAL_AGGREGATES_OFFSET + aggregate_capacity * sizeof(journal_aggregate_t);
+    size_t block_count = (size + JOURNAL_BLOCK_SIZE - 1) / JOURNAL_BLOCK_SIZE;
+    size_t data_offset = (blocks_offset + block_count * sizeof(journal_block_t) + 63) & ~(size_t)63;
+
     journal_t* journal = (journal_t*)malloc(sizeof(journal_t));
     if (!journal)
     {
@@ -24,7 +393,9 @@ journal_t* journal_create(size_t size)
     }
 
     journal->max_size = size;
-    journal->journal_ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    journal->map_size = data_offset + size;
+    journal->options = options;
+    journal->journal_ptr = journal_map(&journal->map_size, &journal->options);
 
     if (journal->journal_ptr == MAP_FAILED)
     {
@@ -32,8 +403,30 @@ journal_t* journal_create(size_t size)
         goto journal_create_map_failed;
     }
 
-    size_t cur_size = sizeof(size_t);
-    memcpy(journal->journal_ptr, &cur_size, sizeof(size_t));
+    journal->header = (journal_header_t*)journal->journal_ptr;
+    journal->index = (journal_index_entry_t*)((char*)journal->journal_ptr + JOURNAL_HEADER_SIZE);
+    journal->aggregates = (journal_aggregate_t*)((char*)journal->journal_ptr + JOURNAL_AGGREGATES_OFFSET);
+    journal->aggregate_capacity = aggregate_capacity;
+    journal->blocks = (journal_block_t*)((char*)journal->journal_ptr + blocks_offset);
+    journal->block_count = block_count;
+    journal->data = (char*)journal->journal_ptr + data_offset;
+    journal->header->size = 0;
+    journal->header->committed = 0;
+    journal->header->last_timestamp = 0;
+    journal->header->index_count = 0;
+    journal->header->index_record_interval = JOURNAL_INDEX_RECORD_INTERVAL;
+    journal->header->index_time_interval = JOURNAL_INDEX_TIME_INTERVAL_MS;
+    journal->header->records_since_index = 0;
+    journal->header->aggregate_count = 0;
+    journal->header->aggregate_dropped = 0;
+    journal->header->sample_rate = 0;
+    journal->header->sample_second = 0;
+    journal->header->sample_seen = 0;
+    journal->header->sample_slot_count = 0;
+    memset(journal->header->channels, 0, sizeof(journal->header->channels));
+    journal->header->fold_window = 0;
+    journal->header->fold_run_count = 0;
+    memset(journal->header->fold_runs, 0, sizeof(journal->header->fold_runs));
 
     pthread_mutexattr_t attr;
     if (pthread_mutexattr_init(&attr) != 0)
@@ -48,7 +441,14 @@ journal_t* journal_create(size_t size)
         goto journal_create_attr_failed;
     }
 
-    if (pthread_mutex_init(&journal->mutex, &attr) != 0)
+    // Workers are separate processes, one of them may die holding the mutex
+    if (pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0)
+    {
+        DEBUG_LOG("journal_create failed: pthread_mutexattr_setrobust error: %s", strerror(errno));
+        goto journal_create_attr_failed;
+    }
+
+    if (pthread_mutex_init(&journal->header->mutex, &attr) != 0)
     {
         DEBUG_LOG("journal_create failed: pthread_mutex_init error: %s", strerror(errno));
         goto journal_create_attr_failed;
@@ -56,13 +456,15 @@ journal_t* journal_create(size_t size)
 
     pthread_mutexattr_destroy(&attr);
 
+    journal_commit(journal, 1);
+
     return journal;
 
 journal_create_attr_failed:
     pthread_mutexattr_destroy(&attr);
 
 journal_create_mutex_failed:
-    munmap(journal->journal_ptr, journal->max_size);
+    munmap(journal->journal_ptr, journal->map_size);
 
 journal_create_map_failed:
     SAFE_FREE(journal);
@@ -78,15 +480,15 @@ journal_status_t journal_delete(journal_t* journal)
         return JOURNAL_STATUS_ERROR_PARAMS_NULL;
     }
 
-    if (munmap(journal->journal_ptr, journal->max_size) == -1)
+    if (pthread_mutex_destroy(&journal->header->mutex) != 0)
     {
-        DEBUG_LOG("journal_delete: Error unlinking journal: %s", strerror(errno));
-        return JOURNAL_STATUS_ERROR_MUNMAP;
+        DEBUG_LOG("journal_delete: Error destroying mutex: %s", strerror(errno));
     }
 
-    if (pthread_mutex_destroy(&journal->mutex) != 0)
+    if (munmap(journal->journal_ptr, journal->map_size) == -1)
     {
-        DEBUG_LOG("journal_delete: Error destroying mutex: %s", strerror(errno));
+        DEBUG_LOG("journal_delete: Error unlinking journal: %s", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUNMAP;
     }
 
     SAFE_FREE(journal);
@@ -96,83 +498,1047 @@ journal_status_t journal_delete(journal_t* journal)
 
 journal_status_t journal_write(journal_t* journal, const void* data, size_t data_size)
 {
-    if (!journal || !data)
+    journal_entry_t entry = {.pid = JOURNAL_PID_NONE, .status = JOURNAL_RECORD_STATUS_NONE, .cpu = 0.0, .channel = JOURNAL_CHANNEL_SYSTEM};
+    return journal_write_entry(journal, &entry, data, data_size);
+}
+
+static const char* journal_channel_names[JOURNAL_CHANNEL_COUNT] = {"results", "errors", "system"};
+
+// Count record which does not fit to quota of closed channel, result is status of write
+static journal_status_t journal_channel_overflow(journal_channel_state_t* channel)
+{
+    __atomic_fetch_add(&channel->dropped, 1, __ATOMIC_RELAXED);
+    return channel->overflow == JOURNAL_OVERFLOW_DROP ? JOURNAL_STATUS_SUCCESS : JOURNAL_STATUS_ERROR_NO_SPACE;
+}
+
+// Append record, must be called under journal mutex
+// Channel is closed if record does not fit to its quota
+static journal_status_t journal_append(journal_t* journal, const journal_entry_t* entry, uint32_t weight, uint8_t flags, int64_t timestamp, const void* data, size_t data_size)
+{
+    size_t cur_size = journal->header->size;
+    size_t available = journal->max_size - cur_size;
+
+    if (data_size > UINT32_MAX || available < sizeof(journal_record_t) || data_size > available - sizeof(journal_record_t)
+        || JOURNAL_RECORD_SIZE(data_size) > available)
     {
-        DEBUG_LOG("journal_write: journal or data is NULL\n");
-        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+        DEBUG_LOG("journal_write: not enough space in journal. Available: %zu, requested: %zu\n", available, data_size);
+        return JOURNAL_STATUS_ERROR_NO_SPACE;
     }
 
-    if (data_size == 0)
+    size_t record_size = JOURNAL_RECORD_SIZE(data_size);
+    journal_channel_state_t* channel = &journal->header->channels[entry->channel];
+    if (channel->quota != 0 && record_size > channel->quota - channel->used)
     {
-        DEBUG_LOG("journal_write: data_size is zero\n");
-        return JOURNAL_STATUS_SUCCESS;
+        DEBUG_LOG("journal_write: channel %s is over quota %zu\n", journal_channel_names[entry->channel], channel->quota);
+        __atomic_store_n(&channel->closed, 1, __ATOMIC_RELEASE);
+        return JOURNAL_STATUS_ERROR_NO_SPACE;
     }
 
-    if (pthread_mutex_lock(&journal->mutex) != 0)
+    journal_commit(journal, cur_size + record_size);
+
+    journal_record_t* record = (journal_record_t*)(journal->data + cur_size);
+    record->magic = JOURNAL_RECORD_MAGIC;
+    record->size = (uint32_t)data_size;
+    record->weight = weight;
+    record->timestamp = timestamp;
+    record->pid = entry->pid;
+    record->status = (uint16_t)entry->status;
+    record->channel = (uint8_t)entry->channel;
+    record->flags = flags;
+    record->cpu = entry->cpu;
+    if (data_size > 0)
     {
-        DEBUG_LOG("journal_write: pthread_mutex_lock error: %s\n", strerror(errno));
-        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+        memcpy(record + 1, data, data_size);
     }
+    record->crc = journal_record_crc(record);
 
-    size_t cur_size = 0;
-    memcpy(&cur_size, journal->journal_ptr, sizeof(size_t));
+    journal_index_update(journal, timestamp, cur_size);
 
-    if (cur_size + data_size > journal->max_size)
+    // Mapping is zeroed, so block is empty until its first record
+    journal_block_t* block = &journal->blocks[cur_size / JOURNAL_BLOCK_SIZE];
+    if (block->record_count == 0)
     {
-        DEBUG_LOG("journal_write: not enough space in journal. Available: %zu, requested: %zu\n", journal->max_size - cur_size, data_size);
-        pthread_mutex_unlock(&journal->mutex);
-        return JOURNAL_STATUS_ERROR_NO_SPACE;
+        block->first_record = (uint32_t)(cur_size % JOURNAL_BLOCK_SIZE);
+    }
+    block->record_count++;
+    if (entry->pid != JOURNAL_PID_NONE)
+    {
+        journal_bloom_add(block, entry->pid);
     }
 
-    memcpy((char*)journal->journal_ptr + cur_size, data, data_size);
-    cur_size += data_size;
-    memcpy(journal->journal_ptr, &cur_size, sizeof(cur_size));
+    channel->used += record_size;
+    channel->records++;
 
-    if (pthread_mutex_unlock(&journal->mutex) != 0)
+    journal->header->last_timestamp = timestamp;
+    journal->header->size = cur_size + record_size;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+// Write pending run as one folded record, or as plain record if it has one entry, and free its slot
+// Must be called under journal mutex
+static void journal_fold_close(journal_t* journal, journal_fold_run_t* run)
+{
+    if (run->entries == 0)
     {
-        DEBUG_LOG("journal_write: pthread_mutex_unlock error: %s\n", strerror(errno));
-        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+        return;
     }
 
-    return JOURNAL_STATUS_SUCCESS;
+    journal_entry_t entry = {
+        .pid = run->pid, .status = (journal_record_status_t)run->status, .cpu = run->cpu_sum / run->weight, .channel = (journal_channel_t)run->channel};
+    int64_t timestamp = run->first_timestamp < journal->header->last_timestamp ? journal->header->last_timestamp : run->first_timestamp;
+
+    journal_status_t status;
+    if (run->entries == 1)
+    {
+        status = journal_append(journal, &entry, run->weight, 0, timestamp, run->data, run->size);
+    }
+    else
+    {
+        char payload[sizeof(journal_fold_t) + JOURNAL_FOLD_TEXT_SIZE];
+        memcpy(payload, &run->fold, sizeof(journal_fold_t));
+        memcpy(payload + sizeof(journal_fold_t), run->data, run->size);
+        status = journal_append(journal, &entry, run->weight, JOURNAL_RECORD_FLAG_FOLDED, timestamp, payload, sizeof(journal_fold_t) + run->size);
+    }
+
+    if (status != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_fold_close: %u entries of pid %d are lost\n", run->weight, run->pid);
+    }
+
+    run->entries = 0;
+    journal->header->fold_run_count--;
 }
 
-journal_status_t journal_read(journal_t* journal, void* buffer, size_t* buffer_size)
+// Write pending runs which started before expire (all runs for JOURNAL_TIME_MAX), in order of their start
+// Must be called under journal mutex
+static void journal_fold_expire(journal_t* journal, int64_t expire)
 {
-    if (!journal || !buffer || !buffer_size)
+    journal_header_t* header = journal->header;
+    while (header->fold_run_count > 0)
     {
-        DEBUG_LOG("journal_read: journal or buffer or buffer_size is NULL\n");
-        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+        journal_fold_run_t* oldest = NULL;
+        for (size_t i = 0; i < JOURNAL_FOLD_SLOTS; i++)
+        {
+            journal_fold_run_t* run = &header->fold_runs[i];
+            if (run->entries > 0 && run->first_timestamp < expire && (!oldest || run->first_timestamp < oldest->first_timestamp))
+            {
+                oldest = run;
+            }
+        }
+        if (!oldest)
+        {
+            return;
+        }
+        journal_fold_close(journal, oldest);
     }
+}
 
-    if (pthread_mutex_lock(&journal->mutex) != 0)
+// Add entry to pending run of its (pid, status, channel) or start a new one, entries which can not be folded are appended at once
+// Must be called under journal mutex
+static journal_status_t journal_fold(journal_t* journal, const journal_entry_t* entry, uint32_t weight, int64_t timestamp, const void* data, size_t data_size)
+{
+    journal_header_t* header = journal->header;
+    if (header->fold_window == 0)
     {
-        DEBUG_LOG("journal_read: pthread_mutex_lock error: %s\n", strerror(errno));
-        *buffer_size = 0;
-        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+        return journal_append(journal, entry, weight, 0, timestamp, data, data_size);
     }
 
-    size_t cur_size = 0;
-    memcpy(&cur_size, journal->journal_ptr, sizeof(size_t));
+    // Runs are written when their own window is over, not when another pid is written
+    journal_fold_expire(journal, timestamp - header->fold_window + 1);
 
-    if (*buffer_size < cur_size)
+    journal_fold_run_t* run = NULL;
+    journal_fold_run_t* free_run = NULL;
+    for (size_t i = 0; i < JOURNAL_FOLD_SLOTS && !run; i++)
     {
-        DEBUG_LOG("journal_read: buffer too small. Buffer size: %zu, journal data size: %zu\n", *buffer_size, cur_size);
-        *buffer_size = 0;
-        pthread_mutex_unlock(&journal->mutex);
-        return JOURNAL_STATUS_ERROR_READ;
+        journal_fold_run_t* slot = &header->fold_runs[i];
+        if (slot->entries == 0)
+        {
+            free_run = free_run ? free_run : slot;
+        }
+        else if (slot->pid == entry->pid && slot->status == (uint16_t)entry->status && slot->channel == (uint8_t)entry->channel)
+        {
+            run = slot;
+        }
     }
 
-    memcpy(buffer, (const char*)journal->journal_ptr + sizeof(size_t), cur_size - sizeof(size_t));
+    if (run && weight <= UINT32_MAX - run->weight)
+    {
+        double cpu = entry->cpu;
+        if (cpu < run->fold.cpu_min)
+        {
+            run->fold.cpu_min = cpu;
+        }
+        if (cpu > run->fold.cpu_max)
+        {
+            run->fold.cpu_max = cpu;
+        }
+        run->fold.last_timestamp = timestamp;
+        run->cpu_sum += cpu * weight;
+        run->weight += weight;
+        run->entries++;
+        return JOURNAL_STATUS_SUCCESS;
+    }
 
-    if (pthread_mutex_unlock(&journal->mutex) != 0)
+    if (run)
     {
-        DEBUG_LOG("journal_read: pthread_mutex_unlock error: %s\n", strerror(errno));
-        *buffer_size = 0;
-        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+        journal_fold_close(journal, run);
+        free_run = run;
+    }
+    if (timestamp < header->last_timestamp)
+    {
+        timestamp = header->last_timestamp;
+    }
+
+    if (data_size > JOURNAL_FOLD_TEXT_SIZE)
+    {
+        return journal_append(journal, entry, weight, 0, timestamp, data, data_size);
+    }
+
+    // All slots are taken, the oldest run is written
+    if (!free_run)
+    {
+        free_run = &header->fold_runs[0];
+        for (size_t i = 1; i < JOURNAL_FOLD_SLOTS; i++)
+        {
+            if (header->fold_runs[i].first_timestamp < free_run->first_timestamp)
+            {
+                free_run = &header->fold_runs[i];
+            }
+        }
+        journal_fold_close(journal, free_run);
     }
 
-    *buffer_size = cur_size - sizeof(size_t);
+    run = free_run;
+    run->entries = 1;
+    run->weight = weight;
+    run->pid = entry->pid;
+    run->status = (uint16_t)entry->status;
+    run->channel = (uint8_t)entry->channel;
+    run->first_timestamp = timestamp;
+    run->fold.last_timestamp = timestamp;
+    run->fold.cpu_min = entry->cpu;
+    run->fold.cpu_max = entry->cpu;
+    run->cpu_sum = entry->cpu * weight;
+    run->size = data_size;
+    memcpy(run->data, data, data_size);
+    header->fold_run_count++;
 
     return JOURNAL_STATUS_SUCCESS;
 }
+
+// Find sample slot of (pid, status, channel), add it if table has space
+// Must be called under journal mutex
+static journal_sample_slot_t* journal_sample_find(journal_t* journal, const journal_entry_t* entry)
+{
+    journal_header_t* header = journal->header;
+    size_t slot = (size_t)((((uint32_t)entry->pid * 0x9E3779B1u) ^ ((uint32_t)entry->status | (uint32_t)entry->channel << 16)) >> 8) & (JOURNAL_SAMPLE_SLOTS - 1);
+
+    for (size_t probe = 0; probe < JOURNAL_SAMPLE_SLOTS; probe++)
+    {
+        journal_sample_slot_t* sample = &header->sample_slots[slot];
+        if (sample->seen == 0)
+        {
+            if (4 * (header->sample_slot_count + 1) > 3 * JOURNAL_SAMPLE_SLOTS)
+            {
+                return NULL;
+            }
+            sample->pid = entry->pid;
+            sample->status = (uint16_t)entry->status;
+            sample->channel = (uint16_t)entry->channel;
+            header->sample_slot_count++;
+            return sample;
+        }
+        if (sample->pid == entry->pid && sample->status == (uint16_t)entry->status && sample->channel == (uint16_t)entry->channel)
+        {
+            return sample;
+        }
+        slot = (slot + 1) & (JOURNAL_SAMPLE_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+// Write pending entries of slots as summary records without payload
+// Slots of finished second are reset, slots of current second (reset is 0) keep their counts so strides go on
+// Must be called under journal mutex
+static void journal_sample_flush(journal_t* journal, int reset)
+{
+    journal_header_t* header = journal->header;
+
+    int64_t timestamp = header->sample_second * 1000 + 999;
+    if (!reset && journal_now_ms() < timestamp)
+    {
+        timestamp = journal_now_ms();
+    }
+    if (timestamp < header->last_timestamp)
+    {
+        timestamp = header->last_timestamp;
+    }
+
+    for (size_t i = 0; i < JOURNAL_SAMPLE_SLOTS && header->sample_slot_count > 0; i++)
+    {
+        journal_sample_slot_t* sample = &header->sample_slots[i];
+        if (sample->pending > 0)
+        {
+            journal_entry_t entry = {
+                .pid = sample->pid, .status = (journal_record_status_t)sample->status, .cpu = sample->cpu_sum / sample->pending, .channel = (journal_channel_t)sample->channel};
+            if (journal_append(journal, &entry, sample->pending, 0, timestamp, NULL, 0) != JOURNAL_STATUS_SUCCESS)
+            {
+                DEBUG_LOG("journal_sample_flush: %u entries of pid %d are lost\n", sample->pending, sample->pid);
+            }
+            sample->pending = 0;
+            sample->cpu_sum = 0.0;
+        }
+    }
+
+    if (reset)
+    {
+        memset(header->sample_slots, 0, sizeof(header->sample_slots));
+        header->sample_slot_count = 0;
+    }
+}
+
+// Pending sampled entries and pending run become visible to readers, so weights of read records add up to every entry
+// Must be called under journal mutex
+static void journal_flush_pending(journal_t* journal)
+{
+    journal_fold_expire(journal, JOURNAL_TIME_MAX);
+    journal_sample_flush(journal, journal_now_ms() / 1000 != journal->header->sample_second);
+}
+
+// Weight of record for entry, 0 if entry is skipped and left pending in its slot
+// Record of weight above 1 stands for pending entries too, cpu is set to their average
+// Must be called under journal mutex
+static uint32_t journal_sample(journal_t* journal, const journal_entry_t* entry, int64_t timestamp, double* cpu)
+{
+    *cpu = entry->cpu;
+    journal_header_t* header = journal->header;
+    if (header->sample_rate == 0)
+    {
+        return 1;
+    }
+
+    int64_t second = timestamp / 1000;
+    if (second != header->sample_second)
+    {
+        journal_sample_flush(journal, 1);
+        header->sample_second = second;
+        header->sample_seen = 0;
+    }
+
+    uint64_t over = header->sample_seen++;
+    if (over < header->sample_rate)
+    {
+        return 1;
+    }
+
+    // Stride doubles each time the rate is exceeded once more, so records per second stay logarithmic in load
+    uint64_t stride = 2;
+    while (over >= header->sample_rate * stride && stride < ((uint64_t)1 << 31))
+    {
+        stride *= 2;
+    }
+
+    // Entries which do not fit to slots are written as is
+    journal_sample_slot_t* sample = journal_sample_find(journal, entry);
+    if (!sample)
+    {
+        return 1;
+    }
+
+    sample->seen++;
+    if (sample->seen % stride != 0)
+    {
+        sample->pending++;
+        sample->cpu_sum += entry->cpu;
+        return 0;
+    }
+
+    uint32_t weight = sample->pending + 1;
+    *cpu = (sample->cpu_sum + entry->cpu) / weight;
+    sample->pending = 0;
+    sample->cpu_sum = 0.0;
+    return weight;
+}
+
+journal_status_t journal_set_sample_rate(journal_t* journal, uint32_t records_per_second)
+{
+    if (!journal)
+    {
+        DEBUG_LOG("journal_set_sample_rate: journal is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_set_sample_rate: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    journal_sample_flush(journal, 1);
+    journal->header->sample_rate = records_per_second;
+    journal->header->sample_seen = 0;
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_set_sample_rate: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_write_entry(journal_t* journal, const journal_entry_t* entry, const void* data, size_t data_size)
+{
+    if (!journal || !entry || !data)
+    {
+        DEBUG_LOG("journal_write: journal or entry or data is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (data_size == 0)
+    {
+        DEBUG_LOG("journal_write: data_size is zero\n");
+        return JOURNAL_STATUS_SUCCESS;
+    }
+
+    if (data_size > JOURNAL_RECORD_MAX_DATA_SIZE)
+    {
+        DEBUG_LOG("journal_write: data_size %zu is above limit %d\n", data_size, JOURNAL_RECORD_MAX_DATA_SIZE);
+        return JOURNAL_STATUS_ERROR_WRITE;
+    }
+
+    if ((unsigned)entry->channel >= JOURNAL_CHANNEL_COUNT)
+    {
+        DEBUG_LOG("journal_write: unknown channel %d\n", (int)entry->channel);
+        return JOURNAL_STATUS_ERROR_WRITE;
+    }
+
+    // Closed channel takes mutex only to count entry of pid in aggregates, so flood of entries without pid
+    // does not slow down writers of other channels
+    journal_channel_state_t* channel = &journal->header->channels[entry->channel];
+    int closed = __atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE);
+    if (closed && entry->pid == JOURNAL_PID_NONE)
+    {
+        return journal_channel_overflow(channel);
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_write: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    // Keep timestamps ordered for the index even if realtime clock goes back
+    int64_t timestamp = journal_now_ms();
+    if (timestamp < journal->header->last_timestamp)
+    {
+        timestamp = journal->header->last_timestamp;
+    }
+
+    journal_status_t status = closed ? JOURNAL_STATUS_ERROR_NO_SPACE : JOURNAL_STATUS_SUCCESS;
+    journal_entry_t sampled = *entry;
+    uint32_t weight = closed ? 0 : journal_sample(journal, entry, timestamp, &sampled.cpu);
+    if (weight > 0)
+    {
+        // Summary records of previous second may have been written with later timestamp
+        if (timestamp < journal->header->last_timestamp)
+        {
+            timestamp = journal->header->last_timestamp;
+        }
+        status = journal_fold(journal, &sampled, weight, timestamp, data, data_size);
+    }
+
+    // Aggregates count every entry, including skipped ones and ones over quota of closed channel
+    if (status == JOURNAL_STATUS_SUCCESS || (status == JOURNAL_STATUS_ERROR_NO_SPACE && __atomic_load_n(&channel->closed, __ATOMIC_RELAXED)))
+    {
+        journal_aggregate_update(journal, entry, timestamp);
+    }
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_write: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    if (status == JOURNAL_STATUS_ERROR_NO_SPACE && __atomic_load_n(&channel->closed, __ATOMIC_ACQUIRE))
+    {
+        return journal_channel_overflow(channel);
+    }
+
+    return status;
+}
+
+journal_status_t journal_set_fold_window(journal_t* journal, int64_t window_ms)
+{
+    if (!journal)
+    {
+        DEBUG_LOG("journal_set_fold_window: journal is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_set_fold_window: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    journal_fold_expire(journal, JOURNAL_TIME_MAX);
+    journal->header->fold_window = window_ms > 0 ? window_ms : 0;
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_set_fold_window: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_channel_set_quota(journal_t* journal, journal_channel_t channel, size_t quota, journal_overflow_t overflow)
+{
+    if (!journal)
+    {
+        DEBUG_LOG("journal_channel_set_quota: journal is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if ((unsigned)channel >= JOURNAL_CHANNEL_COUNT)
+    {
+        DEBUG_LOG("journal_channel_set_quota: unknown channel %d\n", (int)channel);
+        return JOURNAL_STATUS_ERROR_WRITE;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_channel_set_quota: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    // Channel is opened again, next record which does not fit closes it
+    journal_channel_state_t* state = &journal->header->channels[channel];
+    state->quota = quota;
+    state->overflow = (uint32_t)overflow;
+    __atomic_store_n(&state->closed, 0, __ATOMIC_RELEASE);
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_channel_set_quota: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_channel_get(journal_t* journal, journal_channel_t channel, journal_channel_state_t* state)
+{
+    if (!journal || !state)
+    {
+        DEBUG_LOG("journal_channel_get: journal or state is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if ((unsigned)channel >= JOURNAL_CHANNEL_COUNT)
+    {
+        DEBUG_LOG("journal_channel_get: unknown channel %d\n", (int)channel);
+        return JOURNAL_STATUS_ERROR_READ;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_channel_get: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    *state = journal->header->channels[channel];
+    state->dropped = __atomic_load_n(&journal->header->channels[channel].dropped, __ATOMIC_RELAXED);
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_channel_get: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+const char* journal_channel_name(journal_channel_t channel)
+{
+    return (unsigned)channel < JOURNAL_CHANNEL_COUNT ? journal_channel_names[channel] : "unknown";
+}
+
+int journal_channel_parse(const char* names, uint32_t* channel_mask)
+{
+    if (!names || !channel_mask)
+    {
+        return -1;
+    }
+
+    uint32_t mask = 0;
+    while (*names != '\0')
+    {
+        size_t length = strcspn(names, ",");
+        int found = 0;
+        for (int channel = 0; channel < JOURNAL_CHANNEL_COUNT; channel++)
+        {
+            if (strlen(journal_channel_names[channel]) == length && strncmp(names, journal_channel_names[channel], length) == 0)
+            {
+                mask |= JOURNAL_CHANNEL_BIT(channel);
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            return -1;
+        }
+        names += length;
+        if (*names == ',')
+        {
+            names++;
+        }
+    }
+
+    if (mask == 0)
+    {
+        return -1;
+    }
+
+    *channel_mask = mask;
+    return 0;
+}
+
+journal_status_t journal_read(journal_t* journal, void* buffer, size_t* buffer_size)
+{
+    return journal_read_range(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, buffer, buffer_size);
+}
+
+journal_status_t journal_read_range(journal_t* journal, int64_t t_from, int64_t t_to, void* buffer, size_t* buffer_size)
+{
+    if (!journal || !buffer || !buffer_size)
+    {
+        DEBUG_LOG("journal_read_range: journal or buffer or buffer_size is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    journal_range_t range;
+    journal_status_t status = journal_range_begin(journal, t_from, t_to, &range);
+    if (status != JOURNAL_STATUS_SUCCESS)
+    {
+        *buffer_size = 0;
+        return status;
+    }
+
+    if (*buffer_size < range.size)
+    {
+        DEBUG_LOG("journal_read_range: buffer too small. Buffer size: %zu, journal data size: %zu\n", *buffer_size, range.size);
+        *buffer_size = 0;
+        return JOURNAL_STATUS_ERROR_READ;
+    }
+
+    *buffer_size = range.size;
+
+    return journal_range_read(journal, &range, buffer, buffer_size);
+}
+
+journal_status_t journal_range_begin(journal_t* journal, int64_t t_from, int64_t t_to, journal_range_t* range)
+{
+    return journal_range_begin_channels(journal, t_from, t_to, JOURNAL_CHANNEL_ALL, range);
+}
+
+journal_status_t journal_range_begin_channels(journal_t* journal, int64_t t_from, int64_t t_to, uint32_t channel_mask, journal_range_t* range)
+{
+    if (!journal || !range)
+    {
+        DEBUG_LOG("journal_range_begin: journal or range is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_range_begin: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    journal_flush_pending(journal);
+
+    size_t end = journal->header->size;
+    size_t offset = journal_index_lookup(journal, t_from);
+
+    if (pthread_mutex_unlock(&journal->header->mutex) != 0)
+    {
+        DEBUG_LOG("journal_range_begin: pthread_mutex_unlock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_UNLOCK;
+    }
+
+    // Written records are never changed, so they are scanned without holding the mutex
+    const journal_record_t* record = NULL;
+    while ((record = journal_record_next(journal, &offset, end)) && record->timestamp < t_from)
+    {
+        offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+    if (!record)
+    {
+        offset = end;
+    }
+
+    range->t_from = t_from;
+    range->t_to = t_to;
+    range->offset = offset;
+    range->size = 0;
+    range->records_size = 0;
+    range->channel_mask = channel_mask;
+
+    while ((record = journal_record_next(journal, &offset, end)) && record->timestamp <= t_to)
+    {
+        if (channel_mask & JOURNAL_CHANNEL_BIT(record->channel))
+        {
+            range->size += record->size - JOURNAL_RECORD_TEXT_OFFSET(record);
+            range->records_size += JOURNAL_RECORD_SIZE(record->size);
+        }
+        offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+
+    range->end = record ? offset : end;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_range_read(journal_t* journal, journal_range_t* range, void* buffer, size_t* buffer_size)
+{
+    if (!journal || !range || !buffer || !buffer_size)
+    {
+        DEBUG_LOG("journal_range_read: journal or range or buffer or buffer_size is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    size_t copied = 0;
+
+    const journal_record_t* record = NULL;
+    while ((record = journal_record_next(journal, &range->offset, range->end)))
+    {
+        if (!(range->channel_mask & JOURNAL_CHANNEL_BIT(record->channel)))
+        {
+            range->offset += JOURNAL_RECORD_SIZE(record->size);
+            continue;
+        }
+
+        // Only writer payload is read, fold of folded record is not
+        size_t text_offset = JOURNAL_RECORD_TEXT_OFFSET(record);
+        size_t text_size = record->size - text_offset;
+        if (text_size > *buffer_size - copied)
+        {
+            break;
+        }
+
+        memcpy((char*)buffer + copied, (const char*)(record + 1) + text_offset, text_size);
+        copied += text_size;
+        range->offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+
+    if (!record)
+    {
+        range->offset = range->end;
+    }
+
+    if (copied == 0 && range->offset < range->end)
+    {
+        DEBUG_LOG("journal_range_read: buffer too small for record at %zu\n", range->offset);
+        *buffer_size = 0;
+        return JOURNAL_STATUS_ERROR_READ;
+    }
+
+    *buffer_size = copied;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_range_read_records(journal_t* journal, journal_range_t* range, void* buffer, size_t* buffer_size)
+{
+    if (!journal || !range || !buffer || !buffer_size)
+    {
+        DEBUG_LOG("journal_range_read_records: journal or range or buffer or buffer_size is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    size_t copied = 0;
+
+    const journal_record_t* record = NULL;
+    while ((record = journal_record_next(journal, &range->offset, range->end)))
+    {
+        size_t record_size = JOURNAL_RECORD_SIZE(record->size);
+        if (!(range->channel_mask & JOURNAL_CHANNEL_BIT(record->channel)))
+        {
+            range->offset += record_size;
+            continue;
+        }
+
+        if (record_size > *buffer_size - copied)
+        {
+            break;
+        }
+
+        memcpy((char*)buffer + copied, record, record_size);
+        copied += record_size;
+        range->offset += record_size;
+    }
+
+    if (!record)
+    {
+        range->offset = range->end;
+    }
+
+    if (copied == 0 && range->offset < range->end)
+    {
+        DEBUG_LOG("journal_range_read_records: buffer too small for record at %zu\n", range->offset);
+        *buffer_size = 0;
+        return JOURNAL_STATUS_ERROR_READ;
+    }
+
+    *buffer_size = copied;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+const journal_record_t* journal_record_next(journal_t* journal, size_t* offset, size_t end)
+{
+    if (!journal || !offset)
+    {
+        DEBUG_LOG("journal_record_next: journal or offset is NULL\n");
+        return NULL;
+    }
+
+    for (size_t current = *offset; current < end && end - current >= sizeof(journal_record_t); current += JOURNAL_RECORD_ALIGN)
+    {
+        const journal_record_t* record = (const journal_record_t*)(journal->data + current);
+        if (record->magic == JOURNAL_RECORD_MAGIC && record->size <= end - current - sizeof(journal_record_t) && record->crc == journal_record_crc(record))
+        {
+            if (current != *offset)
+            {
+                DEBUG_LOG("journal_record_next: skipped %zu damaged bytes at %zu\n", current - *offset, *offset);
+            }
+            *offset = current;
+            return record;
+        }
+    }
+
+    return NULL;
+}
+
+journal_status_t journal_get_size(journal_t* journal, size_t* size)
+{
+    if (!journal || !size)
+    {
+        DEBUG_LOG("journal_get_size: journal or size is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_get_size: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    journal_flush_pending(journal);
+    *size = journal->header->size;
+
+    pthread_mutex_unlock(&journal->header->mutex);
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_read_at(journal_t* journal, size_t offset, void* buffer, size_t* buffer_size)
+{
+    if (!journal || !buffer || !buffer_size)
+    {
+        DEBUG_LOG("journal_read_at: journal or buffer or buffer_size is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    size_t cur_size = 0;
+    journal_status_t status = journal_get_size(journal, &cur_size);
+    if (status != JOURNAL_STATUS_SUCCESS)
+    {
+        *buffer_size = 0;
+        return status;
+    }
+
+    if (offset > cur_size)
+    {
+        DEBUG_LOG("journal_read_at: offset %zu is beyond journal size %zu\n", offset, cur_size);
+        *buffer_size = 0;
+        return JOURNAL_STATUS_ERROR_READ;
+    }
+
+    // Written bytes are never changed, so they can be copied without holding the mutex
+    if (*buffer_size > cur_size - offset)
+    {
+        *buffer_size = cur_size - offset;
+    }
+
+    memcpy(buffer, journal->data + offset, *buffer_size);
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_find_pid(journal_t* journal, int32_t pid, journal_pid_iterator_t* iterator)
+{
+    if (!journal || !iterator)
+    {
+        DEBUG_LOG("journal_find_pid: journal or iterator is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    // Blocks below size are not changed after size is published, so they are read without holding the mutex
+    journal_status_t status = journal_get_size(journal, &iterator->end);
+    if (status != JOURNAL_STATUS_SUCCESS)
+    {
+        return status;
+    }
+
+    iterator->pid = pid;
+    iterator->offset = 0;
+    iterator->block = SIZE_MAX;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_pid_next(journal_t* journal, journal_pid_iterator_t* iterator, const journal_record_t** record)
+{
+    if (!journal || !iterator || !record)
+    {
+        DEBUG_LOG("journal_pid_next: journal or iterator or record is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    while (iterator->offset < iterator->end)
+    {
+        size_t block = iterator->offset / JOURNAL_BLOCK_SIZE;
+
+        // Entering a block: offset is at its first record, so the whole block can be skipped
+        if (block != iterator->block && !journal_bloom_contains(&journal->blocks[block], iterator->pid))
+        {
+            iterator->offset = iterator->end;
+            for (block++; block * JOURNAL_BLOCK_SIZE < iterator->end; block++)
+            {
+                const journal_block_t* next = &journal->blocks[block];
+                if (next->record_count > 0 && journal_bloom_contains(next, iterator->pid))
+                {
+                    iterator->offset = block * JOURNAL_BLOCK_SIZE + next->first_record;
+                    break;
+                }
+            }
+        }
+        iterator->block = block;
+
+        if (iterator->offset >= iterator->end)
+        {
+            break;
+        }
+
+        const journal_record_t* current = journal_record_next(journal, &iterator->offset, iterator->end);
+        if (!current)
+        {
+            iterator->offset = iterator->end;
+            break;
+        }
+        iterator->offset += JOURNAL_RECORD_SIZE(current->size);
+
+        if (current->pid == iterator->pid)
+        {
+            *record = current;
+            return JOURNAL_STATUS_SUCCESS;
+        }
+    }
+
+    *record = NULL;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+journal_status_t journal_aggregate_get(journal_t* journal, int32_t pid, journal_aggregate_t* aggregate)
+{
+    if (!journal || !aggregate)
+    {
+        DEBUG_LOG("journal_aggregate_get: journal or aggregate is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_aggregate_get: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    const journal_aggregate_t* found = pid == JOURNAL_PID_NONE ? NULL : journal_aggregate_find(journal, pid, 0);
+    if (found)
+    {
+        *aggregate = *found;
+    }
+
+    pthread_mutex_unlock(&journal->header->mutex);
+
+    return found ? JOURNAL_STATUS_SUCCESS : JOURNAL_STATUS_ERROR_READ;
+}
+
+journal_status_t journal_aggregate_get_all(journal_t* journal, journal_aggregate_t* aggregates, size_t* count)
+{
+    if (!journal || !aggregates || !count)
+    {
+        DEBUG_LOG("journal_aggregate_get_all: journal or aggregates or count is NULL\n");
+        return JOURNAL_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (journal_lock(journal) != 0)
+    {
+        DEBUG_LOG("journal_aggregate_get_all: pthread_mutex_lock error: %s\n", strerror(errno));
+        return JOURNAL_STATUS_ERROR_MUTEX_LOCK;
+    }
+
+    size_t copied = 0;
+    for (size_t slot = 0; slot < journal->aggregate_capacity && copied < *count; slot++)
+    {
+        if (journal->aggregates[slot].count > 0)
+        {
+            aggregates[copied++] = journal->aggregates[slot];
+        }
+    }
+
+    pthread_mutex_unlock(&journal->header->mutex);
+
+    *count = copied;
+
+    return JOURNAL_STATUS_SUCCESS;
+}
+
+const char* journal_options_to_string(int options, char* buffer, size_t buffer_size)
+{
+    static const struct
+    {
+        int option;
+        const char* name;
+    } names[] = {{JOURNAL_OPTION_HUGETLB, "hugetlb"}, {JOURNAL_OPTION_THP, "thp"}, {JOURNAL_OPTION_POPULATE, "populate"}, {JOURNAL_OPTION_MLOCK, "mlock"}};
+
+    if (!buffer || buffer_size == 0)
+    {
+        return NULL;
+    }
+
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if ((options & names[i].option) && length < buffer_size)
+        {
+            length += snprintf(buffer + length, buffer_size - length, "%s%s", length ? "|" : "", names[i].name);
+        }
+    }
+
+    if (length == 0)
+    {
+        snprintf(buffer, buffer_size, "none");
+    }
+
+    return buffer;
+}
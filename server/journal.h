@@ -2,6 +2,66 @@
 #define JOURNAL_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Journal memory is reserved for max_size and committed by chunks as the journal grows
+#define JOURNAL_COMMIT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Sparse time index: one entry every N records or every M ms, both are doubled when index is full
+#define JOURNAL_INDEX_CAPACITY 4096
+#define JOURNAL_INDEX_RECORD_INTERVAL 1024
+#define JOURNAL_INDEX_TIME_INTERVAL_MS 1000
+
+// Records are aligned to 8 bytes in journal and start with magic, readers resynchronize on it after a damaged record
+#define JOURNAL_RECORD_ALIGN 8
+#define JOURNAL_RECORD_MAGIC 0x4C4E524Au
+#define JOURNAL_RECORD_SIZE(payload_size) ((sizeof(journal_record_t) + (payload_size) + JOURNAL_RECORD_ALIGN - 1) & ~(size_t)(JOURNAL_RECORD_ALIGN - 1))
+// Larger writes are refused, so any record fits to chunk of range readers and transfer (JOURNAL_TRANSFER_CHUNK_SIZE)
+#define JOURNAL_RECORD_MAX_DATA_SIZE (32 * 1024)
+
+// Whole time range for journal_read_range
+#define JOURNAL_TIME_MIN INT64_MIN
+#define JOURNAL_TIME_MAX INT64_MAX
+
+// Journal data is split into blocks, each block keeps bloom filter of PIDs of records starting in it
+#define JOURNAL_BLOCK_SIZE (64 * 1024)
+#define JOURNAL_BLOOM_BITS 1024
+#define JOURNAL_BLOOM_HASHES 3
+
+// Aggregates of records per pid are updated on write, each pid keeps a ring of time buckets with cpu histogram
+// Table capacity is a power of two between MIN and MAX, the largest one which takes at most 1/JOURNAL_AGGREGATE_SIZE_RATIO of journal size
+#define JOURNAL_AGGREGATE_MIN_CAPACITY 64
+#define JOURNAL_AGGREGATE_MAX_CAPACITY 4096
+#define JOURNAL_AGGREGATE_SIZE_RATIO 4
+#define JOURNAL_AGGREGATE_BUCKETS 24
+#define JOURNAL_AGGREGATE_BUCKET_MS (60 * 60 * 1000)
+#define JOURNAL_AGGREGATE_HISTOGRAM_BINS 16
+// Upper bounds of histogram bins in cpu percent, the last bin has no upper bound
+#define JOURNAL_AGGREGATE_HISTOGRAM_BOUNDS {1, 2, 5, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 200, 400}
+
+// Writes above sample rate per second are sampled, skipped entries are counted per (pid, status) slot
+// and represented by weight of the next sampled record of the slot or by summary record at the end of second
+#define JOURNAL_SAMPLE_SLOTS 256
+
+// Entries of the same pid, status and channel within fold window are folded to one record (journal_set_fold_window)
+// Each (pid, status, channel) has its own pending run, so interleaved entries of several pids are folded too
+// Run is written at the first write after its window, when slots are full (the oldest run), or before a read
+// Entries with longer payload are never folded
+#define JOURNAL_FOLD_TEXT_SIZE 256
+#define JOURNAL_FOLD_SLOTS 16
+
+// Record flags
+#define JOURNAL_RECORD_FLAG_FOLDED 1u    // record of folded run, payload starts with journal_fold_t
+// Offset of writer payload in record payload
+#define JOURNAL_RECORD_TEXT_OFFSET(record) (((record)->flags & JOURNAL_RECORD_FLAG_FOLDED) ? sizeof(journal_fold_t) : 0)
+
+// Bit of channel in channel masks
+#define JOURNAL_CHANNEL_BIT(channel) (1u << (channel))
+#define JOURNAL_CHANNEL_ALL ((1u << JOURNAL_CHANNEL_COUNT) - 1)
+
+// Pid of records which are not related to a process
+#define JOURNAL_PID_NONE (-1)
 
 typedef enum journal_status
 {
@@ -19,23 +79,290 @@ typedef enum journal_status
 
 } journal_status_t;
 
-typedef struct journal
+// Memory options for the journal mapping, combined as bit flags
+typedef enum journal_option
+{
+    JOURNAL_OPTION_NONE = 0,
+    JOURNAL_OPTION_HUGETLB = 1 << 0,     // explicit huge pages (MAP_HUGETLB), falls back to normal pages
+    JOURNAL_OPTION_THP = 1 << 1,         // transparent huge pages (madvise MADV_HUGEPAGE)
+    JOURNAL_OPTION_POPULATE = 1 << 2,    // prefault pages when they are committed
+    JOURNAL_OPTION_MLOCK = 1 << 3        // lock pages in RAM when they are committed
+} journal_option_t;
+
+// Result of request stored in record
+typedef enum journal_record_status
+{
+    JOURNAL_RECORD_STATUS_NONE = 0,    // record is not a result of request
+    JOURNAL_RECORD_STATUS_OK,
+    JOURNAL_RECORD_STATUS_NOT_FOUND,
+    JOURNAL_RECORD_STATUS_INVALID,
+    JOURNAL_RECORD_STATUS_COUNT
+} journal_record_status_t;
+
+// Records are written to channels, each channel has its own quota of journal data,
+// so a flood of one channel (e.g. invalid requests) can not take space of the others
+typedef enum journal_channel
+{
+    JOURNAL_CHANNEL_RESULTS = 0,    // measurements of processes
+    JOURNAL_CHANNEL_ERRORS,         // invalid requests
+    JOURNAL_CHANNEL_SYSTEM,         // messages of server
+    JOURNAL_CHANNEL_COUNT
+} journal_channel_t;
+
+// What happens to record which does not fit to quota of its channel
+typedef enum journal_overflow
+{
+    JOURNAL_OVERFLOW_REJECT = 0,    // write fails with JOURNAL_STATUS_ERROR_NO_SPACE
+    JOURNAL_OVERFLOW_DROP           // record is counted as dropped and write succeeds
+} journal_overflow_t;
+
+// Record header in journal data, payload follows it
+typedef struct journal_record
+{
+    uint32_t magic;       // JOURNAL_RECORD_MAGIC
+    uint32_t crc;         // CRC32C of header fields after crc and payload
+    uint32_t size;        // payload size
+    uint32_t weight;      // entries represented by record, more than 1 if journal is sampled (0 is read as 1)
+    int64_t timestamp;    // ms since epoch, never less than timestamp of previous record
+    int32_t pid;          // JOURNAL_PID_NONE if record is not related to a process
+    uint16_t status;      // journal_record_status_t
+    uint8_t channel;      // journal_channel_t
+    uint8_t flags;        // JOURNAL_RECORD_FLAG_*
+    double cpu;           // cpu usage in percent if status is JOURNAL_RECORD_STATUS_OK, average of folded run
+} journal_record_t;
+
+// Payload prefix of folded record, record timestamp is time of first entry and weight is count of entries
+typedef struct journal_fold
+{
+    int64_t last_timestamp;
+    double cpu_min;
+    double cpu_max;
+} journal_fold_t;
+
+// Record metadata given by writer
+typedef struct journal_entry
+{
+    int32_t pid;
+    journal_record_status_t status;
+    double cpu;
+    journal_channel_t channel;
+} journal_entry_t;
+
+// Entries of (pid, status) skipped by sampling in current second
+typedef struct journal_sample_slot
+{
+    int32_t pid;
+    uint16_t status;
+    uint16_t channel;
+    uint32_t seen;       // entries of slot above sample rate, zero for empty slot
+    uint32_t pending;    // skipped entries not represented by any record yet
+    double cpu_sum;      // cpu of pending entries
+} journal_sample_slot_t;
+
+typedef struct journal_index_entry
+{
+    int64_t timestamp;
+    size_t offset;    // offset of record in journal data
+} journal_index_entry_t;
+
+typedef struct journal_block
+{
+    uint32_t record_count;    // records starting in block
+    uint32_t first_record;    // offset of first of them from block start
+    uint8_t bloom[JOURNAL_BLOOM_BITS / 8];
+} journal_block_t;
+
+typedef struct journal_aggregate_bucket
+{
+    int64_t start;    // ms since epoch, multiple of JOURNAL_AGGREGATE_BUCKET_MS
+    uint32_t count;
+    uint32_t cpu_count;
+    double cpu_sum;
+    double cpu_max;
+    uint32_t histogram[JOURNAL_AGGREGATE_HISTOGRAM_BINS];
+} journal_aggregate_bucket_t;
+
+// Aggregates of all records of pid, cpu fields are over records with JOURNAL_RECORD_STATUS_OK
+typedef struct journal_aggregate
+{
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t count;    // zero for empty slot
+    uint64_t cpu_count;
+    double cpu_sum;
+    double cpu_min;
+    double cpu_max;
+    int64_t last_timestamp;
+    journal_aggregate_bucket_t buckets[JOURNAL_AGGREGATE_BUCKETS];    // bucket of time t is (t / JOURNAL_AGGREGATE_BUCKET_MS) % JOURNAL_AGGREGATE_BUCKETS
+} journal_aggregate_t;
+
+// Run of identical entries which is not written yet, payload is the one of first entry
+typedef struct journal_fold_run
+{
+    uint32_t entries;    // writes in run, 0 if there is no run
+    uint32_t weight;     // entries represented by run (writes of sampled journal have weight)
+    int32_t pid;
+    uint16_t status;
+    uint8_t channel;
+    int64_t first_timestamp;
+    journal_fold_t fold;
+    double cpu_sum;
+    size_t size;
+    char data[JOURNAL_FOLD_TEXT_SIZE];
+} journal_fold_run_t;
+
+// Quota and counters of channel
+typedef struct journal_channel_state
+{
+    size_t quota;         // max bytes of records with headers, 0 if only journal size limits channel
+    size_t used;          // bytes of records with headers
+    uint32_t overflow;    // journal_overflow_t
+    uint32_t closed;      // set when record did not fit to quota, later records are dropped or rejected without taking mutex
+    uint64_t records;     // written records
+    uint64_t dropped;     // records dropped or rejected by quota
+} journal_channel_state_t;
+
+// Journal state placed at the beginning of the shared mapping, so it is common for all processes
+typedef struct journal_header
 {
     pthread_mutex_t mutex;
-    size_t max_size;
+    size_t size;         // bytes of data written
+    size_t committed;    // bytes of data area committed (prefaulted or locked if requested)
+    int64_t last_timestamp;
+    size_t index_count;
+    size_t index_record_interval;
+    int64_t index_time_interval;
+    size_t records_since_index;
+    size_t aggregate_count;       // pids in aggregate table
+    uint64_t aggregate_dropped;    // records of pids not aggregated because table is full
+    uint32_t sample_rate;          // entries per second written without sampling, 0 if sampling is off
+    int64_t sample_second;         // second of sample_seen and sample_slots
+    uint64_t sample_seen;          // entries in sample_second
+    size_t sample_slot_count;
+    journal_sample_slot_t sample_slots[JOURNAL_SAMPLE_SLOTS];    // open addressing table by (pid, status, channel)
+    journal_channel_state_t channels[JOURNAL_CHANNEL_COUNT];
+    int64_t fold_window;    // ms, 0 if folding is off
+    size_t fold_run_count;
+    journal_fold_run_t fold_runs[JOURNAL_FOLD_SLOTS];    // pending runs by (pid, status, channel), empty slot has no entries
+} journal_header_t;
+
+// State of reading records in time range
+typedef struct journal_range
+{
+    int64_t t_from;
+    int64_t t_to;
+    size_t offset;    // next record to read
+    size_t end;       // end of last record in range
+    size_t size;            // total size of payloads in range
+    size_t records_size;    // total size of valid records in range with headers
+    uint32_t channel_mask;  // JOURNAL_CHANNEL_BIT of channels to read
+} journal_range_t;
+
+// State of iterating over records of one pid
+typedef struct journal_pid_iterator
+{
+    int32_t pid;
+    size_t offset;    // next record to check
+    size_t end;       // journal size when iteration began
+    size_t block;     // last block checked by bloom filter
+} journal_pid_iterator_t;
+
+typedef struct journal
+{
+    size_t max_size;    // capacity of data area
+    size_t map_size;    // real size of mapping (header + index + aggregates + blocks + data, rounded up to huge page size if needed)
+    int options;        // options which actually took effect
     void* journal_ptr;
+    journal_header_t* header;
+    journal_index_entry_t* index;
+    journal_aggregate_t* aggregates;    // open addressing table by pid
+    size_t aggregate_capacity;          // slots in aggregates, power of two
+    journal_block_t* blocks;
+    size_t block_count;
+    char* data;
 } journal_t;
 
-// Create journal ANONYMOUS SHARED
+// Create journal ANONYMOUS SHARED, address space for size bytes is reserved, memory is committed on demand
 journal_t* journal_create(size_t size);
 
+// Create journal ANONYMOUS SHARED with journal_option_t flags, unsupported options are dropped
+// Check journal->options to see which of them took effect
+journal_t* journal_create_with_options(size_t size, int options);
+
+// Write names of options to buffer as "hugetlb|thp|populate|mlock" ("none" if empty)
+const char* journal_options_to_string(int options, char* buffer, size_t buffer_size);
+
 // Delete journal and close if needed
 journal_status_t journal_delete(journal_t* journal);
 
-// Write to the end of journal
+// Write record to the end of journal (JOURNAL_CHANNEL_SYSTEM), timestamp is set to current time
 journal_status_t journal_write(journal_t* journal, const void* data, size_t data_size);
 
-// Copy all journal to buffer, return buffer_size as amount of cur size of journal
+// Write record with metadata to the end of journal, timestamp is set to current time
+// If sample rate is set, entry may be skipped and counted in weight of a later record, aggregates count every entry
+journal_status_t journal_write_entry(journal_t* journal, const journal_entry_t* entry, const void* data, size_t data_size);
+
+// Sample entries above records_per_second in each second (0 turns sampling off)
+// Above the rate every 2nd entry of (pid, status) is written, every 4th above twice the rate and so on
+journal_status_t journal_set_sample_rate(journal_t* journal, uint32_t records_per_second);
+
+// Fold entries of the same pid, status and channel within window_ms into one record (0 turns folding off)
+// Run is written when a different entry comes, when it is older than window or before journal is read
+journal_status_t journal_set_fold_window(journal_t* journal, int64_t window_ms);
+
+// Limit channel to quota bytes of records with headers (0 for no limit) and set what happens to records above it
+// Channel is closed once a record does not fit, so later writes to it cost no locking
+journal_status_t journal_channel_set_quota(journal_t* journal, journal_channel_t channel, size_t quota, journal_overflow_t overflow);
+
+// Copy quota and counters of channel
+journal_status_t journal_channel_get(journal_t* journal, journal_channel_t channel, journal_channel_state_t* state);
+
+// Name of channel: "results", "errors" or "system"
+const char* journal_channel_name(journal_channel_t channel);
+
+// Parse comma separated channel names to JOURNAL_CHANNEL_BIT mask, return 0 on success (mask is not changed on error)
+int journal_channel_parse(const char* names, uint32_t* channel_mask);
+
+// Copy payloads of all records to buffer, return buffer_size as amount of copied bytes
 journal_status_t journal_read(journal_t* journal, void* buffer, size_t* buffer_size);
 
+// Copy payloads of records with timestamp in [t_from, t_to] (ms since epoch) to buffer, return buffer_size as amount of copied bytes
+journal_status_t journal_read_range(journal_t* journal, int64_t t_from, int64_t t_to, void* buffer, size_t* buffer_size);
+
+// Find first record of [t_from, t_to] with the time index and calculate size of range payloads
+journal_status_t journal_range_begin(journal_t* journal, int64_t t_from, int64_t t_to, journal_range_t* range);
+
+// Same as journal_range_begin, only records of channels in channel_mask (JOURNAL_CHANNEL_BIT) are read
+journal_status_t journal_range_begin_channels(journal_t* journal, int64_t t_from, int64_t t_to, uint32_t channel_mask, journal_range_t* range);
+
+// Copy next payloads of range to buffer (only whole records), buffer_size is zero at the end of range
+journal_status_t journal_range_read(journal_t* journal, journal_range_t* range, void* buffer, size_t* buffer_size);
+
+// Copy next whole records of range (headers and aligned payloads, damaged bytes are skipped) to buffer
+// buffer_size is zero at the end of range
+journal_status_t journal_range_read_records(journal_t* journal, journal_range_t* range, void* buffer, size_t* buffer_size);
+
+// Find first valid record (magic, size and crc are checked) at or after offset and before end, set offset to it
+// Return NULL if there is no valid record, damaged bytes are skipped
+const journal_record_t* journal_record_next(journal_t* journal, size_t* offset, size_t end);
+
+// Get amount of bytes written to journal data (records with headers)
+journal_status_t journal_get_size(journal_t* journal, size_t* size);
+
+// Copy up to buffer_size bytes of raw journal data starting from offset, return buffer_size as amount of copied bytes
+journal_status_t journal_read_at(journal_t* journal, size_t offset, void* buffer, size_t* buffer_size);
+
+// Begin iterating over records of pid written before this call
+journal_status_t journal_find_pid(journal_t* journal, int32_t pid, journal_pid_iterator_t* iterator);
+
+// Get next record of pid, blocks which bloom filter rules pid out are skipped
+// record is NULL at the end, otherwise it points to record in journal (payload follows it) and stays valid until journal_delete
+journal_status_t journal_pid_next(journal_t* journal, journal_pid_iterator_t* iterator, const journal_record_t** record);
+
+// Copy aggregates of pid in O(1), JOURNAL_STATUS_ERROR_READ if pid has no records
+journal_status_t journal_aggregate_get(journal_t* journal, int32_t pid, journal_aggregate_t* aggregate);
+
+// Copy aggregates of all pids, up to *count entries, return count as amount of copied entries
+journal_status_t journal_aggregate_get_all(journal_t* journal, journal_aggregate_t* aggregates, size_t* count);
+
 #endif    // JOURNAL_H
\ No newline at end of file
@@ -0,0 +1,581 @@
+#include "journal_analyze.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "journal.h"
+#include "journal_reader.h"
+#include "utility.h"
+
+#define JOURNAL_ANALYZE_MIN_CHUNK_SIZE (256 * 1024)    // smaller chunks of text or records are not worth a thread
+#define JOURNAL_ANALYZE_TABLE_INITIAL_CAPACITY 64
+#define JOURNAL_ANALYZE_KEY_EMPTY INT64_MIN
+#define JOURNAL_ANALYZE_LINE_SIZE 256
+
+// Open addressing table of statistics by key, kept at most half full
+typedef struct journal_analyze_table
+{
+    journal_analyze_stats_t* slots;
+    size_t count;
+    size_t capacity;
+} journal_analyze_table_t;
+
+// State of one thread, iterator is limited to the chunk of the thread
+typedef struct journal_analyze_worker
+{
+    pthread_t thread;
+    journal_reader_iterator_t iterator;
+    int64_t bucket_seconds;
+    int64_t zone_hour;    // UTC hour of zone_offset
+    int64_t zone_offset;
+    journal_analyze_table_t pids;
+    journal_analyze_table_t buckets;
+    uint64_t records;
+    uint64_t invalid;
+    uint64_t skipped;
+    int error;
+} journal_analyze_worker_t;
+
+static int journal_analyze_table_init(journal_analyze_table_t* table, size_t capacity)
+{
+    table->slots = (journal_analyze_stats_t*)malloc(capacity * sizeof(journal_analyze_stats_t));
+    if (!table->slots)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        table->slots[i].key = JOURNAL_ANALYZE_KEY_EMPTY;
+    }
+    table->count = 0;
+    table->capacity = capacity;
+
+    return 0;
+}
+
+static size_t journal_analyze_table_slot(const journal_analyze_table_t* table, int64_t key)
+{
+    size_t mask = table->capacity - 1;
+    size_t slot = (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+
+    while (table->slots[slot].key != JOURNAL_ANALYZE_KEY_EMPTY && table->slots[slot].key != key)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static journal_analyze_stats_t* journal_analyze_table_get(journal_analyze_table_t* table, int64_t key)
+{
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        journal_analyze_table_t grown;
+        if (journal_analyze_table_init(&grown, table->capacity * 2) != 0)
+        {
+            return NULL;
+        }
+
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            if (table->slots[i].key != JOURNAL_ANALYZE_KEY_EMPTY)
+            {
+                grown.slots[journal_analyze_table_slot(&grown, table->slots[i].key)] = table->slots[i];
+            }
+        }
+        grown.count = table->count;
+
+        SAFE_FREE(table->slots);
+        *table = grown;
+    }
+
+    journal_analyze_stats_t* stats = &table->slots[journal_analyze_table_slot(table, key)];
+    if (stats->key == JOURNAL_ANALYZE_KEY_EMPTY)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->key = key;
+        table->count++;
+    }
+
+    return stats;
+}
+
+// Sampled or folded record stands for weight entries with its average cpu, folded record keeps range of them
+static void journal_analyze_stats_add(journal_analyze_stats_t* stats, const journal_reader_record_t* record)
+{
+    stats->count += record->weight;
+    if (record->status != JOURNAL_RECORD_STATUS_OK)
+    {
+        return;
+    }
+
+    if (stats->cpu_count == 0 || record->cpu_min < stats->cpu_min)
+    {
+        stats->cpu_min = record->cpu_min;
+    }
+    if (stats->cpu_count == 0 || record->cpu_max > stats->cpu_max)
+    {
+        stats->cpu_max = record->cpu_max;
+    }
+    stats->cpu_count += record->weight;
+    stats->cpu_sum += record->cpu * record->weight;
+}
+
+static void journal_analyze_stats_merge(journal_analyze_stats_t* stats, const journal_analyze_stats_t* other)
+{
+    if (other->cpu_count)
+    {
+        if (stats->cpu_count == 0 || other->cpu_min < stats->cpu_min)
+        {
+            stats->cpu_min = other->cpu_min;
+        }
+        if (stats->cpu_count == 0 || other->cpu_max > stats->cpu_max)
+        {
+            stats->cpu_max = other->cpu_max;
+        }
+    }
+    stats->count += other->count;
+    stats->cpu_count += other->cpu_count;
+    stats->cpu_sum += other->cpu_sum;
+}
+
+static int journal_analyze_table_merge(journal_analyze_table_t* table, const journal_analyze_table_t* other)
+{
+    for (size_t i = 0; i < other->capacity; i++)
+    {
+        if (other->slots[i].key == JOURNAL_ANALYZE_KEY_EMPTY)
+        {
+            continue;
+        }
+
+        journal_analyze_stats_t* stats = journal_analyze_table_get(table, other->slots[i].key);
+        if (!stats)
+        {
+            return -1;
+        }
+        journal_analyze_stats_merge(stats, &other->slots[i]);
+    }
+
+    return 0;
+}
+
+static int journal_analyze_compare_key(const void* a, const void* b)
+{
+    int64_t key_a = ((const journal_analyze_stats_t*)a)->key;
+    int64_t key_b = ((const journal_analyze_stats_t*)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// Copy used slots to sorted array
+static journal_analyze_stats_t* journal_analyze_table_to_array(const journal_analyze_table_t* table, size_t* count)
+{
+    journal_analyze_stats_t* array = (journal_analyze_stats_t*)malloc((table->count ? table->count : 1) * sizeof(journal_analyze_stats_t));
+    if (!array)
+    {
+        return NULL;
+    }
+
+    size_t used = 0;
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].key != JOURNAL_ANALYZE_KEY_EMPTY)
+        {
+            array[used++] = table->slots[i];
+        }
+    }
+    qsort(array, used, sizeof(journal_analyze_stats_t), journal_analyze_compare_key);
+
+    *count = used;
+    return array;
+}
+
+static int64_t journal_analyze_floor(int64_t value, int64_t step)
+{
+    int64_t quotient = value / step;
+    if (value % step != 0 && value < 0)
+    {
+        quotient--;
+    }
+    return quotient * step;
+}
+
+static int journal_analyze_worker_add(journal_analyze_worker_t* worker, int64_t time, int32_t pid, const journal_reader_record_t* record)
+{
+    journal_analyze_stats_t* bucket = journal_analyze_table_get(&worker->buckets, journal_analyze_floor(time, worker->bucket_seconds));
+    if (!bucket)
+    {
+        return -1;
+    }
+    journal_analyze_stats_add(bucket, record);
+    worker->records += record->weight;
+
+    if (pid == JOURNAL_PID_NONE)
+    {
+        worker->invalid += record->weight;
+        return 0;
+    }
+
+    journal_analyze_stats_t* stats = journal_analyze_table_get(&worker->pids, pid);
+    if (!stats)
+    {
+        return -1;
+    }
+    journal_analyze_stats_add(stats, record);
+
+    return 0;
+}
+
+// Local time seconds of ms since epoch, offset to UTC is kept for one hour
+static int64_t journal_analyze_local_time(journal_analyze_worker_t* worker, int64_t timestamp)
+{
+    int64_t seconds = journal_analyze_floor(timestamp, 1000) / 1000;
+    int64_t hour = journal_analyze_floor(seconds, 3600) / 3600;
+
+    if (hour != worker->zone_hour)
+    {
+        struct tm tm;
+        time_t hour_start = (time_t)(hour * 3600);
+        worker->zone_offset = localtime_r(&hour_start, &tm) ? (int64_t)tm.tm_gmtoff : 0;
+        worker->zone_hour = hour;
+    }
+
+    return seconds + worker->zone_offset;
+}
+
+static void* journal_analyze_worker_run(void* arg)
+{
+    journal_analyze_worker_t* worker = (journal_analyze_worker_t*)arg;
+    journal_reader_record_t record;
+
+    while (journal_reader_next(&worker->iterator, &record))
+    {
+        if (record.status == JOURNAL_RECORD_STATUS_NONE || record.status >= JOURNAL_RECORD_STATUS_COUNT)
+        {
+            worker->skipped++;
+            continue;
+        }
+
+        int32_t pid = record.status == JOURNAL_RECORD_STATUS_INVALID ? JOURNAL_PID_NONE : record.pid;
+        if (journal_analyze_worker_add(worker, journal_analyze_local_time(worker, record.timestamp), pid, &record) != 0)
+        {
+            worker->error = 1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static size_t journal_analyze_thread_count(const journal_analyze_options_t* options)
+{
+    long threads = options && options->threads ? (long)options->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+
+    return threads > JOURNAL_ANALYZE_MAX_THREADS ? JOURNAL_ANALYZE_MAX_THREADS : (size_t)threads;
+}
+
+// Run workers, first one in calling thread, workers which could not be started also run in calling thread
+static journal_analyze_status_t journal_analyze_run_workers(journal_analyze_worker_t* workers, size_t count, journal_analyze_result_t* result)
+{
+    int started[JOURNAL_ANALYZE_MAX_THREADS] = {0};
+
+    for (size_t i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&workers[i].thread, NULL, journal_analyze_worker_run, &workers[i]) == 0;
+        if (!started[i])
+        {
+            DEBUG_LOG("journal_analyze_run_workers: pthread_create failed, chunk %zu runs in calling thread\n", i);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!started[i])
+        {
+            journal_analyze_worker_run(&workers[i]);
+        }
+    }
+
+    journal_analyze_table_t pids, buckets;
+    int error = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    if (journal_analyze_table_init(&pids, JOURNAL_ANALYZE_TABLE_INITIAL_CAPACITY) != 0)
+    {
+        return JOURNAL_ANALYZE_STATUS_ERROR_MALLOC;
+    }
+    if (journal_analyze_table_init(&buckets, JOURNAL_ANALYZE_TABLE_INITIAL_CAPACITY) != 0)
+    {
+        SAFE_FREE(pids.slots);
+        return JOURNAL_ANALYZE_STATUS_ERROR_MALLOC;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        error |= workers[i].error;
+        error |= journal_analyze_table_merge(&pids, &workers[i].pids) != 0;
+        error |= journal_analyze_table_merge(&buckets, &workers[i].buckets) != 0;
+        result->records += workers[i].records;
+        result->invalid += workers[i].invalid;
+        result->skipped += workers[i].skipped;
+    }
+
+    if (!error)
+    {
+        result->pids = journal_analyze_table_to_array(&pids, &result->pid_count);
+        result->buckets = journal_analyze_table_to_array(&buckets, &result->bucket_count);
+        error = !result->pids || !result->buckets;
+    }
+
+    SAFE_FREE(pids.slots);
+    SAFE_FREE(buckets.slots);
+
+    return error ? JOURNAL_ANALYZE_STATUS_ERROR_MALLOC : JOURNAL_ANALYZE_STATUS_SUCCESS;
+}
+
+journal_analyze_status_t journal_analyze_file(const char* file_path, const journal_analyze_options_t* options, journal_analyze_result_t* result)
+{
+    if (!file_path || !result)
+    {
+        DEBUG_LOG("journal_analyze_file: file_path or result is NULL\n");
+        return JOURNAL_ANALYZE_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->bucket_seconds = options && options->bucket_seconds > 0 ? options->bucket_seconds : JOURNAL_ANALYZE_BUCKET_SECONDS;
+
+    journal_reader_t reader;
+    journal_reader_status_t reader_status = journal_reader_open(file_path, &reader);
+    if (reader_status != JOURNAL_READER_STATUS_SUCCESS)
+    {
+        return reader_status == JOURNAL_READER_STATUS_ERROR_OPEN ? JOURNAL_ANALYZE_STATUS_ERROR_OPEN
+             : reader_status == JOURNAL_READER_STATUS_ERROR_MMAP ? JOURNAL_ANALYZE_STATUS_ERROR_MMAP
+                                                                 : JOURNAL_ANALYZE_STATUS_ERROR_FORMAT;
+    }
+
+    // Text and records are split by bytes, columnar by blocks
+    size_t threads = journal_analyze_thread_count(options);
+    size_t max_threads = reader.format == JOURNAL_READER_FORMAT_COLUMNAR ? reader.columnar.block_count : reader.map_size / JOURNAL_ANALYZE_MIN_CHUNK_SIZE + 1;
+    if (threads > max_threads)
+    {
+        threads = max_threads ? max_threads : 1;
+    }
+
+    journal_analyze_status_t status = JOURNAL_ANALYZE_STATUS_SUCCESS;
+    journal_analyze_worker_t* workers = (journal_analyze_worker_t*)calloc(threads, sizeof(journal_analyze_worker_t));
+    if (!workers)
+    {
+        journal_reader_close(&reader);
+        return JOURNAL_ANALYZE_STATUS_ERROR_MALLOC;
+    }
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        journal_reader_iterator_init(&reader, &workers[i].iterator);
+        journal_reader_seek_cursor(&workers[i].iterator, journal_reader_split(&reader, i, threads));
+        journal_reader_set_end(&workers[i].iterator, journal_reader_split(&reader, i + 1, threads));
+        workers[i].bucket_seconds = result->bucket_seconds;
+        workers[i].zone_hour = INT64_MIN;
+
+        if (journal_analyze_table_init(&workers[i].pids, JOURNAL_ANALYZE_TABLE_INITIAL_CAPACITY) != 0
+            || journal_analyze_table_init(&workers[i].buckets, JOURNAL_ANALYZE_TABLE_INITIAL_CAPACITY) != 0)
+        {
+            status = JOURNAL_ANALYZE_STATUS_ERROR_MALLOC;
+        }
+    }
+
+    result->threads = threads;
+    if (status == JOURNAL_ANALYZE_STATUS_SUCCESS)
+    {
+        status = journal_analyze_run_workers(workers, threads, result);
+    }
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        SAFE_FREE(workers[i].pids.slots);
+        SAFE_FREE(workers[i].buckets.slots);
+    }
+    SAFE_FREE(workers);
+    journal_reader_close(&reader);
+
+    if (status != JOURNAL_ANALYZE_STATUS_SUCCESS)
+    {
+        journal_analyze_result_free(result);
+    }
+
+    return status;
+}
+
+static double journal_analyze_average(const journal_analyze_stats_t* stats)
+{
+    return stats->cpu_count ? stats->cpu_sum / (double)stats->cpu_count : 0.0;
+}
+
+static int journal_analyze_compare_average(const void* a, const void* b)
+{
+    double average_a = journal_analyze_average((const journal_analyze_stats_t*)a);
+    double average_b = journal_analyze_average((const journal_analyze_stats_t*)b);
+    if (average_a != average_b)
+    {
+        return average_a < average_b ? 1 : -1;
+    }
+    return journal_analyze_compare_key(a, b);
+}
+
+size_t journal_analyze_top(const journal_analyze_result_t* result, size_t k, journal_analyze_stats_t* top)
+{
+    if (!result || !top || k == 0 || result->pid_count == 0)
+    {
+        return 0;
+    }
+
+    journal_analyze_stats_t* sorted = (journal_analyze_stats_t*)malloc(result->pid_count * sizeof(journal_analyze_stats_t));
+    if (!sorted)
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < result->pid_count; i++)
+    {
+        if (result->pids[i].cpu_count)
+        {
+            sorted[count++] = result->pids[i];
+        }
+    }
+    qsort(sorted, count, sizeof(journal_analyze_stats_t), journal_analyze_compare_average);
+
+    if (count > k)
+    {
+        count = k;
+    }
+    memcpy(top, sorted, count * sizeof(journal_analyze_stats_t));
+    SAFE_FREE(sorted);
+
+    return count;
+}
+
+static int journal_analyze_append(char** text, size_t* used, size_t* capacity, const char* format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(*text + *used, *capacity - *used, format, args);
+        va_end(args);
+
+        if (written < 0)
+        {
+            return -1;
+        }
+
+        if ((size_t)written < *capacity - *used)
+        {
+            *used += (size_t)written;
+            return 0;
+        }
+
+        size_t new_capacity = *capacity * 2 + (size_t)written;
+        char* new_text = (char*)realloc(*text, new_capacity);
+        if (!new_text)
+        {
+            return -1;
+        }
+        *text = new_text;
+        *capacity = new_capacity;
+    }
+}
+
+char* journal_analyze_result_to_string(const journal_analyze_result_t* result, size_t top_k, size_t* length)
+{
+    if (!result || !length)
+    {
+        return NULL;
+    }
+
+    size_t capacity = (result->pid_count + result->bucket_count + top_k + 8) * JOURNAL_ANALYZE_LINE_SIZE;
+    size_t used = 0;
+    char* text = (char*)malloc(capacity);
+    if (!text)
+    {
+        return NULL;
+    }
+
+    int error = journal_analyze_append(&text, &used, &capacity, "records %llu invalid %llu skipped %llu threads %zu\n", (unsigned long long)result->records,
+                                       (unsigned long long)result->invalid, (unsigned long long)result->skipped, result->threads);
+
+    error |= journal_analyze_append(&text, &used, &capacity, "\npid count avg min max\n");
+    for (size_t i = 0; i < result->pid_count && !error; i++)
+    {
+        const journal_analyze_stats_t* stats = &result->pids[i];
+        error |= journal_analyze_append(&text, &used, &capacity, "%lld %llu %.3f %.3f %.3f\n", (long long)stats->key, (unsigned long long)stats->count,
+                                        journal_analyze_average(stats), stats->cpu_min, stats->cpu_max);
+    }
+
+    journal_analyze_stats_t* top = top_k ? (journal_analyze_stats_t*)malloc(top_k * sizeof(journal_analyze_stats_t)) : NULL;
+    size_t top_count = top ? journal_analyze_top(result, top_k, top) : 0;
+
+    error |= journal_analyze_append(&text, &used, &capacity, "\ntop %zu by avg\npid count avg max\n", top_count);
+    for (size_t i = 0; i < top_count && !error; i++)
+    {
+        error |= journal_analyze_append(&text, &used, &capacity, "%lld %llu %.3f %.3f\n", (long long)top[i].key, (unsigned long long)top[i].count,
+                                        journal_analyze_average(&top[i]), top[i].cpu_max);
+    }
+    SAFE_FREE(top);
+
+    error |= journal_analyze_append(&text, &used, &capacity, "\ntime count avg max (bucket %llds)\n", (long long)result->bucket_seconds);
+    for (size_t i = 0; i < result->bucket_count && !error; i++)
+    {
+        const journal_analyze_stats_t* stats = &result->buckets[i];
+
+        // Keys are local time as seconds since epoch, so they are printed without time zone conversion
+        struct tm tm;
+        char time_str[32] = "?";
+        time_t time = (time_t)stats->key;
+        if (gmtime_r(&time, &tm))
+        {
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm);
+        }
+
+        error |= journal_analyze_append(&text, &used, &capacity, "%s %llu %.3f %.3f\n", time_str, (unsigned long long)stats->count,
+                                        journal_analyze_average(stats), stats->cpu_max);
+    }
+
+    if (error)
+    {
+        SAFE_FREE(text);
+        return NULL;
+    }
+
+    *length = used;
+    return text;
+}
+
+void journal_analyze_result_free(journal_analyze_result_t* result)
+{
+    if (!result)
+    {
+        return;
+    }
+
+    SAFE_FREE(result->pids);
+    SAFE_FREE(result->buckets);
+    result->pid_count = 0;
+    result->bucket_count = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef JOURNAL_ANALYZE_H
+#define JOURNAL_ANALYZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Offline analysis of exported journal file in any format of journal_reader.h
+// File is mapped, split into chunks on record boundaries and chunks are parsed on all cores
+#define JOURNAL_ANALYZE_MAX_THREADS 64
+
+typedef enum journal_analyze_status
+{
+    JOURNAL_ANALYZE_STATUS_SUCCESS = 0,
+    JOURNAL_ANALYZE_STATUS_ERROR_PARAMS_NULL,
+    JOURNAL_ANALYZE_STATUS_ERROR_OPEN,
+    JOURNAL_ANALYZE_STATUS_ERROR_MMAP,
+    JOURNAL_ANALYZE_STATUS_ERROR_MALLOC,
+    JOURNAL_ANALYZE_STATUS_ERROR_FORMAT
+} journal_analyze_status_t;
+
+// Statistics of records with the same key (pid or start of time bucket), cpu fields are over records with cpu usage
+typedef struct journal_analyze_stats
+{
+    int64_t key;
+    uint64_t count;
+    uint64_t cpu_count;
+    double cpu_sum;
+    double cpu_min;
+    double cpu_max;
+} journal_analyze_stats_t;
+
+typedef struct journal_analyze_options
+{
+    size_t threads;            // 0 for number of online cpus
+    int64_t bucket_seconds;    // size of time histogram bucket, 0 for JOURNAL_ANALYZE_BUCKET_SECONDS
+} journal_analyze_options_t;
+
+typedef struct journal_analyze_result
+{
+    uint64_t records;                    // parsed records, sampled records are counted by weight
+    uint64_t invalid;                    // records of invalid requests, they have no pid
+    uint64_t skipped;                    // lines which are not records
+    size_t threads;                      // threads actually used
+    int64_t bucket_seconds;
+    journal_analyze_stats_t* pids;       // key is pid, sorted by pid
+    size_t pid_count;
+    journal_analyze_stats_t* buckets;    // key is bucket start in local time seconds, sorted by time
+    size_t bucket_count;
+} journal_analyze_result_t;
+
+// Analyze file, result must be freed by journal_analyze_result_free
+journal_analyze_status_t journal_analyze_file(const char* file_path, const journal_analyze_options_t* options, journal_analyze_result_t* result);
+
+// Copy up to k pids with highest average cpu usage to top, return amount of copied pids
+size_t journal_analyze_top(const journal_analyze_result_t* result, size_t k, journal_analyze_stats_t* top);
+
+// Format report: totals, per pid statistics, top k pids and time histogram, returned string must be freed
+char* journal_analyze_result_to_string(const journal_analyze_result_t* result, size_t top_k, size_t* length);
+
+void journal_analyze_result_free(journal_analyze_result_t* result);
+
+#endif    // JOURNAL_ANALYZE_H
@@ -0,0 +1,376 @@
+#include "journal_columnar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utility.h"
+
+#define JOURNAL_COLUMNAR_ALIGN 8
+#define JOURNAL_COLUMNAR_ALIGN_UP(size) (((size) + JOURNAL_COLUMNAR_ALIGN - 1) & ~(size_t)(JOURNAL_COLUMNAR_ALIGN - 1))
+
+typedef struct journal_columnar_file_header
+{
+    uint32_t magic;
+    uint32_t version;
+} journal_columnar_file_header_t;
+
+static int journal_columnar_write(journal_columnar_writer_t* writer, const void* data, size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, writer->file) != size)
+    {
+        DEBUG_LOG("journal_columnar_write: fwrite error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    writer->offset += size;
+    return 0;
+}
+
+static int journal_columnar_pad(journal_columnar_writer_t* writer)
+{
+    static const uint8_t zeros[JOURNAL_COLUMNAR_ALIGN] = {0};
+    return journal_columnar_write(writer, zeros, JOURNAL_COLUMNAR_ALIGN_UP(writer->offset) - writer->offset);
+}
+
+static size_t journal_columnar_varint_encode(uint64_t value, uint8_t* out)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        out[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (uint8_t)value;
+    return size;
+}
+
+static const uint8_t* journal_columnar_varint_decode(const uint8_t* in, const uint8_t* end, uint64_t* value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *in++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+journal_columnar_writer_t* journal_columnar_writer_open(const char* file_path)
+{
+    if (!file_path)
+    {
+        DEBUG_LOG("journal_columnar_writer_open: file_path is NULL\n");
+        return NULL;
+    }
+
+    journal_columnar_writer_t* writer = (journal_columnar_writer_t*)calloc(1, sizeof(journal_columnar_writer_t));
+    if (!writer)
+    {
+        DEBUG_LOG("journal_columnar_writer_open: malloc error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    writer->file = fopen(file_path, "wb");
+    if (!writer->file)
+    {
+        DEBUG_LOG("journal_columnar_writer_open: fopen error: %s\n", strerror(errno));
+        SAFE_FREE(writer);
+        return NULL;
+    }
+
+    journal_columnar_file_header_t header = {.magic = JOURNAL_COLUMNAR_MAGIC, .version = JOURNAL_COLUMNAR_VERSION};
+    if (journal_columnar_write(writer, &header, sizeof(header)) != 0)
+    {
+        fclose(writer->file);
+        SAFE_FREE(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+static journal_columnar_status_t journal_columnar_flush_block(journal_columnar_writer_t* writer)
+{
+    if (writer->count == 0)
+    {
+        return JOURNAL_COLUMNAR_STATUS_SUCCESS;
+    }
+
+    if (writer->block_count == writer->block_capacity)
+    {
+        size_t capacity = writer->block_capacity ? writer->block_capacity * 2 : 64;
+        journal_columnar_block_stats_t* blocks = (journal_columnar_block_stats_t*)realloc(writer->blocks, capacity * sizeof(journal_columnar_block_stats_t));
+        if (!blocks)
+        {
+            DEBUG_LOG("journal_columnar_flush_block: malloc error: %s\n", strerror(errno));
+            return JOURNAL_COLUMNAR_STATUS_ERROR_MALLOC;
+        }
+        writer->blocks = blocks;
+        writer->block_capacity = capacity;
+    }
+
+    journal_columnar_block_stats_t* stats = &writer->blocks[writer->block_count];
+    memset(stats, 0, sizeof(*stats));
+    stats->offset = writer->offset;
+    stats->record_count = (uint32_t)writer->count;
+    stats->t_min = writer->timestamps[0];
+    stats->t_max = writer->timestamps[0];
+    stats->pid_min = writer->pids[0];
+    stats->pid_max = writer->pids[0];
+
+    // Timestamps are zigzag varint deltas from previous record
+    uint8_t* deltas = writer->deltas;
+    size_t deltas_size = 0;
+    int cpu_seen = 0;
+
+    for (size_t i = 0; i < writer->count; i++)
+    {
+        int64_t delta = i ? (int64_t)((uint64_t)writer->timestamps[i] - (uint64_t)writer->timestamps[i - 1]) : 0;
+        deltas_size += journal_columnar_varint_encode(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63), deltas + deltas_size);
+
+        stats->t_min = writer->timestamps[i] < stats->t_min ? writer->timestamps[i] : stats->t_min;
+        stats->t_max = writer->timestamps[i] > stats->t_max ? writer->timestamps[i] : stats->t_max;
+        stats->pid_min = writer->pids[i] < stats->pid_min ? writer->pids[i] : stats->pid_min;
+        stats->pid_max = writer->pids[i] > stats->pid_max ? writer->pids[i] : stats->pid_max;
+        stats->status_mask |= 1u << (writer->statuses[i] & 31);
+
+        if (writer->statuses[i] == JOURNAL_RECORD_STATUS_OK)
+        {
+            stats->cpu_min = !cpu_seen || writer->cpu[i] < stats->cpu_min ? writer->cpu[i] : stats->cpu_min;
+            stats->cpu_max = !cpu_seen || writer->cpu[i] > stats->cpu_max ? writer->cpu[i] : stats->cpu_max;
+            cpu_seen = 1;
+        }
+    }
+
+    journal_columnar_block_header_t header = {
+        .record_count = (uint32_t)writer->count, .timestamps_size = (uint32_t)JOURNAL_COLUMNAR_ALIGN_UP(deltas_size), .t_first = writer->timestamps[0]};
+
+    if (journal_columnar_write(writer, &header, sizeof(header)) != 0 || journal_columnar_write(writer, deltas, deltas_size) != 0 || journal_columnar_pad(writer) != 0
+        || journal_columnar_write(writer, writer->pids, writer->count * sizeof(int32_t)) != 0 || journal_columnar_pad(writer) != 0
+        || journal_columnar_write(writer, writer->weights, writer->count * sizeof(uint32_t)) != 0 || journal_columnar_pad(writer) != 0
+        || journal_columnar_write(writer, writer->cpu, writer->count * sizeof(double)) != 0
+        || journal_columnar_write(writer, writer->statuses, writer->count * sizeof(uint8_t)) != 0
+        || journal_columnar_write(writer, writer->flags, writer->count * sizeof(uint8_t)) != 0 || journal_columnar_pad(writer) != 0)
+    {
+        return JOURNAL_COLUMNAR_STATUS_ERROR_WRITE;
+    }
+
+    writer->block_count++;
+    writer->count = 0;
+
+    return JOURNAL_COLUMNAR_STATUS_SUCCESS;
+}
+
+journal_columnar_status_t journal_columnar_writer_add(journal_columnar_writer_t* writer, const journal_record_t* record)
+{
+    if (!writer || !record)
+    {
+        DEBUG_LOG("journal_columnar_writer_add: writer or record is NULL\n");
+        return JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    // Full block is flushed before adding, so a failed flush is retried instead of overflowing the block
+    if (writer->count == JOURNAL_COLUMNAR_BLOCK_RECORDS)
+    {
+        journal_columnar_status_t status = journal_columnar_flush_block(writer);
+        if (status != JOURNAL_COLUMNAR_STATUS_SUCCESS)
+        {
+            return status;
+        }
+    }
+
+    writer->timestamps[writer->count] = record->timestamp;
+    writer->pids[writer->count] = record->pid;
+    writer->weights[writer->count] = record->weight ? record->weight : 1;
+    writer->cpu[writer->count] = record->status == JOURNAL_RECORD_STATUS_OK ? record->cpu : 0.0;
+    writer->statuses[writer->count] = (uint8_t)record->status;
+    writer->flags[writer->count] = record->flags;
+    writer->count++;
+
+    return JOURNAL_COLUMNAR_STATUS_SUCCESS;
+}
+
+journal_columnar_status_t journal_columnar_writer_close(journal_columnar_writer_t* writer)
+{
+    if (!writer)
+    {
+        DEBUG_LOG("journal_columnar_writer_close: writer is NULL\n");
+        return JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    journal_columnar_status_t status = journal_columnar_flush_block(writer);
+
+    if (status == JOURNAL_COLUMNAR_STATUS_SUCCESS)
+    {
+        journal_columnar_trailer_t trailer = {.footer_offset = writer->offset, .block_count = (uint32_t)writer->block_count, .magic = JOURNAL_COLUMNAR_MAGIC};
+        if (journal_columnar_write(writer, writer->blocks, writer->block_count * sizeof(journal_columnar_block_stats_t)) != 0
+            || journal_columnar_write(writer, &trailer, sizeof(trailer)) != 0)
+        {
+            status = JOURNAL_COLUMNAR_STATUS_ERROR_WRITE;
+        }
+    }
+
+    if (fclose(writer->file) != 0 && status == JOURNAL_COLUMNAR_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_columnar_writer_close: fclose error: %s\n", strerror(errno));
+        status = JOURNAL_COLUMNAR_STATUS_ERROR_WRITE;
+    }
+
+    SAFE_FREE(writer->blocks);
+    SAFE_FREE(writer);
+
+    return status;
+}
+
+journal_columnar_status_t journal_columnar_reader_open(const char* file_path, journal_columnar_reader_t* reader)
+{
+    if (!file_path || !reader)
+    {
+        DEBUG_LOG("journal_columnar_reader_open: file_path or reader is NULL\n");
+        return JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->fd = open(file_path, O_RDONLY);
+    if (reader->fd == -1)
+    {
+        DEBUG_LOG("journal_columnar_reader_open: open error: %s\n", strerror(errno));
+        return JOURNAL_COLUMNAR_STATUS_ERROR_OPEN;
+    }
+
+    struct stat file_stat;
+    if (fstat(reader->fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(journal_columnar_file_header_t) + sizeof(journal_columnar_trailer_t))
+    {
+        DEBUG_LOG("journal_columnar_reader_open: file is too small\n");
+        close(reader->fd);
+        return JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT;
+    }
+
+    reader->map_size = (size_t)file_stat.st_size;
+    void* map = mmap(NULL, reader->map_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        DEBUG_LOG("journal_columnar_reader_open: mmap error: %s\n", strerror(errno));
+        close(reader->fd);
+        return JOURNAL_COLUMNAR_STATUS_ERROR_MMAP;
+    }
+    reader->map = (const char*)map;
+
+    const journal_columnar_file_header_t* header = (const journal_columnar_file_header_t*)reader->map;
+    const journal_columnar_trailer_t* trailer = (const journal_columnar_trailer_t*)(reader->map + reader->map_size - sizeof(journal_columnar_trailer_t));
+    size_t footer_size = (size_t)trailer->block_count * sizeof(journal_columnar_block_stats_t);
+
+    if (header->magic != JOURNAL_COLUMNAR_MAGIC || header->version != JOURNAL_COLUMNAR_VERSION || trailer->magic != JOURNAL_COLUMNAR_MAGIC
+        || trailer->footer_offset % JOURNAL_COLUMNAR_ALIGN != 0 || trailer->footer_offset > reader->map_size - sizeof(journal_columnar_trailer_t)
+        || reader->map_size - sizeof(journal_columnar_trailer_t) - trailer->footer_offset != footer_size)
+    {
+        DEBUG_LOG("journal_columnar_reader_open: invalid header or footer\n");
+        journal_columnar_reader_close(reader);
+        return JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT;
+    }
+
+    reader->blocks = (const journal_columnar_block_stats_t*)(reader->map + trailer->footer_offset);
+    reader->block_count = trailer->block_count;
+
+    return JOURNAL_COLUMNAR_STATUS_SUCCESS;
+}
+
+int journal_columnar_block_may_match(const journal_columnar_block_stats_t* stats, int64_t t_from, int64_t t_to, int32_t pid)
+{
+    if (!stats || stats->t_max < t_from || stats->t_min > t_to)
+    {
+        return 0;
+    }
+
+    return pid == JOURNAL_PID_NONE || (pid >= stats->pid_min && pid <= stats->pid_max);
+}
+
+journal_columnar_status_t journal_columnar_read_block(const journal_columnar_reader_t* reader, size_t index, journal_columnar_block_t* block)
+{
+    if (!reader || !block)
+    {
+        DEBUG_LOG("journal_columnar_read_block: reader or block is NULL\n");
+        return JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (index >= reader->block_count)
+    {
+        DEBUG_LOG("journal_columnar_read_block: block %zu is out of %zu\n", index, reader->block_count);
+        return JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    const journal_columnar_block_stats_t* stats = &reader->blocks[index];
+    size_t data_end = (size_t)((const char*)reader->blocks - reader->map);
+    if (stats->offset % JOURNAL_COLUMNAR_ALIGN != 0 || stats->offset > data_end || data_end - stats->offset < sizeof(journal_columnar_block_header_t))
+    {
+        return JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT;
+    }
+
+    const journal_columnar_block_header_t* header = (const journal_columnar_block_header_t*)(reader->map + stats->offset);
+    size_t count = header->record_count;
+    size_t pids_offset = stats->offset + sizeof(journal_columnar_block_header_t) + header->timestamps_size;
+    size_t weights_offset = pids_offset + JOURNAL_COLUMNAR_ALIGN_UP(count * sizeof(int32_t));
+    size_t cpu_offset = weights_offset + JOURNAL_COLUMNAR_ALIGN_UP(count * sizeof(uint32_t));
+    size_t statuses_offset = cpu_offset + count * sizeof(double);
+    size_t flags_offset = statuses_offset + count;
+
+    if (count == 0 || count > JOURNAL_COLUMNAR_BLOCK_RECORDS || count != stats->record_count || header->timestamps_size % JOURNAL_COLUMNAR_ALIGN != 0
+        || flags_offset + count > data_end)
+    {
+        DEBUG_LOG("journal_columnar_read_block: invalid block %zu\n", index);
+        return JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT;
+    }
+
+    const uint8_t* deltas = (const uint8_t*)(header + 1);
+    const uint8_t* deltas_end = deltas + header->timestamps_size;
+    int64_t timestamp = header->t_first;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t zigzag = 0;
+        if (!(deltas = journal_columnar_varint_decode(deltas, deltas_end, &zigzag)))
+        {
+            return JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT;
+        }
+        timestamp = (int64_t)((uint64_t)timestamp + ((zigzag >> 1) ^ (0 - (zigzag & 1))));
+        block->timestamps[i] = timestamp;
+    }
+
+    block->record_count = count;
+    block->pids = (const int32_t*)(reader->map + pids_offset);
+    block->weights = (const uint32_t*)(reader->map + weights_offset);
+    block->cpu = (const double*)(reader->map + cpu_offset);
+    block->statuses = (const uint8_t*)(reader->map + statuses_offset);
+    block->flags = (const uint8_t*)(reader->map + flags_offset);
+
+    return JOURNAL_COLUMNAR_STATUS_SUCCESS;
+}
+
+void journal_columnar_reader_close(journal_columnar_reader_t* reader)
+{
+    if (!reader)
+    {
+        return;
+    }
+
+    // File is open while it is mapped
+    if (reader->map)
+    {
+        munmap((void*)reader->map, reader->map_size);
+        close(reader->fd);
+    }
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+}
@@ -0,0 +1,117 @@
+#ifndef JOURNAL_COLUMNAR_H
+#define JOURNAL_COLUMNAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "journal.h"
+
+// Columnar export of journal records for analytics:
+//   "JCOL" version, then blocks of up to JOURNAL_COLUMNAR_BLOCK_RECORDS records, each block is
+//   [block header][timestamps: varint deltas][pid: int32][weight: uint32][cpu: double][status: uint8][flags: uint8] (columns are 8-byte aligned)
+//   then footer with statistics of every block and trailer {footer offset, block count, "JCOL"}
+// Payload text is not exported, values are taken from record header (weight of sampled record, JOURNAL_RECORD_FLAG_* of folded run)
+#define JOURNAL_COLUMNAR_MAGIC 0x4C4F434Au
+#define JOURNAL_COLUMNAR_VERSION 2
+#define JOURNAL_COLUMNAR_BLOCK_RECORDS 4096
+#define JOURNAL_COLUMNAR_VARINT_MAX_SIZE 10
+
+typedef enum journal_columnar_status
+{
+    JOURNAL_COLUMNAR_STATUS_SUCCESS = 0,
+    JOURNAL_COLUMNAR_STATUS_ERROR_PARAMS_NULL,
+    JOURNAL_COLUMNAR_STATUS_ERROR_MALLOC,
+    JOURNAL_COLUMNAR_STATUS_ERROR_OPEN,
+    JOURNAL_COLUMNAR_STATUS_ERROR_WRITE,
+    JOURNAL_COLUMNAR_STATUS_ERROR_MMAP,
+    JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT
+} journal_columnar_status_t;
+
+// Statistics of block, stored in footer so blocks can be skipped without reading them
+typedef struct journal_columnar_block_stats
+{
+    uint64_t offset;          // offset of block header in file
+    uint32_t record_count;
+    uint32_t status_mask;     // bit (1 << status) of statuses in block
+    int64_t t_min;
+    int64_t t_max;
+    int32_t pid_min;
+    int32_t pid_max;
+    double cpu_min;           // over records with JOURNAL_RECORD_STATUS_OK, 0 if there are none
+    double cpu_max;
+} journal_columnar_block_stats_t;
+
+typedef struct journal_columnar_block_header
+{
+    uint32_t record_count;
+    uint32_t timestamps_size;    // bytes of varint deltas, padded to 8
+    int64_t t_first;
+} journal_columnar_block_header_t;
+
+typedef struct journal_columnar_trailer
+{
+    uint64_t footer_offset;
+    uint32_t block_count;
+    uint32_t magic;
+} journal_columnar_trailer_t;
+
+typedef struct journal_columnar_writer
+{
+    FILE* file;
+    uint64_t offset;
+    size_t count;    // records in current block
+    int64_t timestamps[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    int32_t pids[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    uint32_t weights[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    double cpu[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    uint8_t statuses[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    uint8_t flags[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    uint8_t deltas[JOURNAL_COLUMNAR_BLOCK_RECORDS * JOURNAL_COLUMNAR_VARINT_MAX_SIZE];
+    journal_columnar_block_stats_t* blocks;
+    size_t block_count;
+    size_t block_capacity;
+} journal_columnar_writer_t;
+
+typedef struct journal_columnar_reader
+{
+    int fd;
+    const char* map;
+    size_t map_size;
+    const journal_columnar_block_stats_t* blocks;    // footer in mapping
+    size_t block_count;
+} journal_columnar_reader_t;
+
+// Columns of one block: pid, weight, cpu, status and flags point into the mapping, timestamps are decoded to the block
+typedef struct journal_columnar_block
+{
+    size_t record_count;
+    int64_t timestamps[JOURNAL_COLUMNAR_BLOCK_RECORDS];
+    const int32_t* pids;
+    const uint32_t* weights;    // 1 or more
+    const double* cpu;
+    const uint8_t* statuses;
+    const uint8_t* flags;
+} journal_columnar_block_t;
+
+// Create file and write format header, writer must be closed by journal_columnar_writer_close
+journal_columnar_writer_t* journal_columnar_writer_open(const char* file_path);
+
+// Add record to current block, full block is written to file
+journal_columnar_status_t journal_columnar_writer_add(journal_columnar_writer_t* writer, const journal_record_t* record);
+
+// Write last block and footer, close file and free writer
+journal_columnar_status_t journal_columnar_writer_close(journal_columnar_writer_t* writer);
+
+// Map file and check its footer
+journal_columnar_status_t journal_columnar_reader_open(const char* file_path, journal_columnar_reader_t* reader);
+
+// Non-zero if statistics of block allow records in [t_from, t_to] of pid (JOURNAL_PID_NONE for any pid)
+int journal_columnar_block_may_match(const journal_columnar_block_stats_t* stats, int64_t t_from, int64_t t_to, int32_t pid);
+
+// Decode block columns
+journal_columnar_status_t journal_columnar_read_block(const journal_columnar_reader_t* reader, size_t index, journal_columnar_block_t* block);
+
+void journal_columnar_reader_close(journal_columnar_reader_t* reader);
+
+#endif    // JOURNAL_COLUMNAR_H
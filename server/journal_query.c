@@ -0,0 +1,639 @@
+#include "journal_query.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utility.h"
+
+#define JOURNAL_QUERY_TABLE_INITIAL_CAPACITY 64
+#define JOURNAL_QUERY_LINE_SIZE 256
+
+// Records of one batch decoded to columns
+typedef struct journal_query_batch
+{
+    size_t count;
+    int32_t pid[JOURNAL_QUERY_BATCH_SIZE];
+    uint32_t status[JOURNAL_QUERY_BATCH_SIZE];
+    uint32_t channel[JOURNAL_QUERY_BATCH_SIZE];
+    double cpu[JOURNAL_QUERY_BATCH_SIZE];
+    double cpu_max[JOURNAL_QUERY_BATCH_SIZE];
+    uint32_t weight[JOURNAL_QUERY_BATCH_SIZE];
+    uint8_t selected[JOURNAL_QUERY_BATCH_SIZE];
+} journal_query_batch_t;
+
+// Source of records: time range scan, or bloom filtered pid iterator if query is for one pid
+typedef struct journal_query_scan
+{
+    journal_range_t range;
+    journal_pid_iterator_t pid_iterator;
+    int by_pid;
+    int done;
+} journal_query_scan_t;
+
+static const char* journal_query_status_names[JOURNAL_RECORD_STATUS_COUNT] = {"none", "ok", "not_found", "invalid"};
+
+void journal_query_init(journal_query_t* query)
+{
+    if (!query)
+    {
+        return;
+    }
+
+    query->t_from = JOURNAL_TIME_MIN;
+    query->t_to = JOURNAL_TIME_MAX;
+    query->pid = JOURNAL_PID_NONE;
+    query->status_mask = 0;
+    query->channel_mask = 0;
+    query->group_by_pid = 1;
+    query->percentile_count = 3;
+    query->percentiles[0] = 50.0;
+    query->percentiles[1] = 90.0;
+    query->percentiles[2] = 99.0;
+}
+
+static int journal_query_parse_status(char* value, uint32_t* status_mask)
+{
+    char* saveptr = NULL;
+    *status_mask = 0;
+
+    for (char* name = strtok_r(value, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr))
+    {
+        int found = 0;
+        for (int status = 0; status < JOURNAL_RECORD_STATUS_COUNT; status++)
+        {
+            if (strcmp(name, journal_query_status_names[status]) == 0)
+            {
+                *status_mask |= JOURNAL_QUERY_STATUS_BIT(status);
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            return -1;
+        }
+    }
+
+    return *status_mask ? 0 : -1;
+}
+
+static int journal_query_parse_percentiles(char* value, journal_query_t* query)
+{
+    char* saveptr = NULL;
+    query->percentile_count = 0;
+
+    for (char* number = strtok_r(value, ",", &saveptr); number; number = strtok_r(NULL, ",", &saveptr))
+    {
+        char* end = NULL;
+        double percentile = strtod(number, &end);
+        if (end == number || *end != '\0' || !(percentile >= 0.0 && percentile <= 100.0) || query->percentile_count == JOURNAL_QUERY_MAX_PERCENTILES)
+        {
+            return -1;
+        }
+        query->percentiles[query->percentile_count++] = percentile;
+    }
+
+    return 0;
+}
+
+static int journal_query_parse_integer(const char* value, long long min, long long max, long long* result)
+{
+    char* end = NULL;
+    errno = 0;
+    long long number = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || errno != 0 || number < min || number > max)
+    {
+        return -1;
+    }
+
+    *result = number;
+    return 0;
+}
+
+journal_query_status_t journal_query_parse(const char* text, journal_query_t* query)
+{
+    if (!text || !query)
+    {
+        DEBUG_LOG("journal_query_parse: text or query is NULL\n");
+        return JOURNAL_QUERY_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    journal_query_init(query);
+
+    char* copy = strdup(text);
+    if (!copy)
+    {
+        DEBUG_LOG("journal_query_parse: strdup error: %s\n", strerror(errno));
+        return JOURNAL_QUERY_STATUS_ERROR_MALLOC;
+    }
+
+    journal_query_status_t status = JOURNAL_QUERY_STATUS_SUCCESS;
+    char* saveptr = NULL;
+
+    for (char* token = strtok_r(copy, " \t\r\n", &saveptr); token; token = strtok_r(NULL, " \t\r\n", &saveptr))
+    {
+        char* value = strchr(token, '=');
+        if (!value)
+        {
+            status = JOURNAL_QUERY_STATUS_ERROR_PARSE;
+            break;
+        }
+        *value++ = '\0';
+
+        long long number = 0;
+        int error = 0;
+
+        if (strcmp(token, "pid") == 0)
+        {
+            error = journal_query_parse_integer(value, 0, INT32_MAX, &number);
+            query->pid = (int32_t)number;
+        }
+        else if (strcmp(token, "from") == 0)
+        {
+            error = journal_query_parse_integer(value, INT64_MIN, INT64_MAX, &number);
+            query->t_from = number;
+        }
+        else if (strcmp(token, "to") == 0)
+        {
+            error = journal_query_parse_integer(value, INT64_MIN, INT64_MAX, &number);
+            query->t_to = number;
+        }
+        else if (strcmp(token, "status") == 0)
+        {
+            error = journal_query_parse_status(value, &query->status_mask);
+        }
+        else if (strcmp(token, "channel") == 0)
+        {
+            error = journal_channel_parse(value, &query->channel_mask);
+        }
+        else if (strcmp(token, "group") == 0)
+        {
+            error = strcmp(value, "pid") != 0 && strcmp(value, "none") != 0;
+            query->group_by_pid = strcmp(value, "pid") == 0;
+        }
+        else if (strcmp(token, "p") == 0)
+        {
+            error = journal_query_parse_percentiles(value, query);
+        }
+        else
+        {
+            error = 1;
+        }
+
+        if (error)
+        {
+            DEBUG_LOG("journal_query_parse: invalid parameter %s=%s\n", token, value);
+            status = JOURNAL_QUERY_STATUS_ERROR_PARSE;
+            break;
+        }
+    }
+
+    SAFE_FREE(copy);
+
+    return status;
+}
+
+static size_t journal_query_hash(int32_t pid, size_t capacity)
+{
+    return (size_t)(((uint32_t)pid * 0x9E3779B1u) >> 8) & (capacity - 1);
+}
+
+static int journal_query_table_grow(journal_query_result_t* result)
+{
+    size_t capacity = result->table_capacity ? result->table_capacity * 2 : JOURNAL_QUERY_TABLE_INITIAL_CAPACITY;
+    size_t* table = (size_t*)calloc(capacity, sizeof(size_t));
+    if (!table)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < result->group_count; i++)
+    {
+        size_t slot = journal_query_hash(result->groups[i].pid, capacity);
+        while (table[slot])
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = i + 1;
+    }
+
+    SAFE_FREE(result->table);
+    result->table = table;
+    result->table_capacity = capacity;
+
+    return 0;
+}
+
+static journal_query_group_t* journal_query_group_add(journal_query_result_t* result, int32_t pid)
+{
+    if (result->group_count == result->group_capacity)
+    {
+        size_t capacity = result->group_capacity ? result->group_capacity * 2 : 16;
+        journal_query_group_t* groups = (journal_query_group_t*)realloc(result->groups, capacity * sizeof(journal_query_group_t));
+        if (!groups)
+        {
+            return NULL;
+        }
+        result->groups = groups;
+        result->group_capacity = capacity;
+    }
+
+    journal_query_group_t* group = &result->groups[result->group_count++];
+    memset(group, 0, sizeof(*group));
+    group->pid = pid;
+
+    return group;
+}
+
+// Find group of pid or add it, keep table at most half full
+static journal_query_group_t* journal_query_group_find(journal_query_result_t* result, int32_t pid)
+{
+    if (2 * (result->group_count + 1) > result->table_capacity && journal_query_table_grow(result) != 0)
+    {
+        return NULL;
+    }
+
+    size_t slot = journal_query_hash(pid, result->table_capacity);
+    while (result->table[slot])
+    {
+        journal_query_group_t* group = &result->groups[result->table[slot] - 1];
+        if (group->pid == pid)
+        {
+            return group;
+        }
+        slot = (slot + 1) & (result->table_capacity - 1);
+    }
+
+    journal_query_group_t* group = journal_query_group_add(result, pid);
+    if (group)
+    {
+        result->table[slot] = result->group_count;
+    }
+
+    return group;
+}
+
+static void journal_query_scan_record(journal_query_batch_t* batch, const journal_record_t* record)
+{
+    batch->pid[batch->count] = record->pid;
+    batch->status[batch->count] = record->status;
+    batch->channel[batch->count] = record->channel;
+    batch->cpu[batch->count] = record->cpu;
+    batch->cpu_max[batch->count] = (record->flags & JOURNAL_RECORD_FLAG_FOLDED) ? ((const journal_fold_t*)(record + 1))->cpu_max : record->cpu;
+    batch->weight[batch->count] = record->weight ? record->weight : 1;
+    batch->count++;
+}
+
+// Decode next records of query time range to batch columns
+static void journal_query_scan_batch(journal_t* journal, const journal_query_t* query, journal_query_scan_t* scan, journal_query_batch_t* batch)
+{
+    batch->count = 0;
+
+    if (!scan->by_pid)
+    {
+        const journal_record_t* record = NULL;
+        while (batch->count < JOURNAL_QUERY_BATCH_SIZE && (record = journal_record_next(journal, &scan->range.offset, scan->range.end)))
+        {
+            journal_query_scan_record(batch, record);
+            scan->range.offset += JOURNAL_RECORD_SIZE(record->size);
+        }
+        scan->done = !record || scan->range.offset >= scan->range.end;
+        return;
+    }
+
+    while (batch->count < JOURNAL_QUERY_BATCH_SIZE)
+    {
+        const journal_record_t* record = NULL;
+        if (journal_pid_next(journal, &scan->pid_iterator, &record) != JOURNAL_STATUS_SUCCESS || !record || record->timestamp > query->t_to)
+        {
+            scan->done = 1;
+            return;
+        }
+        if (record->timestamp >= query->t_from)
+        {
+            journal_query_scan_record(batch, record);
+        }
+    }
+}
+
+// Filters are evaluated for whole batch without branches, so the loop is vectorized by compiler
+static void journal_query_filter_batch(const journal_query_t* query, journal_query_batch_t* batch)
+{
+    uint32_t status_mask = query->status_mask ? query->status_mask : UINT32_MAX;
+    uint32_t channel_mask = query->channel_mask ? query->channel_mask : UINT32_MAX;
+    int32_t pid = query->pid;
+    uint8_t any_pid = pid == JOURNAL_PID_NONE;
+
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        batch->selected[i] = (uint8_t)(((status_mask >> (batch->status[i] & 31)) & 1) & ((channel_mask >> (batch->channel[i] & 31)) & 1) & (any_pid | (batch->pid[i] == pid)));
+    }
+}
+
+// Sampled or folded record stands for weight entries with its average cpu, folded record keeps max of them
+static void journal_query_group_update(journal_query_group_t* group, uint32_t status, double cpu, double cpu_max, uint32_t weight)
+{
+    group->count += weight;
+
+    if (status != JOURNAL_RECORD_STATUS_OK)
+    {
+        return;
+    }
+
+    size_t bin = cpu > 0.0 ? (size_t)(cpu / JOURNAL_QUERY_HISTOGRAM_RESOLUTION) : 0;
+    if (bin >= JOURNAL_QUERY_HISTOGRAM_BINS)
+    {
+        bin = JOURNAL_QUERY_HISTOGRAM_BINS - 1;
+    }
+
+    group->histogram[bin] += weight;
+    group->cpu_sum += cpu * weight;
+    if (group->cpu_count == 0 || cpu_max > group->cpu_max)
+    {
+        group->cpu_max = cpu_max;
+    }
+    group->cpu_count += weight;
+}
+
+static int journal_query_group_compare(const void* first, const void* second)
+{
+    int32_t first_pid = ((const journal_query_group_t*)first)->pid;
+    int32_t second_pid = ((const journal_query_group_t*)second)->pid;
+    return (first_pid > second_pid) - (first_pid < second_pid);
+}
+
+journal_query_status_t journal_query_run(journal_t* journal, const journal_query_t* query, journal_query_result_t* result)
+{
+    if (!journal || !query || !result)
+    {
+        DEBUG_LOG("journal_query_run: journal or query or result is NULL\n");
+        return JOURNAL_QUERY_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    journal_query_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.by_pid = query->pid != JOURNAL_PID_NONE;
+
+    journal_status_t journal_status = scan.by_pid ? journal_find_pid(journal, query->pid, &scan.pid_iterator)
+                                                  : journal_range_begin(journal, query->t_from, query->t_to, &scan.range);
+    if (journal_status != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_query_run: journal scan failed with status: %d\n", journal_status);
+        return JOURNAL_QUERY_STATUS_ERROR_JOURNAL;
+    }
+
+    journal_query_group_t* total = NULL;
+    if (!query->group_by_pid && !(total = journal_query_group_add(result, JOURNAL_PID_NONE)))
+    {
+        goto journal_query_run_malloc_failed;
+    }
+
+    journal_query_batch_t* batch = (journal_query_batch_t*)malloc(sizeof(journal_query_batch_t));
+    if (!batch)
+    {
+        goto journal_query_run_malloc_failed;
+    }
+
+    while (!scan.done)
+    {
+        journal_query_scan_batch(journal, query, &scan, batch);
+        journal_query_filter_batch(query, batch);
+
+        for (size_t i = 0; i < batch->count; i++)
+        {
+            if (!batch->selected[i])
+            {
+                continue;
+            }
+
+            journal_query_group_t* group = total ? total : journal_query_group_find(result, batch->pid[i]);
+            if (!group)
+            {
+                SAFE_FREE(batch);
+                goto journal_query_run_malloc_failed;
+            }
+
+            journal_query_group_update(group, batch->status[i], batch->cpu[i], batch->cpu_max[i], batch->weight[i]);
+        }
+    }
+
+    SAFE_FREE(batch);
+
+    // Table is not needed after grouping, groups are sorted for stable output
+    SAFE_FREE(result->table);
+    result->table_capacity = 0;
+    if (result->group_count > 1)
+    {
+        qsort(result->groups, result->group_count, sizeof(journal_query_group_t), journal_query_group_compare);
+    }
+
+    return JOURNAL_QUERY_STATUS_SUCCESS;
+
+journal_query_run_malloc_failed:
+    DEBUG_LOG("journal_query_run: malloc error: %s\n", strerror(errno));
+    journal_query_result_free(result);
+
+    return JOURNAL_QUERY_STATUS_ERROR_MALLOC;
+}
+
+double journal_query_percentile(const journal_query_group_t* group, double percentile)
+{
+    if (!group || group->cpu_count == 0)
+    {
+        return 0.0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)group->cpu_count);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t bin = 0; bin < JOURNAL_QUERY_HISTOGRAM_BINS; bin++)
+    {
+        seen += group->histogram[bin];
+        if (seen >= rank)
+        {
+            // Middle of bin, but not above the real maximum
+            double value = ((double)bin + 0.5) * JOURNAL_QUERY_HISTOGRAM_RESOLUTION;
+            return value < group->cpu_max ? value : group->cpu_max;
+        }
+    }
+
+    return group->cpu_max;
+}
+
+// Append formatted text, grow buffer if needed
+static int journal_query_append(char** text, size_t* used, size_t* capacity, const char* format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(*text + *used, *capacity - *used, format, args);
+        va_end(args);
+
+        if (written < 0)
+        {
+            return -1;
+        }
+
+        if ((size_t)written < *capacity - *used)
+        {
+            *used += (size_t)written;
+            return 0;
+        }
+
+        size_t new_capacity = *capacity * 2 + (size_t)written;
+        char* new_text = (char*)realloc(*text, new_capacity);
+        if (!new_text)
+        {
+            return -1;
+        }
+        *text = new_text;
+        *capacity = new_capacity;
+    }
+}
+
+char* journal_query_result_to_string(const journal_query_t* query, const journal_query_result_t* result, size_t* length)
+{
+    if (!query || !result || !length)
+    {
+        DEBUG_LOG("journal_query_result_to_string: query or result or length is NULL\n");
+        return NULL;
+    }
+
+    size_t used = 0;
+    size_t capacity = (result->group_count + 1) * JOURNAL_QUERY_LINE_SIZE;
+    char* text = (char*)malloc(capacity);
+    if (!text)
+    {
+        goto journal_query_result_to_string_failed;
+    }
+
+    int error = journal_query_append(&text, &used, &capacity, "pid count avg max");
+    for (size_t i = 0; i < query->percentile_count; i++)
+    {
+        error |= journal_query_append(&text, &used, &capacity, " p%g", query->percentiles[i]);
+    }
+    error |= journal_query_append(&text, &used, &capacity, "\n");
+
+    for (size_t g = 0; g < result->group_count && !error; g++)
+    {
+        const journal_query_group_t* group = &result->groups[g];
+        double average = group->cpu_count ? group->cpu_sum / (double)group->cpu_count : 0.0;
+
+        if (group->pid == JOURNAL_PID_NONE)
+        {
+            error |= journal_query_append(&text, &used, &capacity, "all");
+        }
+        else
+        {
+            error |= journal_query_append(&text, &used, &capacity, "%d", group->pid);
+        }
+
+        error |= journal_query_append(&text, &used, &capacity, " %llu %.3f %.3f", (unsigned long long)group->count, average, group->cpu_max);
+        for (size_t i = 0; i < query->percentile_count; i++)
+        {
+            error |= journal_query_append(&text, &used, &capacity, " %.3f", journal_query_percentile(group, query->percentiles[i]));
+        }
+        error |= journal_query_append(&text, &used, &capacity, "\n");
+    }
+
+    if (error)
+    {
+        goto journal_query_result_to_string_failed;
+    }
+
+    *length = used;
+
+    return text;
+
+journal_query_result_to_string_failed:
+    DEBUG_LOG("journal_query_result_to_string: malloc error: %s\n", strerror(errno));
+    SAFE_FREE(text);
+
+    return NULL;
+}
+
+char* journal_query_aggregates_to_string(const journal_aggregate_t* aggregates, size_t count, int with_buckets, size_t* length)
+{
+    if ((!aggregates && count > 0) || !length)
+    {
+        DEBUG_LOG("journal_query_aggregates_to_string: aggregates or length is NULL\n");
+        return NULL;
+    }
+
+    size_t used = 0;
+    size_t capacity = (count + 1) * JOURNAL_QUERY_LINE_SIZE;
+    char* text = (char*)malloc(capacity);
+    if (!text)
+    {
+        goto journal_query_aggregates_to_string_failed;
+    }
+
+    int error = journal_query_append(&text, &used, &capacity, "pid count avg min max last\n");
+
+    for (size_t a = 0; a < count && !error; a++)
+    {
+        const journal_aggregate_t* aggregate = &aggregates[a];
+        double average = aggregate->cpu_count ? aggregate->cpu_sum / (double)aggregate->cpu_count : 0.0;
+
+        error |= journal_query_append(&text, &used, &capacity, "%d %llu %.3f %.3f %.3f %lld\n", aggregate->pid, (unsigned long long)aggregate->count, average,
+                                      aggregate->cpu_min, aggregate->cpu_max, (long long)aggregate->last_timestamp);
+
+        // Buckets from oldest to newest: "bucket <start> count avg max h0,h1,..."
+        for (size_t i = 1; with_buckets && i <= JOURNAL_AGGREGATE_BUCKETS && !error; i++)
+        {
+            const journal_aggregate_bucket_t* bucket = &aggregate->buckets[((size_t)(aggregate->last_timestamp / JOURNAL_AGGREGATE_BUCKET_MS) + i) % JOURNAL_AGGREGATE_BUCKETS];
+            if (bucket->count == 0 || bucket->start > aggregate->last_timestamp
+                || aggregate->last_timestamp - bucket->start >= (int64_t)JOURNAL_AGGREGATE_BUCKETS * JOURNAL_AGGREGATE_BUCKET_MS)
+            {
+                continue;
+            }
+
+            double bucket_average = bucket->cpu_count ? bucket->cpu_sum / (double)bucket->cpu_count : 0.0;
+            error |= journal_query_append(&text, &used, &capacity, "bucket %lld %u %.3f %.3f ", (long long)bucket->start, bucket->count, bucket_average, bucket->cpu_max);
+            for (size_t bin = 0; bin < JOURNAL_AGGREGATE_HISTOGRAM_BINS; bin++)
+            {
+                error |= journal_query_append(&text, &used, &capacity, bin ? ",%u" : "%u", bucket->histogram[bin]);
+            }
+            error |= journal_query_append(&text, &used, &capacity, "\n");
+        }
+    }
+
+    if (error)
+    {
+        goto journal_query_aggregates_to_string_failed;
+    }
+
+    *length = used;
+
+    return text;
+
+journal_query_aggregates_to_string_failed:
+    DEBUG_LOG("journal_query_aggregates_to_string: malloc error: %s\n", strerror(errno));
+    SAFE_FREE(text);
+
+    return NULL;
+}
+
+void journal_query_result_free(journal_query_result_t* result)
+{
+    if (!result)
+    {
+        return;
+    }
+
+    SAFE_FREE(result->groups);
+    SAFE_FREE(result->table);
+    result->group_count = 0;
+    result->group_capacity = 0;
+    result->table_capacity = 0;
+}
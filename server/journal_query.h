@@ -0,0 +1,88 @@
+#ifndef JOURNAL_QUERY_H
+#define JOURNAL_QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "journal.h"
+
+#define JOURNAL_QUERY_MAX_PERCENTILES 8
+
+// Records are decoded to columns by batches, filters and aggregates run over the columns
+#define JOURNAL_QUERY_BATCH_SIZE 256
+
+// Cpu percentiles are taken from histogram with fixed bins, values above the last bin go to it
+#define JOURNAL_QUERY_HISTOGRAM_BINS 2048
+#define JOURNAL_QUERY_HISTOGRAM_RESOLUTION 0.1
+
+#define JOURNAL_QUERY_STATUS_BIT(status) (1u << (status))
+
+typedef enum journal_query_status
+{
+    JOURNAL_QUERY_STATUS_SUCCESS = 0,
+    JOURNAL_QUERY_STATUS_ERROR_PARAMS_NULL,
+    JOURNAL_QUERY_STATUS_ERROR_PARSE,
+    JOURNAL_QUERY_STATUS_ERROR_MALLOC,
+    JOURNAL_QUERY_STATUS_ERROR_JOURNAL
+} journal_query_status_t;
+
+// Query text: space separated "key=value", all keys are optional
+//   pid=<pid>                         records of one process
+//   from=<ms> to=<ms>                 time range, ms since epoch, inclusive
+//   status=ok,not_found,invalid,none  records with one of statuses
+//   channel=results,errors,system     records of one of channels
+//   group=pid|none                    aggregate per pid or over all records
+//   p=50,90,99                        cpu percentiles
+typedef struct journal_query
+{
+    int64_t t_from;
+    int64_t t_to;
+    int32_t pid;             // JOURNAL_PID_NONE for all processes
+    uint32_t status_mask;    // JOURNAL_QUERY_STATUS_BIT of statuses, 0 for all
+    uint32_t channel_mask;   // JOURNAL_CHANNEL_BIT of channels, 0 for all
+    int group_by_pid;
+    size_t percentile_count;
+    double percentiles[JOURNAL_QUERY_MAX_PERCENTILES];
+} journal_query_t;
+
+typedef struct journal_query_group
+{
+    int32_t pid;           // JOURNAL_PID_NONE if records are not grouped
+    uint64_t count;        // matched entries (sum of record weights)
+    uint64_t cpu_count;    // matched entries with cpu usage
+    double cpu_sum;
+    double cpu_max;
+    uint32_t histogram[JOURNAL_QUERY_HISTOGRAM_BINS];
+} journal_query_group_t;
+
+typedef struct journal_query_result
+{
+    journal_query_group_t* groups;
+    size_t group_count;
+    size_t group_capacity;
+    size_t* table;    // open addressing pid -> group index + 1, 0 is empty slot
+    size_t table_capacity;
+} journal_query_result_t;
+
+// Set query to all records grouped by pid with p50, p90 and p99
+void journal_query_init(journal_query_t* query);
+
+// Parse query text over defaults of journal_query_init
+journal_query_status_t journal_query_parse(const char* text, journal_query_t* query);
+
+// Scan journal and aggregate matched records, result must be freed by journal_query_result_free
+journal_query_status_t journal_query_run(journal_t* journal, const journal_query_t* query, journal_query_result_t* result);
+
+// Cpu usage percentile of group, percentile is in [0, 100]
+double journal_query_percentile(const journal_query_group_t* group, double percentile);
+
+// Format result as text table "pid count avg max p<N>...", returned string must be freed
+char* journal_query_result_to_string(const journal_query_t* query, const journal_query_result_t* result, size_t* length);
+
+void journal_query_result_free(journal_query_result_t* result);
+
+// Format aggregates as text table "pid count avg min max last", with_buckets adds their time buckets after each pid
+// Returned string must be freed
+char* journal_query_aggregates_to_string(const journal_aggregate_t* aggregates, size_t count, int with_buckets, size_t* length);
+
+#endif    // JOURNAL_QUERY_H
@@ -0,0 +1,636 @@
+#include "journal_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "crc32c.h"
+#include "utility.h"
+
+// Binary search by time stops at this distance, the rest is scanned
+#define JOURNAL_READER_SEEK_LINEAR_SIZE (64 * 1024)
+#define JOURNAL_READER_CURSOR_INDEX_MASK 0xFFFFFFFFull
+#define JOURNAL_READER_CURSOR(block, index) (((uint64_t)(block) << 32) | (uint64_t)(index))
+
+const char* journal_reader_find_separator(const char* begin, const char* end)
+{
+    const char* p = begin;
+
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+
+    while (end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, newline), _mm_cmpeq_epi8(bytes, zero)));
+        if (mask)
+        {
+            return p + __builtin_ctz((unsigned int)mask);
+        }
+        p += 16;
+    }
+#endif
+
+    while (p < end && *p != '\n' && *p != '\0')
+    {
+        p++;
+    }
+
+    return p;
+}
+
+static int journal_reader_parse_digits(const char* p, size_t count, int64_t* value)
+{
+    *value = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (p[i] < '0' || p[i] > '9')
+        {
+            return -1;
+        }
+        *value = *value * 10 + (p[i] - '0');
+    }
+
+    return 0;
+}
+
+// Days since 1970-01-01 of proleptic Gregorian date
+static int64_t journal_reader_days_from_civil(int64_t year, int64_t month, int64_t day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Decimal "[-]digits[.digits]" as printed by "%f", whole [p, p + length) must be the number
+static int journal_reader_parse_double(const char* p, size_t length, double* value)
+{
+    size_t i = 0;
+    int negative = 0;
+    if (i < length && p[i] == '-')
+    {
+        negative = 1;
+        i++;
+    }
+
+    uint64_t mantissa = 0;
+    double scale = 1.0;
+    size_t digits = 0;
+    int point = 0;
+
+    for (; i < length; i++)
+    {
+        if (p[i] == '.' && !point)
+        {
+            point = 1;
+        }
+        else if (p[i] >= '0' && p[i] <= '9' && digits < 18)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(p[i] - '0');
+            scale *= point ? 10.0 : 1.0;
+            digits++;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (digits == 0)
+    {
+        return -1;
+    }
+
+    *value = (negative ? -(double)mantissa : (double)mantissa) / scale;
+    return 0;
+}
+
+// Parse "<pid> %<cpu>", "<pid> not found" or "invalid request", unknown text leaves JOURNAL_RECORD_STATUS_NONE
+static void journal_reader_parse_message(const char* text, size_t length, journal_reader_record_t* record)
+{
+    static const char invalid_text[] = "invalid request";
+    static const char not_found_text[] = "not found";
+
+    if (length == sizeof(invalid_text) - 1 && memcmp(text, invalid_text, length) == 0)
+    {
+        record->status = JOURNAL_RECORD_STATUS_INVALID;
+        return;
+    }
+
+    size_t pid_length = 0;
+    while (pid_length < length && pid_length < 10 && text[pid_length] >= '0' && text[pid_length] <= '9')
+    {
+        pid_length++;
+    }
+
+    int64_t pid = 0;
+    if (pid_length == 0 || pid_length + 1 >= length || text[pid_length] != ' ' || journal_reader_parse_digits(text, pid_length, &pid) || pid > INT32_MAX)
+    {
+        return;
+    }
+
+    text += pid_length + 1;
+    length -= pid_length + 1;
+
+    if (length == sizeof(not_found_text) - 1 && memcmp(text, not_found_text, length) == 0)
+    {
+        record->pid = (int32_t)pid;
+        record->status = JOURNAL_RECORD_STATUS_NOT_FOUND;
+    }
+    else if (text[0] == '%' && journal_reader_parse_double(text + 1, length - 1, &record->cpu) == 0)
+    {
+        record->pid = (int32_t)pid;
+        record->status = JOURNAL_RECORD_STATUS_OK;
+    }
+}
+
+int journal_reader_parse_line(const char* line, size_t length, int64_t* local_time, journal_reader_record_t* record)
+{
+    // "YYYY-MM-DD HH:MM:SS: "
+    static const size_t prefix_size = 21;
+
+    if (!line || !local_time || !record)
+    {
+        return -1;
+    }
+
+    record->pid = JOURNAL_PID_NONE;
+    record->source = -1;
+    record->status = JOURNAL_RECORD_STATUS_NONE;
+    record->cpu = 0.0;
+    record->weight = 1;
+    record->flags = 0;
+
+    // Optional "[<source>] " tag of merged journal
+    if (length > 0 && line[0] == '[')
+    {
+        size_t digits = 1;
+        while (digits < length && digits <= 10 && line[digits] >= '0' && line[digits] <= '9')
+        {
+            digits++;
+        }
+
+        int64_t source = 0;
+        if (digits > 1 && digits + 1 < length && line[digits] == ']' && line[digits + 1] == ' ' && journal_reader_parse_digits(line + 1, digits - 1, &source) == 0
+            && source <= INT32_MAX)
+        {
+            record->source = (int32_t)source;
+            line += digits + 2;
+            length -= digits + 2;
+        }
+    }
+
+    if (length < prefix_size || line[4] != '-' || line[7] != '-' || line[10] != ' ' || line[13] != ':' || line[16] != ':' || line[19] != ':' || line[20] != ' ')
+    {
+        return -1;
+    }
+
+    int64_t year, month, day, hour, minute, second;
+    if (journal_reader_parse_digits(line, 4, &year) || journal_reader_parse_digits(line + 5, 2, &month) || journal_reader_parse_digits(line + 8, 2, &day)
+        || journal_reader_parse_digits(line + 11, 2, &hour) || journal_reader_parse_digits(line + 14, 2, &minute)
+        || journal_reader_parse_digits(line + 17, 2, &second) || month < 1 || month > 12 || day < 1 || day > 31)
+    {
+        return -1;
+    }
+
+    *local_time = journal_reader_days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    journal_reader_parse_message(line + prefix_size, length - prefix_size, record);
+
+    return 0;
+}
+
+// Same checksum as journal_record_crc in journal.c
+static int journal_reader_record_valid(const journal_reader_t* reader, uint64_t offset)
+{
+    if (offset >= reader->map_size || reader->map_size - offset < sizeof(journal_record_t))
+    {
+        return 0;
+    }
+
+    const journal_record_t* record = (const journal_record_t*)(reader->map + offset);
+    if (record->magic != JOURNAL_RECORD_MAGIC || record->size > reader->map_size - offset - sizeof(journal_record_t))
+    {
+        return 0;
+    }
+
+    uint32_t crc = crc32c(0, &record->size, sizeof(journal_record_t) - offsetof(journal_record_t, size));
+    return record->crc == crc32c(crc, record + 1, record->size);
+}
+
+static uint64_t journal_reader_end(const journal_reader_t* reader)
+{
+    return reader->format == JOURNAL_READER_FORMAT_COLUMNAR ? JOURNAL_READER_CURSOR(reader->columnar.block_count, 0) : reader->map_size;
+}
+
+uint64_t journal_reader_align(const journal_reader_t* reader, uint64_t cursor)
+{
+    if (!reader)
+    {
+        return 0;
+    }
+
+    uint64_t end = journal_reader_end(reader);
+    if (cursor >= end)
+    {
+        return end;
+    }
+
+    switch (reader->format)
+    {
+    case JOURNAL_READER_FORMAT_TEXT:
+    {
+        if (cursor == 0 || reader->map[cursor - 1] == '\n' || reader->map[cursor - 1] == '\0')
+        {
+            return cursor;
+        }
+        const char* separator = journal_reader_find_separator(reader->map + cursor, reader->map + reader->map_size);
+        return (uint64_t)(separator - reader->map) + (separator < reader->map + reader->map_size);
+    }
+
+    case JOURNAL_READER_FORMAT_RECORDS:
+    {
+        // Damaged bytes are skipped in record alignment steps, as in journal_record_next
+        cursor = (cursor + JOURNAL_RECORD_ALIGN - 1) & ~(uint64_t)(JOURNAL_RECORD_ALIGN - 1);
+        while (cursor < end && !journal_reader_record_valid(reader, cursor))
+        {
+            cursor += JOURNAL_RECORD_ALIGN;
+        }
+        return cursor < end ? cursor : end;
+    }
+
+    case JOURNAL_READER_FORMAT_COLUMNAR:
+    {
+        size_t block = (size_t)(cursor >> 32);
+        return (cursor & JOURNAL_READER_CURSOR_INDEX_MASK) < reader->columnar.blocks[block].record_count ? cursor : JOURNAL_READER_CURSOR(block + 1, 0);
+    }
+    }
+
+    return end;
+}
+
+uint64_t journal_reader_split(const journal_reader_t* reader, size_t part, size_t parts)
+{
+    if (!reader || parts == 0 || part >= parts)
+    {
+        return reader ? journal_reader_end(reader) : 0;
+    }
+
+    if (reader->format == JOURNAL_READER_FORMAT_COLUMNAR)
+    {
+        return JOURNAL_READER_CURSOR(reader->columnar.block_count * part / parts, 0);
+    }
+
+    return reader->map_size / parts * part;
+}
+
+journal_reader_status_t journal_reader_open(const char* file_path, journal_reader_t* reader)
+{
+    if (!file_path || !reader)
+    {
+        DEBUG_LOG("journal_reader_open: file_path or reader is NULL\n");
+        return JOURNAL_READER_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1)
+    {
+        DEBUG_LOG("journal_reader_open: open error: %s\n", strerror(errno));
+        return JOURNAL_READER_STATUS_ERROR_OPEN;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        DEBUG_LOG("journal_reader_open: fstat error: %s\n", strerror(errno));
+        close(fd);
+        return JOURNAL_READER_STATUS_ERROR_OPEN;
+    }
+
+    // Empty file is an empty text journal, it can not be mapped
+    if (file_stat.st_size == 0)
+    {
+        close(fd);
+        return JOURNAL_READER_STATUS_SUCCESS;
+    }
+
+    reader->map_size = (size_t)file_stat.st_size;
+    void* map = mmap(NULL, reader->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        DEBUG_LOG("journal_reader_open: mmap error: %s\n", strerror(errno));
+        return JOURNAL_READER_STATUS_ERROR_MMAP;
+    }
+    reader->map = (const char*)map;
+
+    uint32_t magic = 0;
+    if (reader->map_size >= sizeof(magic))
+    {
+        memcpy(&magic, reader->map, sizeof(magic));
+    }
+
+    if (magic == JOURNAL_COLUMNAR_MAGIC)
+    {
+        munmap(map, reader->map_size);
+        if (journal_columnar_reader_open(file_path, &reader->columnar) != JOURNAL_COLUMNAR_STATUS_SUCCESS)
+        {
+            memset(reader, 0, sizeof(*reader));
+            return JOURNAL_READER_STATUS_ERROR_FORMAT;
+        }
+        reader->format = JOURNAL_READER_FORMAT_COLUMNAR;
+        reader->map = reader->columnar.map;
+        reader->map_size = reader->columnar.map_size;
+        return JOURNAL_READER_STATUS_SUCCESS;
+    }
+
+    reader->format = magic == JOURNAL_RECORD_MAGIC ? JOURNAL_READER_FORMAT_RECORDS : JOURNAL_READER_FORMAT_TEXT;
+    madvise(map, reader->map_size, MADV_SEQUENTIAL);
+
+    return JOURNAL_READER_STATUS_SUCCESS;
+}
+
+void journal_reader_close(journal_reader_t* reader)
+{
+    if (!reader)
+    {
+        return;
+    }
+
+    if (reader->format == JOURNAL_READER_FORMAT_COLUMNAR)
+    {
+        journal_columnar_reader_close(&reader->columnar);
+    }
+    else if (reader->map)
+    {
+        munmap((void*)reader->map, reader->map_size);
+    }
+
+    memset(reader, 0, sizeof(*reader));
+}
+
+void journal_reader_iterator_init(const journal_reader_t* reader, journal_reader_iterator_t* iterator)
+{
+    if (!reader || !iterator)
+    {
+        return;
+    }
+
+    iterator->reader = reader;
+    iterator->position = 0;
+    iterator->end = journal_reader_end(reader);
+    iterator->last_timestamp = JOURNAL_TIME_MIN;
+    iterator->zone_hour = INT64_MIN;
+    iterator->zone_offset = 0;
+    iterator->block_index = SIZE_MAX;
+    iterator->block.record_count = 0;
+}
+
+void journal_reader_seek_cursor(journal_reader_iterator_t* iterator, uint64_t cursor)
+{
+    if (!iterator || !iterator->reader)
+    {
+        return;
+    }
+
+    iterator->position = journal_reader_align(iterator->reader, cursor);
+    iterator->last_timestamp = JOURNAL_TIME_MIN;
+}
+
+void journal_reader_set_end(journal_reader_iterator_t* iterator, uint64_t cursor)
+{
+    if (!iterator || !iterator->reader)
+    {
+        return;
+    }
+
+    iterator->end = journal_reader_align(iterator->reader, cursor);
+}
+
+// Text has local time, offset to UTC is kept for one hour of local time
+static int64_t journal_reader_local_to_ms(journal_reader_iterator_t* iterator, int64_t local_time)
+{
+    int64_t hour = local_time / 3600 - (local_time % 3600 < 0);
+    if (hour != iterator->zone_hour)
+    {
+        struct tm tm;
+        time_t hour_start = (time_t)(hour * 3600);
+        iterator->zone_offset = 0;
+        if (gmtime_r(&hour_start, &tm))
+        {
+            tm.tm_isdst = -1;
+            time_t utc = mktime(&tm);
+            iterator->zone_offset = utc == (time_t)-1 ? 0 : hour * 3600 - (int64_t)utc;
+        }
+        iterator->zone_hour = hour;
+    }
+
+    return (local_time - iterator->zone_offset) * 1000;
+}
+
+static int journal_reader_next_text(journal_reader_iterator_t* iterator, journal_reader_record_t* record)
+{
+    const journal_reader_t* reader = iterator->reader;
+    const char* map_end = reader->map + reader->map_size;
+
+    while (iterator->position < iterator->end)
+    {
+        const char* line = reader->map + iterator->position;
+        const char* separator = journal_reader_find_separator(line, map_end);
+
+        record->cursor = iterator->position;
+        iterator->position = (uint64_t)(separator - reader->map) + (separator < map_end);
+
+        if (separator == line)
+        {
+            continue;
+        }
+
+        int64_t local_time = 0;
+        if (journal_reader_parse_line(line, (size_t)(separator - line), &local_time, record) == 0)
+        {
+            iterator->last_timestamp = journal_reader_local_to_ms(iterator, local_time);
+        }
+        record->timestamp = iterator->last_timestamp;
+        record->cpu_min = record->cpu;
+        record->cpu_max = record->cpu;
+        record->text = line;
+        record->text_size = (size_t)(separator - line);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int journal_reader_next_records(journal_reader_iterator_t* iterator, journal_reader_record_t* record)
+{
+    const journal_reader_t* reader = iterator->reader;
+
+    uint64_t offset = journal_reader_align(reader, iterator->position);
+    if (offset >= iterator->end)
+    {
+        iterator->position = iterator->end;
+        return 0;
+    }
+
+    const journal_record_t* frame = (const journal_record_t*)(reader->map + offset);
+    record->cursor = offset;
+    record->timestamp = frame->timestamp;
+    record->pid = frame->pid;
+    record->source = -1;
+    record->status = (journal_record_status_t)frame->status;
+    record->cpu = frame->cpu;
+    record->cpu_min = frame->cpu;
+    record->cpu_max = frame->cpu;
+    record->weight = frame->weight ? frame->weight : 1;
+    record->flags = frame->flags;
+    record->text = (const char*)(frame + 1);
+    record->text_size = frame->size;
+    if ((frame->flags & JOURNAL_RECORD_FLAG_FOLDED) && frame->size >= sizeof(journal_fold_t))
+    {
+        const journal_fold_t* fold = (const journal_fold_t*)(frame + 1);
+        record->cpu_min = fold->cpu_min;
+        record->cpu_max = fold->cpu_max;
+        record->text += sizeof(journal_fold_t);
+        record->text_size -= sizeof(journal_fold_t);
+    }
+
+    iterator->position = offset + JOURNAL_RECORD_SIZE(frame->size);
+    return 1;
+}
+
+static int journal_reader_next_columnar(journal_reader_iterator_t* iterator, journal_reader_record_t* record)
+{
+    const journal_reader_t* reader = iterator->reader;
+
+    while (iterator->position < iterator->end)
+    {
+        size_t block = (size_t)(iterator->position >> 32);
+        size_t index = (size_t)(iterator->position & JOURNAL_READER_CURSOR_INDEX_MASK);
+
+        if (block != iterator->block_index)
+        {
+            if (journal_columnar_read_block(&reader->columnar, block, &iterator->block) != JOURNAL_COLUMNAR_STATUS_SUCCESS)
+            {
+                DEBUG_LOG("journal_reader_next_columnar: skipped damaged block %zu\n", block);
+                iterator->position = JOURNAL_READER_CURSOR(block + 1, 0);
+                continue;
+            }
+            iterator->block_index = block;
+        }
+
+        if (index >= iterator->block.record_count)
+        {
+            iterator->position = JOURNAL_READER_CURSOR(block + 1, 0);
+            continue;
+        }
+
+        record->cursor = iterator->position;
+        record->timestamp = iterator->block.timestamps[index];
+        record->pid = iterator->block.pids[index];
+        record->source = -1;
+        record->status = (journal_record_status_t)iterator->block.statuses[index];
+        record->cpu = iterator->block.cpu[index];
+        record->cpu_min = record->cpu;
+        record->cpu_max = record->cpu;
+        record->weight = iterator->block.weights[index] ? iterator->block.weights[index] : 1;
+        record->flags = iterator->block.flags[index];
+        record->text = NULL;
+        record->text_size = 0;
+
+        iterator->position++;
+        return 1;
+    }
+
+    return 0;
+}
+
+int journal_reader_next(journal_reader_iterator_t* iterator, journal_reader_record_t* record)
+{
+    if (!iterator || !iterator->reader || !record)
+    {
+        return 0;
+    }
+
+    switch (iterator->reader->format)
+    {
+    case JOURNAL_READER_FORMAT_TEXT:
+        return journal_reader_next_text(iterator, record);
+    case JOURNAL_READER_FORMAT_RECORDS:
+        return journal_reader_next_records(iterator, record);
+    case JOURNAL_READER_FORMAT_COLUMNAR:
+        return journal_reader_next_columnar(iterator, record);
+    }
+
+    return 0;
+}
+
+void journal_reader_seek_time(journal_reader_iterator_t* iterator, int64_t t_from)
+{
+    if (!iterator || !iterator->reader)
+    {
+        return;
+    }
+
+    const journal_reader_t* reader = iterator->reader;
+    journal_reader_record_t record;
+    uint64_t low = iterator->position;
+
+    if (reader->format == JOURNAL_READER_FORMAT_COLUMNAR)
+    {
+        // Footer statistics give the first block which can have the time
+        size_t block = (size_t)(low >> 32);
+        while (block < reader->columnar.block_count && reader->columnar.blocks[block].t_max < t_from)
+        {
+            block++;
+        }
+        if (JOURNAL_READER_CURSOR(block, 0) > low)
+        {
+            low = JOURNAL_READER_CURSOR(block, 0);
+        }
+    }
+    else
+    {
+        uint64_t high = iterator->end;
+        while (high - low > JOURNAL_READER_SEEK_LINEAR_SIZE)
+        {
+            uint64_t middle = low + (high - low) / 2;
+            iterator->position = journal_reader_align(reader, middle);
+            iterator->last_timestamp = JOURNAL_TIME_MIN;
+
+            if (!journal_reader_next(iterator, &record) || record.timestamp >= t_from)
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle;
+            }
+        }
+    }
+
+    journal_reader_seek_cursor(iterator, low);
+    while (journal_reader_next(iterator, &record))
+    {
+        if (record.timestamp >= t_from)
+        {
+            iterator->position = record.cursor;
+            return;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef JOURNAL_READER_H
+#define JOURNAL_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "journal.h"
+#include "journal_columnar.h"
+
+// Reader of exported journal files, built as separate journal_reader library for tools:
+//   text      lines "[<source>] YYYY-MM-DD HH:MM:SS: <pid> %<cpu>" separated by '\n' or '\0' (as written by journal_utility),
+//             source tag is written only by merge of several journals
+//   records   framed journal records (GET_RECORDS response)
+//   columnar  see journal_columnar.h
+// File is mapped once, iterator does not allocate and returns views into the mapping
+typedef enum journal_reader_status
+{
+    JOURNAL_READER_STATUS_SUCCESS = 0,
+    JOURNAL_READER_STATUS_ERROR_PARAMS_NULL,
+    JOURNAL_READER_STATUS_ERROR_OPEN,
+    JOURNAL_READER_STATUS_ERROR_MMAP,
+    JOURNAL_READER_STATUS_ERROR_FORMAT
+} journal_reader_status_t;
+
+typedef enum journal_reader_format
+{
+    JOURNAL_READER_FORMAT_TEXT = 0,
+    JOURNAL_READER_FORMAT_RECORDS,
+    JOURNAL_READER_FORMAT_COLUMNAR
+} journal_reader_format_t;
+
+typedef struct journal_reader
+{
+    journal_reader_format_t format;
+    const char* map;    // NULL for empty file
+    size_t map_size;
+    journal_columnar_reader_t columnar;
+} journal_reader_t;
+
+// Record view, text points into the mapping and is valid until journal_reader_close
+typedef struct journal_reader_record
+{
+    uint64_t cursor;                   // position of record for journal_reader_seek_cursor
+    int64_t timestamp;                 // ms since epoch, text lines without time have time of previous line
+    int32_t pid;                       // JOURNAL_PID_NONE if record is not related to a process
+    int32_t source;                    // source instance of merged text journal ("[<source>] " line tag), -1 if not tagged
+    journal_record_status_t status;    // JOURNAL_RECORD_STATUS_NONE for lines which are not records
+    double cpu;                        // average cpu of folded record
+    double cpu_min;                    // cpu range of folded record, cpu for other records
+    double cpu_max;
+    uint32_t weight;                   // entries represented by record (journal_record_t weight), 1 for text
+    uint8_t flags;                     // JOURNAL_RECORD_FLAG_* of record, 0 for text
+    const char* text;                  // line without separator or record payload (without fold), NULL for columnar
+    size_t text_size;
+} journal_reader_record_t;
+
+// Cursor is byte offset for text and records, (block << 32 | index in block) for columnar
+typedef struct journal_reader_iterator
+{
+    const journal_reader_t* reader;
+    uint64_t position;          // cursor of next record
+    uint64_t end;               // iteration stops at this cursor
+    int64_t last_timestamp;
+    int64_t zone_hour;          // local hour of zone_offset, text time is local
+    int64_t zone_offset;
+    size_t block_index;         // decoded columnar block, SIZE_MAX if none
+    journal_columnar_block_t block;
+} journal_reader_iterator_t;
+
+// Map file and detect its format, reader must be closed by journal_reader_close
+journal_reader_status_t journal_reader_open(const char* file_path, journal_reader_t* reader);
+
+void journal_reader_close(journal_reader_t* reader);
+
+// Iterate over whole file
+void journal_reader_iterator_init(const journal_reader_t* reader, journal_reader_iterator_t* iterator);
+
+// Cursor of first record at or after cursor, which does not have to be a record start
+uint64_t journal_reader_align(const journal_reader_t* reader, uint64_t cursor);
+
+// Cursor near part / parts of file, for splitting file between threads (align it to get record start)
+uint64_t journal_reader_split(const journal_reader_t* reader, size_t part, size_t parts);
+
+// Continue from first record at or after cursor
+void journal_reader_seek_cursor(journal_reader_iterator_t* iterator, uint64_t cursor);
+
+// Continue from first record with timestamp >= t_from, records are expected to be ordered by time
+void journal_reader_seek_time(journal_reader_iterator_t* iterator, int64_t t_from);
+
+// Stop before cursor (aligned to record start)
+void journal_reader_set_end(journal_reader_iterator_t* iterator, uint64_t cursor);
+
+// Next record, returns 0 at the end
+int journal_reader_next(journal_reader_iterator_t* iterator, journal_reader_record_t* record);
+
+// Find first '\n' or '\0' in [begin, end) with SSE2 compares of 16 bytes (end if there is none)
+const char* journal_reader_find_separator(const char* begin, const char* end);
+
+// Parse one text line without separator, time is local seconds since 1970-01-01 00:00:00, return 0 on success
+int journal_reader_parse_line(const char* line, size_t length, int64_t* local_time, journal_reader_record_t* record);
+
+#endif    // JOURNAL_READER_H
@@ -1,6 +1,11 @@
+#define _GNU_SOURCE
+
 #include "journal_transfer.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,8 +15,258 @@
 #include <unistd.h>
 
 #include "config.h"
+#include "journal_columnar.h"
+#include "journal_query.h"
+#include "journal_uring.h"
 #include "utility.h"
 
+_Static_assert(JOURNAL_RECORD_SIZE(JOURNAL_RECORD_MAX_DATA_SIZE + sizeof(journal_fold_t)) <= JOURNAL_TRANSFER_CHUNK_SIZE, "journal record must fit to transfer chunk");
+
+static journal_transfer_stats_t journal_transfer_stats = NULL;
+
+static int journal_transfer_send_all(int sockfd, const void* data, size_t length)
+{
+    const char* ptr = (const char*)data;
+
+    while (length > 0)
+    {
+        ssize_t bytes_sent = send(sockfd, ptr, length, MSG_NOSIGNAL);
+        if (bytes_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            DEBUG_LOG("Error: unix socket send: %s\n", strerror(errno));
+            return -1;
+        }
+        ptr += bytes_sent;
+        length -= (size_t)bytes_sent;
+    }
+
+    return 0;
+}
+
+static int journal_transfer_recv_all(int sockfd, void* data, size_t length)
+{
+    char* ptr = (char*)data;
+
+    while (length > 0)
+    {
+        ssize_t bytes_received = recv(sockfd, ptr, length, 0);
+        if (bytes_received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_received <= 0)
+        {
+            DEBUG_LOG("Error: unix socket recv: %s\n", bytes_received == 0 ? "connection closed" : strerror(errno));
+            return -1;
+        }
+        ptr += bytes_received;
+        length -= (size_t)bytes_received;
+    }
+
+    return 0;
+}
+
+// Send payloads (or whole records if records is set) of channels in [t_from, t_to]: 64-bit length first, then content streamed by chunks
+static int journal_transfer_send_range(int client_sockfd, journal_t* journal, int64_t t_from, int64_t t_to, uint32_t channel_mask, int records)
+{
+    journal_range_t range;
+    journal_status_t range_status = journal_range_begin_channels(journal, t_from, t_to, channel_mask, &range);
+    if (range_status != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_range_begin failed with status: %d\n", range_status);
+        return -1;
+    }
+
+    size_t range_size = records ? range.records_size : range.size;
+    uint64_t wire_length = range_size;
+    if (journal_transfer_send_all(client_sockfd, &wire_length, sizeof(wire_length)) != 0)
+    {
+        return -1;
+    }
+
+    void* journal_content = malloc(JOURNAL_TRANSFER_CHUNK_SIZE);
+    if (!journal_content)
+    {
+        DEBUG_LOG("Error: journal content malloc");
+        return -1;
+    }
+
+    size_t sent = 0;
+    while (sent < range_size)
+    {
+        size_t chunk_length = JOURNAL_TRANSFER_CHUNK_SIZE;
+
+        journal_status_t read_status = records ? journal_range_read_records(journal, &range, journal_content, &chunk_length)
+                                               : journal_range_read(journal, &range, journal_content, &chunk_length);
+        if (read_status != JOURNAL_STATUS_SUCCESS || chunk_length == 0)
+        {
+            DEBUG_LOG("Journal_read failed with status: %d\n", read_status);
+            SAFE_FREE(journal_content);
+            return -1;
+        }
+
+        if (journal_transfer_send_all(client_sockfd, journal_content, chunk_length) != 0)
+        {
+            SAFE_FREE(journal_content);
+            return -1;
+        }
+
+        sent += chunk_length;
+    }
+
+    DEBUG_LOG("Parent sent journal content: %zu bytes\n", sent);
+
+    SAFE_FREE(journal_content);
+
+    return 0;
+}
+
+// Send text answer: 64-bit length, then text, text is freed
+static int journal_transfer_send_text(int client_sockfd, char* text, size_t length)
+{
+    if (!text)
+    {
+        return -1;
+    }
+
+    uint64_t wire_length = length;
+    int send_result = journal_transfer_send_all(client_sockfd, &wire_length, sizeof(wire_length));
+    if (send_result == 0)
+    {
+        send_result = journal_transfer_send_all(client_sockfd, text, length);
+    }
+
+    SAFE_FREE(text);
+
+    return send_result;
+}
+
+// Evaluate query on journal and send only result table
+static int journal_transfer_send_query(int client_sockfd, journal_t* journal, const char* query_text)
+{
+    journal_query_t query;
+    journal_query_status_t query_status = journal_query_parse(query_text, &query);
+    if (query_status != JOURNAL_QUERY_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("Error: invalid journal query: %s\n", query_text);
+        return -1;
+    }
+
+    journal_query_result_t result;
+    query_status = journal_query_run(journal, &query, &result);
+    if (query_status != JOURNAL_QUERY_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_query_run failed with status: %d\n", query_status);
+        return -1;
+    }
+
+    size_t length = 0;
+    char* text = journal_query_result_to_string(&query, &result, &length);
+    journal_query_result_free(&result);
+
+    return journal_transfer_send_text(client_sockfd, text, length);
+}
+
+// Send materialized aggregates without scanning journal: one pid with time buckets or all pids
+static int journal_transfer_send_aggregate(int client_sockfd, journal_t* journal, const char* args)
+{
+    long long pid = JOURNAL_PID_NONE;
+    if (sscanf(args, "%lld", &pid) == 1 && (pid < 0 || pid > INT32_MAX))
+    {
+        DEBUG_LOG("Error: invalid aggregate request pid: %s\n", args);
+        return -1;
+    }
+
+    size_t count = pid == JOURNAL_PID_NONE ? journal->aggregate_capacity : 1;
+    journal_aggregate_t* aggregates = (journal_aggregate_t*)malloc(count * sizeof(journal_aggregate_t));
+    if (!aggregates)
+    {
+        DEBUG_LOG("Error: aggregates malloc\n");
+        return -1;
+    }
+
+    journal_status_t status = JOURNAL_STATUS_SUCCESS;
+    if (pid == JOURNAL_PID_NONE)
+    {
+        status = journal_aggregate_get_all(journal, aggregates, &count);
+    }
+    else if (journal_aggregate_get(journal, (int32_t)pid, aggregates) != JOURNAL_STATUS_SUCCESS)
+    {
+        // Pid without records gives empty table
+        count = 0;
+    }
+
+    if (status != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("journal_aggregate_get_all failed with status: %d\n", status);
+        SAFE_FREE(aggregates);
+        return -1;
+    }
+
+    size_t length = 0;
+    char* text = journal_query_aggregates_to_string(aggregates, count, pid != JOURNAL_PID_NONE, &length);
+    SAFE_FREE(aggregates);
+
+    return journal_transfer_send_text(client_sockfd, text, length);
+}
+
+void journal_transfer_set_stats(journal_transfer_stats_t stats)
+{
+    journal_transfer_stats = stats;
+}
+
+// Requests: "GET_JOURNAL [<t_from_ms> <t_to_ms> [<channels>]]", "GET_RECORDS [<t_from_ms> <t_to_ms> [<channels>]]", "QUERY <query>", "AGGREGATE [<pid>]" or "STATS"
+// Channels are comma separated names (see journal_channel_parse), all channels are sent if they are not given
+static int journal_transfer_handle_request(int client_sockfd, journal_t* journal, const char* request)
+{
+    long long t_from = JOURNAL_TIME_MIN, t_to = JOURNAL_TIME_MAX;
+    int records = strncmp(request, JOURNAL_TRANSFER_GET_RECORDS, strlen(JOURNAL_TRANSFER_GET_RECORDS)) == 0;
+
+    if (records || strncmp(request, JOURNAL_TRANSFER_GET_JOURNAL, strlen(JOURNAL_TRANSFER_GET_JOURNAL)) == 0)
+    {
+        const char* args = request + (records ? strlen(JOURNAL_TRANSFER_GET_RECORDS) : strlen(JOURNAL_TRANSFER_GET_JOURNAL));
+        char channels[JOURNAL_TRANSFER_REQUEST_SIZE];
+        uint32_t channel_mask = JOURNAL_CHANNEL_ALL;
+        int fields = *args != '\0' ? sscanf(args, "%lld %lld %255s", &t_from, &t_to, channels) : 0;
+        if ((*args != '\0' && fields < 2) || (fields == 3 && journal_channel_parse(channels, &channel_mask) != 0))
+        {
+            DEBUG_LOG("Error: invalid journal range request: %s\n", request);
+            return -1;
+        }
+        return journal_transfer_send_range(client_sockfd, journal, t_from, t_to, channel_mask, records);
+    }
+
+    if (strncmp(request, JOURNAL_TRANSFER_QUERY, strlen(JOURNAL_TRANSFER_QUERY)) == 0)
+    {
+        return journal_transfer_send_query(client_sockfd, journal, request + strlen(JOURNAL_TRANSFER_QUERY));
+    }
+
+    if (strncmp(request, JOURNAL_TRANSFER_AGGREGATE, strlen(JOURNAL_TRANSFER_AGGREGATE)) == 0)
+    {
+        return journal_transfer_send_aggregate(client_sockfd, journal, request + strlen(JOURNAL_TRANSFER_AGGREGATE));
+    }
+
+    if (strncmp(request, JOURNAL_TRANSFER_STATS, strlen(JOURNAL_TRANSFER_STATS)) == 0)
+    {
+        if (!journal_transfer_stats)
+        {
+            DEBUG_LOG("Error: stats source is not set\n");
+            return -1;
+        }
+
+        size_t length = 0;
+        char* text = journal_transfer_stats(&length);
+        return journal_transfer_send_text(client_sockfd, text, length);
+    }
+
+    DEBUG_LOG("Error: unknown journal transfer request: %s\n", request);
+    return -1;
+}
+
 int journal_transfer_run_receiver(const char* socket_path, journal_t* journal)
 {
     int sockfd, client_sockfd;
@@ -53,50 +308,26 @@ int journal_transfer_run_receiver(const char* socket_path, journal_t* journal)
 
     printf("Journal transfer started (PID %d)\n", getpid());
 
-    size_t journal_length = SERVER_MAX_JOURNAL_SIZE;
-
-    void* journal_content = malloc(SERVER_MAX_JOURNAL_SIZE);
-    if (!journal_content)
+    // Wait for request, so the client is not cut off in the middle of sending it
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    ssize_t request_length = recv(client_sockfd, request, sizeof(request) - 1, 0);
+    if (request_length <= 0)
     {
-        DEBUG_LOG("Error: journal content malloc");
+        DEBUG_LOG("Error: unix socket recv request");
         close(client_sockfd);
         return -1;
     }
+    request[request_length] = '\0';
 
-    journal_status_t read_status = journal_read(journal, journal_content, &journal_length);
-    if (read_status != JOURNAL_STATUS_SUCCESS)
-    {
-        DEBUG_LOG("Journal_read failed with status: %d\n", read_status);
-        close(client_sockfd);
-        SAFE_FREE(journal_content);
-        return -1;
-    }
-
-    ssize_t bytes_sent = send(client_sockfd, journal_content, journal_length, 0);
-    if (bytes_sent == -1)
-    {
-        DEBUG_LOG("Error: unix socket send");
-        close(client_sockfd);
-        SAFE_FREE(journal_content);
-        return -1;
-    }
-    // TODO: continue sending
-    if ((size_t)bytes_sent != journal_length)
-    {
-        DEBUG_LOG("Sent incomplete journal content: sent %zd, expected %zu\n", bytes_sent, journal_length);
-    }
-    else
-    {
-        DEBUG_LOG("Parent sent journal content: %zd bytes\n", bytes_sent);
-    }
+    int result = journal_transfer_handle_request(client_sockfd, journal, request);
 
     close(client_sockfd);
-    SAFE_FREE(journal_content);
 
-    return 0;
+    return result;
 }
 
-int journal_transfer_rcv_and_write_file(const char* socket_path, const char* file_path)
+// Connect to receiver, send request and receive 64-bit length of answer, return socket to read answer from
+static int journal_transfer_request(const char* socket_path, const char* request, uint64_t* length)
 {
     int sockfd;
     struct sockaddr_un server_addr;
@@ -111,56 +342,559 @@ int journal_transfer_rcv_and_write_file(const char* socket_path, const char* fil
     server_addr.sun_family = AF_UNIX;
     strncpy(server_addr.sun_path, socket_path, sizeof(server_addr.sun_path) - 1);
 
-    if (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1)
+    // Receiver may be not listening yet (server is starting or is serving previous request)
+    int attempt = 0;
+    while (connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1)
     {
-        DEBUG_LOG("Error: unix socket connect");
-        close(sockfd);
-        return -1;
+        if ((errno != ENOENT && errno != ECONNREFUSED) || ++attempt >= JOURNAL_TRANSFER_CONNECT_ATTEMPTS)
+        {
+            DEBUG_LOG("Error: unix socket connect");
+            close(sockfd);
+            return -1;
+        }
+        usleep(JOURNAL_TRANSFER_CONNECT_DELAY_US);
     }
 
-    const char* trigger_message = "GET_JOURNAL";
-    if (send(sockfd, trigger_message, strlen(trigger_message), 0) == -1)
+    if (journal_transfer_send_all(sockfd, request, strlen(request)) != 0)
     {
         DEBUG_LOG("Error: unix socket send trigger");
         close(sockfd);
         return -1;
     }
 
-    FILE* output_file = fopen(file_path, "wb");
-    if (!output_file)
+    if (journal_transfer_recv_all(sockfd, length, sizeof(*length)) != 0)
     {
-        DEBUG_LOG("Error: file open");
+        DEBUG_LOG("Error: receive journal length failed\n");
         close(sockfd);
         return -1;
     }
 
-    char buffer[JOURNAL_MAX_SIZE];
-    ssize_t bytes_received;
-    size_t total_bytes_received = 0;
+    return sockfd;
+}
 
-    while ((bytes_received = recv(sockfd, buffer, sizeof(buffer), 0)) > 0)
+static int journal_transfer_write_all(int fd, const char* data, size_t length)
+{
+    while (length > 0)
     {
-        if (fwrite(buffer, 1, bytes_received, output_file) != (size_t)bytes_received)
+        ssize_t bytes_written = write(fd, data, length);
+        if (bytes_written == -1)
         {
-            DEBUG_LOG("Error: receive journal failed\n");
-            fclose(output_file);
-            close(sockfd);
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            DEBUG_LOG("Error: write: %s\n", strerror(errno));
             return -1;
         }
-        total_bytes_received += bytes_received;
+        data += bytes_written;
+        length -= (size_t)bytes_written;
+    }
+
+    return 0;
+}
+
+// Copy answer through user space buffer, used if splice is not supported
+static int journal_transfer_copy_to_file(int sockfd, int fd, uint64_t* received, uint64_t length)
+{
+    char* buffer = (char*)malloc(JOURNAL_TRANSFER_CHUNK_SIZE);
+    if (!buffer)
+    {
+        DEBUG_LOG("Error: receive buffer malloc\n");
+        return -1;
+    }
+
+    int result = 0;
+    while (*received < length)
+    {
+        size_t chunk = length - *received < JOURNAL_TRANSFER_CHUNK_SIZE ? (size_t)(length - *received) : JOURNAL_TRANSFER_CHUNK_SIZE;
+        ssize_t bytes_received = recv(sockfd, buffer, chunk, 0);
+        if (bytes_received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_received <= 0 || journal_transfer_write_all(fd, buffer, (size_t)bytes_received) != 0)
+        {
+            result = -1;
+            break;
+        }
+        *received += (uint64_t)bytes_received;
+    }
+
+    SAFE_FREE(buffer);
+    return result;
+}
+
+// Move answer from socket to file through a pipe with splice, data is not copied to user space
+// Return 1 if splice is not supported for this socket or file before anything is received
+static int journal_transfer_splice_to_file(int sockfd, int fd, uint64_t* received, uint64_t length)
+{
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+    {
+        return 1;
+    }
+    fcntl(pipefd[1], F_SETPIPE_SZ, JOURNAL_TRANSFER_CHUNK_SIZE);
+
+    int result = 0;
+    while (*received < length)
+    {
+        size_t chunk = length - *received < JOURNAL_TRANSFER_CHUNK_SIZE ? (size_t)(length - *received) : JOURNAL_TRANSFER_CHUNK_SIZE;
+        ssize_t in_pipe = splice(sockfd, NULL, pipefd[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in_pipe == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (in_pipe == -1 && errno == EINVAL && *received == 0)
+        {
+            result = 1;
+            break;
+        }
+        if (in_pipe <= 0)
+        {
+            DEBUG_LOG("Error: splice from socket: %s\n", in_pipe == 0 ? "connection closed" : strerror(errno));
+            result = -1;
+            break;
+        }
+
+        size_t pending = (size_t)in_pipe;
+        while (pending > 0)
+        {
+            ssize_t out_pipe = splice(pipefd[0], NULL, fd, NULL, pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (out_pipe == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (out_pipe <= 0)
+            {
+                DEBUG_LOG("Error: splice to file: %s\n", strerror(errno));
+                result = -1;
+                break;
+            }
+            pending -= (size_t)out_pipe;
+        }
+        if (result != 0)
+        {
+            break;
+        }
+        *received += (uint64_t)in_pipe;
+    }
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return result;
+}
+
+// Send request and write answer (64-bit length and content) to file
+static int journal_transfer_request_to_file(const char* socket_path, const char* request, const char* file_path)
+{
+    uint64_t journal_length = 0;
+    int sockfd = journal_transfer_request(socket_path, request, &journal_length);
+    if (sockfd == -1)
+    {
+        return -1;
     }
 
-    if (total_bytes_received == 0)
+    // O_DIRECT is only for io_uring receive, file systems without it (tmpfs of old kernels) refuse the open
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = open(file_path, flags | (JOURNAL_TRANSFER_URING && JOURNAL_TRANSFER_DIRECT ? O_DIRECT : 0), 0644);
+    if (fd == -1 && errno == EINVAL && JOURNAL_TRANSFER_URING && JOURNAL_TRANSFER_DIRECT)
     {
-        DEBUG_LOG("Error: receive journal failed\n");
-        fclose(output_file);
+        fd = open(file_path, flags, 0644);
+    }
+    if (fd == -1)
+    {
+        DEBUG_LOG("Error: file open");
         close(sockfd);
         return -1;
     }
 
-    printf("Process received journal content: %zu bytes, saved to file: %s\n", total_bytes_received, file_path);
+    // Length is known before the content, so blocks of file are allocated at once (not supported by every file system)
+    if (JOURNAL_TRANSFER_FALLOCATE && journal_length > 0 && fallocate(fd, 0, 0, (off_t)journal_length) == -1)
+    {
+        DEBUG_LOG("journal_transfer_request_to_file: fallocate: %s\n", strerror(errno));
+    }
+
+    uint64_t total_bytes_received = 0;
+    int result = JOURNAL_TRANSFER_URING ? journal_uring_recv_to_file(sockfd, fd, &total_bytes_received, journal_length) : 1;
+    if (result == 1 && JOURNAL_TRANSFER_URING && JOURNAL_TRANSFER_DIRECT)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    }
+    if (result == 1 && JOURNAL_TRANSFER_SPLICE)
+    {
+        result = journal_transfer_splice_to_file(sockfd, fd, &total_bytes_received, journal_length);
+    }
+    if (result == 1)
+    {
+        result = journal_transfer_copy_to_file(sockfd, fd, &total_bytes_received, journal_length);
+    }
+
+    if (result != 0 || total_bytes_received != journal_length)
+    {
+        DEBUG_LOG("Error: receive journal failed, received %llu of %llu bytes\n", (unsigned long long)total_bytes_received, (unsigned long long)journal_length);
+        close(fd);
+        close(sockfd);
+        return -1;
+    }
+
+    printf("Process received journal content: %llu bytes, saved to file: %s\n", (unsigned long long)total_bytes_received, file_path);
 
-    fclose(output_file);
     close(sockfd);
+    if (close(fd) != 0)
+    {
+        DEBUG_LOG("Error: file close\n");
+        return -1;
+    }
     return 0;
 }
+
+int journal_transfer_rcv_and_write_file(const char* socket_path, const char* file_path)
+{
+    return journal_transfer_request_to_file(socket_path, JOURNAL_TRANSFER_GET_JOURNAL, file_path);
+}
+
+int journal_transfer_rcv_range_and_write_file(const char* socket_path, const char* file_path, int64_t t_from, int64_t t_to)
+{
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    snprintf(request, sizeof(request), "%s %lld %lld", JOURNAL_TRANSFER_GET_JOURNAL, (long long)t_from, (long long)t_to);
+
+    return journal_transfer_request_to_file(socket_path, request, file_path);
+}
+
+int journal_transfer_rcv_channels_and_write_file(const char* socket_path, const char* file_path, const char* channels, int64_t t_from, int64_t t_to)
+{
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    if ((size_t)snprintf(request, sizeof(request), "%s %lld %lld %s", JOURNAL_TRANSFER_GET_JOURNAL, (long long)t_from, (long long)t_to, channels) >= sizeof(request))
+    {
+        DEBUG_LOG("Error: journal channels are too long\n");
+        return -1;
+    }
+
+    return journal_transfer_request_to_file(socket_path, request, file_path);
+}
+
+int journal_transfer_rcv_query_and_write_file(const char* socket_path, const char* file_path, const char* query)
+{
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    if ((size_t)snprintf(request, sizeof(request), "%s %s", JOURNAL_TRANSFER_QUERY, query) >= sizeof(request))
+    {
+        DEBUG_LOG("Error: journal query is too long\n");
+        return -1;
+    }
+
+    return journal_transfer_request_to_file(socket_path, request, file_path);
+}
+
+int journal_transfer_rcv_aggregate_and_write_file(const char* socket_path, const char* file_path, int32_t pid)
+{
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    if (pid == JOURNAL_PID_NONE)
+    {
+        snprintf(request, sizeof(request), "%s", JOURNAL_TRANSFER_AGGREGATE);
+    }
+    else
+    {
+        snprintf(request, sizeof(request), "%s %d", JOURNAL_TRANSFER_AGGREGATE, pid);
+    }
+
+    return journal_transfer_request_to_file(socket_path, request, file_path);
+}
+
+int journal_transfer_rcv_stats_and_write_file(const char* socket_path, const char* file_path)
+{
+    return journal_transfer_request_to_file(socket_path, JOURNAL_TRANSFER_STATS, file_path);
+}
+
+int journal_transfer_rcv_columnar_and_write_file(const char* socket_path, const char* file_path, int64_t t_from, int64_t t_to)
+{
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    snprintf(request, sizeof(request), "%s %lld %lld", JOURNAL_TRANSFER_GET_RECORDS, (long long)t_from, (long long)t_to);
+
+    uint64_t length = 0;
+    int sockfd = journal_transfer_request(socket_path, request, &length);
+    if (sockfd == -1)
+    {
+        return -1;
+    }
+
+    int result = -1;
+    uint64_t total_bytes_received = 0;
+    uint64_t records = 0;
+    size_t buffered = 0;
+
+    char* buffer = (char*)malloc(JOURNAL_TRANSFER_CHUNK_SIZE);
+    journal_columnar_writer_t* writer = journal_columnar_writer_open(file_path);
+    if (!buffer || !writer)
+    {
+        DEBUG_LOG("Error: columnar receive init failed\n");
+        goto journal_transfer_rcv_columnar_cleanup;
+    }
+
+    // Records are parsed from the stream as they arrive, tail of a record split between chunks is moved to the beginning
+    while (total_bytes_received < length)
+    {
+        ssize_t bytes_received = recv(sockfd, buffer + buffered, JOURNAL_TRANSFER_CHUNK_SIZE - buffered, 0);
+        if (bytes_received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_received <= 0)
+        {
+            DEBUG_LOG("Error: receive records failed, received %llu of %llu bytes\n", (unsigned long long)total_bytes_received, (unsigned long long)length);
+            goto journal_transfer_rcv_columnar_cleanup;
+        }
+        total_bytes_received += (uint64_t)bytes_received;
+        buffered += (size_t)bytes_received;
+
+        size_t parsed = 0;
+        while (buffered - parsed >= sizeof(journal_record_t))
+        {
+            const journal_record_t* record = (const journal_record_t*)(buffer + parsed);
+            size_t record_size = JOURNAL_RECORD_SIZE(record->size);
+            if (record->magic != JOURNAL_RECORD_MAGIC || record_size > JOURNAL_TRANSFER_CHUNK_SIZE)
+            {
+                DEBUG_LOG("Error: invalid record in stream\n");
+                goto journal_transfer_rcv_columnar_cleanup;
+            }
+            if (record_size > buffered - parsed)
+            {
+                break;
+            }
+            if (journal_columnar_writer_add(writer, record) != JOURNAL_COLUMNAR_STATUS_SUCCESS)
+            {
+                goto journal_transfer_rcv_columnar_cleanup;
+            }
+            parsed += record_size;
+            records++;
+        }
+
+        memmove(buffer, buffer + parsed, buffered - parsed);
+        buffered -= parsed;
+    }
+
+    result = buffered == 0 ? 0 : -1;
+
+journal_transfer_rcv_columnar_cleanup:
+    if (writer && journal_columnar_writer_close(writer) != JOURNAL_COLUMNAR_STATUS_SUCCESS)
+    {
+        result = -1;
+    }
+    SAFE_FREE(buffer);
+    close(sockfd);
+
+    if (result == 0)
+    {
+        printf("Process received %llu records, saved to columnar file: %s\n", (unsigned long long)records, file_path);
+    }
+
+    return result;
+}
+
+// Stream of framed records from one instance, only one chunk of it is buffered
+typedef struct journal_transfer_merge_source
+{
+    int sockfd;
+    uint64_t remaining;    // bytes of answer not received yet
+    char* buffer;
+    size_t begin;          // head record
+    size_t end;
+} journal_transfer_merge_source_t;
+
+// Make head record of source whole in buffer, return 1 if there is one, 0 at the end of stream, -1 on error
+static int journal_transfer_merge_fill(journal_transfer_merge_source_t* source)
+{
+    for (;;)
+    {
+        size_t available = source->end - source->begin;
+        if (available >= sizeof(journal_record_t))
+        {
+            const journal_record_t* record = (const journal_record_t*)(source->buffer + source->begin);
+            if (record->magic != JOURNAL_RECORD_MAGIC || JOURNAL_RECORD_SIZE(record->size) > JOURNAL_TRANSFER_CHUNK_SIZE)
+            {
+                DEBUG_LOG("Error: invalid record in stream\n");
+                return -1;
+            }
+            if (JOURNAL_RECORD_SIZE(record->size) <= available)
+            {
+                return 1;
+            }
+        }
+
+        if (source->remaining == 0)
+        {
+            return available == 0 ? 0 : -1;
+        }
+
+        memmove(source->buffer, source->buffer + source->begin, available);
+        source->begin = 0;
+        source->end = available;
+
+        size_t space = JOURNAL_TRANSFER_CHUNK_SIZE - source->end;
+        ssize_t bytes_received = recv(source->sockfd, source->buffer + source->end, source->remaining < space ? (size_t)source->remaining : space, 0);
+        if (bytes_received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_received <= 0)
+        {
+            DEBUG_LOG("Error: receive records failed, %llu bytes left\n", (unsigned long long)source->remaining);
+            return -1;
+        }
+        source->end += (size_t)bytes_received;
+        source->remaining -= (uint64_t)bytes_received;
+    }
+}
+
+static int64_t journal_transfer_merge_head_time(const journal_transfer_merge_source_t* source)
+{
+    return ((const journal_record_t*)(source->buffer + source->begin))->timestamp;
+}
+
+// Min-heap of source indexes by head record time, equal times keep source order
+static int journal_transfer_merge_less(const journal_transfer_merge_source_t* sources, size_t a, size_t b)
+{
+    int64_t time_a = journal_transfer_merge_head_time(&sources[a]);
+    int64_t time_b = journal_transfer_merge_head_time(&sources[b]);
+    return time_a < time_b || (time_a == time_b && a < b);
+}
+
+static void journal_transfer_merge_sift_down(const journal_transfer_merge_source_t* sources, size_t* heap, size_t heap_size, size_t i)
+{
+    for (;;)
+    {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < heap_size && journal_transfer_merge_less(sources, heap[left], heap[smallest]))
+            smallest = left;
+        if (right < heap_size && journal_transfer_merge_less(sources, heap[right], heap[smallest]))
+            smallest = right;
+        if (smallest == i)
+            return;
+
+        size_t swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+int journal_transfer_rcv_merge_and_write_file(const char* const* socket_paths, size_t count, const char* file_path, int64_t t_from, int64_t t_to)
+{
+    if (!socket_paths || !file_path || count == 0)
+    {
+        DEBUG_LOG("Error: no sources to merge\n");
+        return -1;
+    }
+
+    int result = -1;
+    uint64_t records = 0;
+    size_t heap_size = 0;
+    FILE* output_file = NULL;
+
+    journal_transfer_merge_source_t* sources = (journal_transfer_merge_source_t*)calloc(count, sizeof(journal_transfer_merge_source_t));
+    size_t* heap = (size_t*)malloc(count * sizeof(size_t));
+    if (!sources || !heap)
+    {
+        goto journal_transfer_rcv_merge_cleanup;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        sources[i].sockfd = -1;
+    }
+
+    // All instances are asked before merging, so they stream their journals concurrently
+    char request[JOURNAL_TRANSFER_REQUEST_SIZE];
+    snprintf(request, sizeof(request), "%s %lld %lld", JOURNAL_TRANSFER_GET_RECORDS, (long long)t_from, (long long)t_to);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sources[i].buffer = (char*)malloc(JOURNAL_TRANSFER_CHUNK_SIZE);
+        if (!sources[i].buffer || (sources[i].sockfd = journal_transfer_request(socket_paths[i], request, &sources[i].remaining)) == -1)
+        {
+            DEBUG_LOG("Error: request to %s failed\n", socket_paths[i]);
+            goto journal_transfer_rcv_merge_cleanup;
+        }
+    }
+
+    output_file = fopen(file_path, "wb");
+    if (!output_file)
+    {
+        DEBUG_LOG("Error: open output file failed\n");
+        goto journal_transfer_rcv_merge_cleanup;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int filled = journal_transfer_merge_fill(&sources[i]);
+        if (filled < 0)
+        {
+            goto journal_transfer_rcv_merge_cleanup;
+        }
+        if (filled)
+        {
+            heap[heap_size++] = i;
+        }
+    }
+    for (size_t i = heap_size / 2; i-- > 0;)
+    {
+        journal_transfer_merge_sift_down(sources, heap, heap_size, i);
+    }
+
+    // Payload of earliest head record is written with tag of its source, then the source is refilled
+    while (heap_size > 0)
+    {
+        size_t index = heap[0];
+        journal_transfer_merge_source_t* source = &sources[index];
+        const journal_record_t* record = (const journal_record_t*)(source->buffer + source->begin);
+
+        // Summary record of sampled journal has no text, a bare tag would be glued to the next line
+        size_t text_offset = record->size >= JOURNAL_RECORD_TEXT_OFFSET(record) ? JOURNAL_RECORD_TEXT_OFFSET(record) : record->size;
+        size_t text_size = record->size - text_offset;
+        if (text_size > 0
+            && (fprintf(output_file, "[%zu] ", index) < 0 || fwrite((const char*)(record + 1) + text_offset, 1, text_size, output_file) != text_size))
+        {
+            DEBUG_LOG("Error: write merged journal failed\n");
+            goto journal_transfer_rcv_merge_cleanup;
+        }
+        source->begin += JOURNAL_RECORD_SIZE(record->size);
+        records++;
+
+        int filled = journal_transfer_merge_fill(source);
+        if (filled < 0)
+        {
+            goto journal_transfer_rcv_merge_cleanup;
+        }
+        if (!filled)
+        {
+            heap[0] = heap[--heap_size];
+        }
+        journal_transfer_merge_sift_down(sources, heap, heap_size, 0);
+    }
+
+    result = 0;
+
+journal_transfer_rcv_merge_cleanup:
+    if (output_file && fclose(output_file) != 0)
+    {
+        result = -1;
+    }
+    for (size_t i = 0; sources && i < count; i++)
+    {
+        if (sources[i].sockfd != -1)
+        {
+            close(sources[i].sockfd);
+        }
+        SAFE_FREE(sources[i].buffer);
+    }
+    SAFE_FREE(sources);
+    SAFE_FREE(heap);
+
+    if (result == 0)
+    {
+        printf("Process merged %llu records of %zu journals, saved to file: %s\n", (unsigned long long)records, count, file_path);
+    }
+
+    return result;
+}
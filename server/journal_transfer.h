@@ -1,12 +1,49 @@
 #ifndef JOURNAL_TRANSFER_H
 #define JOURNAL_TRANSFER_H
 
+#include <stdint.h>
+
 #include "journal.h"
 
+#define JOURNAL_TRANSFER_REQUEST_SIZE 256
+#define JOURNAL_TRANSFER_GET_JOURNAL "GET_JOURNAL"
+#define JOURNAL_TRANSFER_GET_RECORDS "GET_RECORDS"
+#define JOURNAL_TRANSFER_QUERY "QUERY"
+#define JOURNAL_TRANSFER_AGGREGATE "AGGREGATE"
+#define JOURNAL_TRANSFER_STATS "STATS"
+
+// Source of text answer to "STATS" request, returns malloc'ed text or NULL
+typedef char* (*journal_transfer_stats_t)(size_t* length);
+
+// Set source of "STATS" answer (server counters which are not in journal), request fails if it is not set
+void journal_transfer_set_stats(journal_transfer_stats_t stats);
+
 // Running receiver for journal transfer (blocking operation)
 int journal_transfer_run_receiver(const char* socket_path, journal_t* journal);
 
 // Send message to receiver to get journal and then write it to file
 int journal_transfer_rcv_and_write_file(const char* socket_path, const char* file_path);
 
+// Send message to receiver to get records with timestamp in [t_from, t_to] (ms since epoch) and then write them to file
+int journal_transfer_rcv_range_and_write_file(const char* socket_path, const char* file_path, int64_t t_from, int64_t t_to);
+
+// Same as journal_transfer_rcv_range_and_write_file for records of comma separated channels ("results,errors")
+int journal_transfer_rcv_channels_and_write_file(const char* socket_path, const char* file_path, const char* channels, int64_t t_from, int64_t t_to);
+
+// Get records with timestamp in [t_from, t_to] and write them to file in columnar format (see journal_columnar.h)
+int journal_transfer_rcv_columnar_and_write_file(const char* socket_path, const char* file_path, int64_t t_from, int64_t t_to);
+
+// Get records with timestamp in [t_from, t_to] from several receivers and write their payloads merged by time to file
+// Every line is tagged with index of its source in socket_paths as "[<index>] ", memory use is one chunk per source
+int journal_transfer_rcv_merge_and_write_file(const char* const* socket_paths, size_t count, const char* file_path, int64_t t_from, int64_t t_to);
+
+// Send query (see journal_query.h) to receiver and write result table to file
+int journal_transfer_rcv_query_and_write_file(const char* socket_path, const char* file_path, const char* query);
+
+// Get aggregates of pid with time buckets (or of all pids if pid is JOURNAL_PID_NONE) and write them to file
+int journal_transfer_rcv_aggregate_and_write_file(const char* socket_path, const char* file_path, int32_t pid);
+
+// Get server counters (see journal_transfer_set_stats) and write them to file
+int journal_transfer_rcv_stats_and_write_file(const char* socket_path, const char* file_path);
+
 #endif    // JOURNAL_TRANSFER_H
\ No newline at end of file
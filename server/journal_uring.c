@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+
+#include "journal_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "utility.h"
+
+// Operation in low bit of user_data, chunk in the rest
+#define JOURNAL_URING_OP_RECV 0
+#define JOURNAL_URING_OP_WRITE 1
+
+// Fixed file slots
+#define JOURNAL_URING_SOCKET 0
+#define JOURNAL_URING_FILE 1
+
+#define JOURNAL_URING_ALIGN_UP(size) (((size) + JOURNAL_URING_DIRECT_ALIGN - 1) & ~(size_t)(JOURNAL_URING_DIRECT_ALIGN - 1))
+
+typedef struct journal_uring_chunk
+{
+    uint64_t offset;    // file offset of chunk
+    size_t size;        // bytes of stream in chunk
+    size_t done;        // bytes received while chunk is received, then bytes written
+    int busy;
+} journal_uring_chunk_t;
+
+typedef struct journal_uring
+{
+    int fd;
+    unsigned sq_mask;
+    unsigned cq_mask;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;    // NULL if it is in sq_ring mapping (IORING_FEAT_SINGLE_MMAP)
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned tail;         // tail of queued entries, published by journal_uring_enter
+    unsigned to_submit;    // queued entries which are not submitted yet
+    char* buffers;         // registered buffer, JOURNAL_URING_CHUNK_SIZE per chunk
+    int direct;            // file is opened with O_DIRECT
+    journal_uring_chunk_t chunks[JOURNAL_URING_BUFFERS];
+} journal_uring_t;
+
+static void journal_uring_teardown(journal_uring_t* uring)
+{
+    if (uring->sqes != MAP_FAILED)
+    {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+    if (uring->cq_ring)
+    {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+    if (uring->sq_ring != MAP_FAILED)
+    {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+    if (uring->fd != -1)
+    {
+        close(uring->fd);
+    }
+
+    SAFE_FREE(uring->buffers);
+}
+
+// Set up ring with registered buffer and socket and file in fixed slots, -1 if kernel has no io_uring or it is disabled
+static int journal_uring_setup(journal_uring_t* uring, int sockfd, int fd)
+{
+    memset(uring, 0, sizeof(*uring));
+    uring->fd = -1;
+    uring->sq_ring = MAP_FAILED;
+    uring->sqes = MAP_FAILED;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    uring->fd = (int)syscall(__NR_io_uring_setup, JOURNAL_URING_BUFFERS * 2, &params);
+    if (uring->fd == -1)
+    {
+        DEBUG_LOG("journal_uring_setup: io_uring_setup error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) && uring->cq_ring_size > uring->sq_ring_size)
+    {
+        uring->sq_ring_size = uring->cq_ring_size;
+    }
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED)
+    {
+        DEBUG_LOG("journal_uring_setup: mmap of sq ring error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    uint8_t* cq_ring = (uint8_t*)uring->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED)
+        {
+            DEBUG_LOG("journal_uring_setup: mmap of cq ring error: %s\n", strerror(errno));
+            uring->cq_ring = NULL;
+            return -1;
+        }
+        cq_ring = (uint8_t*)uring->cq_ring;
+    }
+
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe*)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED)
+    {
+        DEBUG_LOG("journal_uring_setup: mmap of sqes error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    uint8_t* sq_ring = (uint8_t*)uring->sq_ring;
+    uring->sq_tail = (unsigned*)(sq_ring + params.sq_off.tail);
+    uring->sq_mask = *(unsigned*)(sq_ring + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned*)(sq_ring + params.sq_off.array);
+    uring->cq_head = (unsigned*)(cq_ring + params.cq_off.head);
+    uring->cq_tail = (unsigned*)(cq_ring + params.cq_off.tail);
+    uring->cq_mask = *(unsigned*)(cq_ring + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+    uring->tail = *uring->sq_tail;
+
+    // Aligned for O_DIRECT, chunks are multiples of the alignment
+    if (posix_memalign((void**)&uring->buffers, JOURNAL_URING_DIRECT_ALIGN, (size_t)JOURNAL_URING_BUFFERS * JOURNAL_URING_CHUNK_SIZE) != 0)
+    {
+        DEBUG_LOG("journal_uring_setup: posix_memalign of buffers failed\n");
+        uring->buffers = NULL;
+        return -1;
+    }
+
+    struct iovec buffer = {.iov_base = uring->buffers, .iov_len = (size_t)JOURNAL_URING_BUFFERS * JOURNAL_URING_CHUNK_SIZE};
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_BUFFERS, &buffer, 1) != 0)
+    {
+        DEBUG_LOG("journal_uring_setup: register of buffers error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int files[2] = {[JOURNAL_URING_SOCKET] = sockfd, [JOURNAL_URING_FILE] = fd};
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_FILES, files, 2) != 0)
+    {
+        DEBUG_LOG("journal_uring_setup: register of files error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    uring->direct = flags != -1 && (flags & O_DIRECT);
+
+    return 0;
+}
+
+static struct io_uring_sqe* journal_uring_sqe(journal_uring_t* uring, uint8_t opcode, size_t chunk, unsigned op)
+{
+    unsigned index = uring->tail & uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->user_data = ((uint64_t)chunk << 1) | op;
+    uring->sq_array[index] = index;
+    uring->tail++;
+    uring->to_submit++;
+
+    return sqe;
+}
+
+// Receive rest of chunk, MSG_WAITALL completes it at once unless the stream is slower than the chunk
+static void journal_uring_queue_recv(journal_uring_t* uring, size_t index)
+{
+    journal_uring_chunk_t* chunk = &uring->chunks[index];
+    struct io_uring_sqe* sqe = journal_uring_sqe(uring, IORING_OP_RECV, index, JOURNAL_URING_OP_RECV);
+    sqe->fd = JOURNAL_URING_SOCKET;
+    sqe->addr = (uint64_t)(uintptr_t)(uring->buffers + index * JOURNAL_URING_CHUNK_SIZE + chunk->done);
+    sqe->len = (uint32_t)(chunk->size - chunk->done);
+    sqe->msg_flags = MSG_WAITALL;
+}
+
+// Write rest of chunk, O_DIRECT chunk is written up to the aligned end (buffer tail is zeroed)
+static void journal_uring_queue_write(journal_uring_t* uring, size_t index)
+{
+    journal_uring_chunk_t* chunk = &uring->chunks[index];
+    size_t size = uring->direct ? JOURNAL_URING_ALIGN_UP(chunk->size) : chunk->size;
+    struct io_uring_sqe* sqe = journal_uring_sqe(uring, IORING_OP_WRITE_FIXED, index, JOURNAL_URING_OP_WRITE);
+    sqe->fd = JOURNAL_URING_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)(uring->buffers + index * JOURNAL_URING_CHUNK_SIZE + chunk->done);
+    sqe->len = (uint32_t)(size - chunk->done);
+    sqe->off = chunk->offset + chunk->done;
+    sqe->buf_index = 0;
+}
+
+static int journal_uring_enter(journal_uring_t* uring)
+{
+    __atomic_store_n(uring->sq_tail, uring->tail, __ATOMIC_RELEASE);
+
+    for (;;)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, uring->fd, uring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0)
+        {
+            uring->to_submit -= (unsigned)ret < uring->to_submit ? (unsigned)ret : uring->to_submit;
+            return 0;
+        }
+        if (errno != EINTR)
+        {
+            DEBUG_LOG("journal_uring_enter: io_uring_enter error: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+}
+
+int journal_uring_recv_to_file(int sockfd, int fd, uint64_t* received, uint64_t length)
+{
+    if (!received)
+    {
+        DEBUG_LOG("journal_uring_recv_to_file: received is NULL\n");
+        return -1;
+    }
+
+    journal_uring_t uring;
+    if (journal_uring_setup(&uring, sockfd, fd) != 0)
+    {
+        journal_uring_teardown(&uring);
+        return 1;
+    }
+
+    int result = 0;
+    uint64_t offset = 0;    // stream offset of next chunk
+    int receiving = -1;     // chunk with recv in flight
+    unsigned in_flight = 0;
+
+    for (;;)
+    {
+        // Next chunk is received after the previous one, chunks which are written meanwhile hold their buffers
+        for (size_t i = 0; result == 0 && receiving == -1 && offset < length && i < JOURNAL_URING_BUFFERS; i++)
+        {
+            journal_uring_chunk_t* chunk = &uring.chunks[i];
+            if (chunk->busy)
+            {
+                continue;
+            }
+
+            chunk->offset = offset;
+            chunk->size = length - offset < JOURNAL_URING_CHUNK_SIZE ? (size_t)(length - offset) : JOURNAL_URING_CHUNK_SIZE;
+            chunk->done = 0;
+            chunk->busy = 1;
+            if (uring.direct && chunk->size % JOURNAL_URING_DIRECT_ALIGN != 0)
+            {
+                memset(uring.buffers + i * JOURNAL_URING_CHUNK_SIZE + chunk->size, 0, JOURNAL_URING_ALIGN_UP(chunk->size) - chunk->size);
+            }
+            journal_uring_queue_recv(&uring, i);
+            offset += chunk->size;
+            receiving = (int)i;
+            in_flight++;
+        }
+
+        if (in_flight == 0)
+        {
+            break;
+        }
+
+        // Ring is not usable after failed enter, pending operations may still complete into the buffer, so it is left allocated
+        if (journal_uring_enter(&uring) != 0)
+        {
+            uring.buffers = NULL;
+            result = -1;
+            break;
+        }
+
+        unsigned head = *uring.cq_head;
+        unsigned cq_tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++)
+        {
+            const struct io_uring_cqe* cqe = &uring.cqes[head & uring.cq_mask];
+            size_t index = (size_t)(cqe->user_data >> 1);
+            journal_uring_chunk_t* chunk = &uring.chunks[index];
+            in_flight--;
+
+            if ((cqe->user_data & 1) == JOURNAL_URING_OP_RECV)
+            {
+                if (cqe->res > 0 && result == 0)
+                {
+                    chunk->done += (size_t)cqe->res;
+                    if (chunk->done == chunk->size)
+                    {
+                        chunk->done = 0;
+                        journal_uring_queue_write(&uring, index);
+                        receiving = -1;
+                    }
+                    else
+                    {
+                        journal_uring_queue_recv(&uring, index);
+                    }
+                    in_flight++;
+                }
+                else if ((cqe->res == -EINTR || cqe->res == -EAGAIN) && result == 0)
+                {
+                    journal_uring_queue_recv(&uring, index);
+                    in_flight++;
+                }
+                else
+                {
+                    // Kernel without IORING_OP_RECV refuses the first recv, stream is left for the fallback
+                    if (cqe->res == -EINVAL && chunk->offset == 0 && chunk->done == 0)
+                    {
+                        result = 1;
+                    }
+                    else if (result == 0)
+                    {
+                        DEBUG_LOG("journal_uring_recv_to_file: recv error: %s\n", cqe->res == 0 ? "connection closed" : strerror(-cqe->res));
+                        result = -1;
+                    }
+                    chunk->busy = 0;
+                    receiving = -1;
+                }
+            }
+            else
+            {
+                size_t size = uring.direct ? JOURNAL_URING_ALIGN_UP(chunk->size) : chunk->size;
+                if (cqe->res > 0 && result == 0 && chunk->done + (size_t)cqe->res < size)
+                {
+                    chunk->done += (size_t)cqe->res;
+                    journal_uring_queue_write(&uring, index);
+                    in_flight++;
+                    continue;
+                }
+
+                if (cqe->res > 0 && chunk->done + (size_t)cqe->res == size)
+                {
+                    *received += chunk->size;
+                }
+                else if (result == 0)
+                {
+                    DEBUG_LOG("journal_uring_recv_to_file: write error: %s\n", cqe->res < 0 ? strerror(-cqe->res) : "nothing written");
+                    result = -1;
+                }
+                chunk->busy = 0;
+            }
+        }
+        __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Padding of the last O_DIRECT block is cut off
+    if (result == 0 && uring.direct && ftruncate(fd, (off_t)length) != 0)
+    {
+        DEBUG_LOG("journal_uring_recv_to_file: ftruncate error: %s\n", strerror(errno));
+        result = -1;
+    }
+
+    journal_uring_teardown(&uring);
+    return result;
+}
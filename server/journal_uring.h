@@ -0,0 +1,18 @@
+#ifndef JOURNAL_URING_H
+#define JOURNAL_URING_H
+
+#include <stdint.h>
+
+// Receive of a stream of known length from socket to file with io_uring: chunks are received into a registered buffer
+// and written from it at their file offset (WRITE_FIXED), socket and file are in fixed file slots of the ring
+// One recv is in flight so the stream stays in order, writes of earlier chunks go on while the next chunk is received
+// File opened with O_DIRECT is written in whole blocks from aligned buffers, last block is padded and file is truncated to length
+#define JOURNAL_URING_BUFFERS 4                  // chunks in flight
+#define JOURNAL_URING_CHUNK_SIZE (256 * 1024)    // multiple of JOURNAL_URING_DIRECT_ALIGN
+#define JOURNAL_URING_DIRECT_ALIGN 4096          // O_DIRECT alignment of buffers, offsets and lengths
+
+// Receive length bytes from sockfd and write them to fd from offset 0, received counts bytes written to file
+// Returns 0 on success, -1 on error, 1 if io_uring is not available and nothing is received (use splice or recv then)
+int journal_uring_recv_to_file(int sockfd, int fd, uint64_t* received, uint64_t length);
+
+#endif    // JOURNAL_URING_H
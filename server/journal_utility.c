@@ -1,20 +1,215 @@
+#define _XOPEN_SOURCE 700
+
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <time.h>
 
 #include "config.h"
+#include "journal_analyze.h"
 #include "journal_transfer.h"
 
-// "Usage: %s <socket_path> <file_path>\n"
+// Parse local time "YYYY-MM-DD HH:MM:SS" (as in journal) or seconds since epoch to ms since epoch
+static int parse_time_ms(const char* str, int64_t* time_ms)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+
+    const char* end = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+    if (end && *end == '\0')
+    {
+        tm.tm_isdst = -1;
+        *time_ms = (int64_t)mktime(&tm) * 1000;
+        return 0;
+    }
+
+    char* number_end = NULL;
+    long long seconds = strtoll(str, &number_end, 10);
+    if (number_end == str || *number_end != '\0')
+    {
+        return -1;
+    }
+
+    *time_ms = (int64_t)seconds * 1000;
+    return 0;
+}
+
+// Analyze exported journal (text or columnar) on all cores, write report to report_path or stdout
+static int analyze_and_write_report(const char* journal_path, const char* report_path)
+{
+    journal_analyze_result_t result;
+    if (journal_analyze_file(journal_path, NULL, &result) != JOURNAL_ANALYZE_STATUS_SUCCESS)
+    {
+        fprintf(stderr, "Failed to analyze %s\n", journal_path);
+        return -1;
+    }
+
+    size_t length = 0;
+    char* report = journal_analyze_result_to_string(&result, JOURNAL_ANALYZE_TOP_K, &length);
+    journal_analyze_result_free(&result);
+    if (!report)
+    {
+        return -1;
+    }
+
+    FILE* file = report_path ? fopen(report_path, "w") : stdout;
+    int error = !file || fwrite(report, 1, length, file) != length;
+    if (file && file != stdout)
+        error |= fclose(file) != 0;
+
+    free(report);
+    return error ? -1 : 0;
+}
+
+// "Usage: %s <socket_path> <file_path> [<from> <to> | --query <query> | --aggregate [<pid>] | --stats | --columnar [<from> <to>]]\n"
+// "       %s --analyze <journal_file> [<report_file>]\n"
+// "       %s --merge <file_path> <socket_path>...\n"
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--merge") == 0)
+    {
+        if (argc < 4)
+        {
+            fprintf(stderr, "Usage: %s --merge <file_path> <socket_path>...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 3; i < argc; i++)
+            printf("Source [%d]: %s\n", i - 3, argv[i]);
+
+        if (journal_transfer_rcv_merge_and_write_file((const char* const*)(argv + 3), (size_t)(argc - 3), argv[2], JOURNAL_TIME_MIN, JOURNAL_TIME_MAX) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--analyze") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            fprintf(stderr, "Usage: %s --analyze <journal_file> [<report_file>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (analyze_and_write_report(argv[2], argc == 4 ? argv[3] : NULL) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
     const char* socket_path = SERVER_UNIX_SOCKET_PATH;
     const char* file_path = JOURNAL_FILE_PATH;
 
+    if (argc > 1)
+        socket_path = argv[1];
+    if (argc > 2)
+        file_path = argv[2];
+
+    if (argc > 3 && strcmp(argv[3], "--query") == 0)
+    {
+        if (argc != 5)
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> --query \"pid=<pid> from=<ms> to=<ms> status=ok,not_found,invalid channel=results,errors group=pid|none p=50,90,99\"\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (journal_transfer_rcv_query_and_write_file(socket_path, file_path, argv[4]) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 3 && strcmp(argv[3], "--aggregate") == 0)
+    {
+        char* end = NULL;
+        long pid = argc == 5 ? strtol(argv[4], &end, 10) : JOURNAL_PID_NONE;
+        if (argc > 5 || (end && (end == argv[4] || *end != '\0' || pid < 0 || pid > INT32_MAX)))
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> --aggregate [<pid>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (journal_transfer_rcv_aggregate_and_write_file(socket_path, file_path, (int32_t)pid) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 3 && strcmp(argv[3], "--stats") == 0)
+    {
+        if (argc > 4)
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> --stats\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (journal_transfer_rcv_stats_and_write_file(socket_path, file_path) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 3 && strcmp(argv[3], "--channels") == 0)
+    {
+        int64_t t_from = JOURNAL_TIME_MIN, t_to = JOURNAL_TIME_MAX;
+        uint32_t channel_mask = 0;
+        if ((argc != 5 && argc != 7) || journal_channel_parse(argv[4], &channel_mask) != 0
+            || (argc == 7 && (parse_time_ms(argv[5], &t_from) != 0 || parse_time_ms(argv[6], &t_to) != 0)))
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> --channels results,errors,system [<from> <to>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (argc == 7)
+            t_to += 999;
+
+        if (journal_transfer_rcv_channels_and_write_file(socket_path, file_path, argv[4], t_from, t_to) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 3 && strcmp(argv[3], "--columnar") == 0)
+    {
+        int64_t t_from = JOURNAL_TIME_MIN, t_to = JOURNAL_TIME_MAX;
+        if ((argc != 4 && argc != 6) || (argc == 6 && (parse_time_ms(argv[4], &t_from) != 0 || parse_time_ms(argv[5], &t_to) != 0)))
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> --columnar [<from> <to>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (argc == 6)
+            t_to += 999;
+
+        if (journal_transfer_rcv_columnar_and_write_file(socket_path, file_path, t_from, t_to) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 3)
+    {
+        int64_t t_from = 0, t_to = 0;
+        if (argc != 5 || parse_time_ms(argv[3], &t_from) != 0 || parse_time_ms(argv[4], &t_to) != 0)
+        {
+            fprintf(stderr, "Usage: %s <socket_path> <file_path> [<from> <to> | --query <query> | --aggregate [<pid>] | --stats | --channels <channels> [<from> <to>] | --columnar [<from> <to>]]\n", argv[0]);
+            fprintf(stderr, "Time is \"YYYY-MM-DD HH:MM:SS\" or seconds since epoch\n");
+            return EXIT_FAILURE;
+        }
+
+        // Inclusive range by seconds as printed in journal
+        if (journal_transfer_rcv_range_and_write_file(socket_path, file_path, t_from, t_to + 999) != 0)
+            return EXIT_FAILURE;
+
+        return EXIT_SUCCESS;
+    }
+
     if (journal_transfer_rcv_and_write_file(socket_path, file_path) != 0)
         return EXIT_FAILURE;
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,269 @@
+#include "process_cpu_cache.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "utility.h"
+
+#define PROCESS_CPU_CACHE_BYTES_01 0x0101010101010101ULL
+#define PROCESS_CPU_CACHE_BYTES_80 0x8080808080808080ULL
+
+static uint64_t process_cpu_cache_hash(pid_t pid)
+{
+    return (uint64_t)(uint32_t)pid * 0x9E3779B97F4A7C15ULL;
+}
+
+// Tag of hash is never 0, 0 marks empty slot
+static uint8_t process_cpu_cache_tag(uint64_t hash)
+{
+    return (uint8_t)(hash >> 56) | 0x80;
+}
+
+// Bit 7 of every byte of word which is equal to tag
+static uint64_t process_cpu_cache_match(uint64_t word, uint8_t tag)
+{
+    uint64_t x = word ^ (PROCESS_CPU_CACHE_BYTES_01 * tag);
+    return (x - PROCESS_CPU_CACHE_BYTES_01) & ~x & PROCESS_CPU_CACHE_BYTES_80;
+}
+
+static int64_t process_cpu_cache_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+process_cpu_cache_t* process_cpu_cache_create(size_t capacity)
+{
+    size_t groups = 1;
+    while (groups * PROCESS_CPU_CACHE_GROUP < capacity)
+    {
+        groups <<= 1;
+    }
+
+    process_cpu_cache_t* cache = (process_cpu_cache_t*)calloc(1, sizeof(process_cpu_cache_t));
+    if (!cache)
+    {
+        DEBUG_LOG("process_cpu_cache_create: calloc failed\n");
+        return NULL;
+    }
+
+    cache->map_size = groups * (sizeof(uint64_t) + PROCESS_CPU_CACHE_GROUP * sizeof(process_cpu_cache_slot_t));
+    void* map = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        DEBUG_LOG("process_cpu_cache_create: mmap of %zu bytes failed\n", cache->map_size);
+        SAFE_FREE(cache);
+        return NULL;
+    }
+
+    // Anonymous mapping is zeroed: all tags and slots are empty
+    cache->group_mask = groups - 1;
+    cache->tags = (uint64_t*)map;
+    cache->slots = (process_cpu_cache_slot_t*)(cache->tags + groups);
+
+    return cache;
+}
+
+void process_cpu_cache_delete(process_cpu_cache_t* cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    munmap(cache->tags, cache->map_size);
+    SAFE_FREE(cache);
+}
+
+// Consistent copy of slot, 0 if it is being written for all attempts
+static int process_cpu_cache_read(const process_cpu_cache_slot_t* slot, process_cpu_cache_slot_t* copy)
+{
+    for (int attempt = 0; attempt < PROCESS_CPU_CACHE_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        copy->pid = __atomic_load_n(&slot->pid, __ATOMIC_RELAXED);
+        __atomic_load(&slot->cpu_usage, &copy->cpu_usage, __ATOMIC_RELAXED);
+        copy->time_ms = __atomic_load_n(&slot->time_ms, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Consistent copy of result of pid, 0 if there is none
+static int process_cpu_cache_find(const process_cpu_cache_t* cache, pid_t pid, process_cpu_cache_slot_t* copy)
+{
+    uint64_t hash = process_cpu_cache_hash(pid);
+    size_t group = (size_t)hash & cache->group_mask;
+    uint64_t match = process_cpu_cache_match(__atomic_load_n(&cache->tags[group], __ATOMIC_ACQUIRE), process_cpu_cache_tag(hash));
+
+    while (match)
+    {
+        size_t index = (size_t)__builtin_ctzll(match) / 8;
+        match &= match - 1;
+
+        if (process_cpu_cache_read(&cache->slots[group * PROCESS_CPU_CACHE_GROUP + index], copy) && copy->pid == pid)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int process_cpu_cache_get(process_cpu_cache_t* cache, pid_t pid, int64_t max_staleness_ms, double* cpu_usage)
+{
+    if (!cache || !cpu_usage || pid == 0)
+    {
+        return 0;
+    }
+
+    process_cpu_cache_slot_t copy;
+    if (process_cpu_cache_find(cache, pid, &copy) && copy.cpu_usage >= 0 && process_cpu_cache_now_ms() - copy.time_ms <= max_staleness_ms)
+    {
+        *cpu_usage = copy.cpu_usage;
+        cache->hits++;
+        return 1;
+    }
+
+    cache->misses++;
+    return 0;
+}
+
+// Set tag byte of slot in group word, other processes may change other bytes at the same time
+static void process_cpu_cache_set_tag(uint64_t* word, size_t index, uint8_t tag)
+{
+    uint64_t expected = __atomic_load_n(word, __ATOMIC_RELAXED);
+    uint64_t desired;
+    do
+    {
+        desired = (expected & ~(0xFFULL << (index * 8))) | ((uint64_t)tag << (index * 8));
+    } while (!__atomic_compare_exchange_n(word, &expected, desired, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Empty slot of pid, it is left as is if another process is writing it
+static void process_cpu_cache_drop(process_cpu_cache_t* cache, pid_t pid)
+{
+    uint64_t hash = process_cpu_cache_hash(pid);
+    size_t group = (size_t)hash & cache->group_mask;
+    process_cpu_cache_slot_t* slots = &cache->slots[group * PROCESS_CPU_CACHE_GROUP];
+
+    for (uint64_t match = process_cpu_cache_match(__atomic_load_n(&cache->tags[group], __ATOMIC_ACQUIRE), process_cpu_cache_tag(hash)); match; match &= match - 1)
+    {
+        size_t index = (size_t)__builtin_ctzll(match) / 8;
+        process_cpu_cache_slot_t* slot = &slots[index];
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&slot->pid, __ATOMIC_RELAXED) != pid || (sequence & 1)
+            || !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            continue;
+        }
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        // Slot could be taken by another pid between the checks
+        if (__atomic_load_n(&slot->pid, __ATOMIC_RELAXED) == pid)
+        {
+            __atomic_store_n(&slot->pid, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot->time_ms, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+            process_cpu_cache_set_tag(&cache->tags[group], index, 0);
+            return;
+        }
+        __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    }
+}
+
+int process_cpu_cache_missing(process_cpu_cache_t* cache, pid_t pid, int64_t ttl_ms)
+{
+    if (!cache || pid == 0)
+    {
+        return 0;
+    }
+
+    process_cpu_cache_slot_t copy;
+    if (!process_cpu_cache_find(cache, pid, &copy) || copy.cpu_usage >= 0 || process_cpu_cache_now_ms() - copy.time_ms > ttl_ms)
+    {
+        return 0;
+    }
+
+    // Pid may have been created after it was not found, kill with signal 0 only checks it and is cheaper than reading /proc
+    if (kill(pid, 0) == 0 || errno == EPERM)
+    {
+        process_cpu_cache_drop(cache, pid);
+        return 0;
+    }
+
+    return 1;
+}
+
+void process_cpu_cache_put(process_cpu_cache_t* cache, pid_t pid, double cpu_usage)
+{
+    if (!cache || pid == 0)
+    {
+        return;
+    }
+
+    uint64_t hash = process_cpu_cache_hash(pid);
+    uint8_t tag = process_cpu_cache_tag(hash);
+    size_t group = (size_t)hash & cache->group_mask;
+    uint64_t tags = __atomic_load_n(&cache->tags[group], __ATOMIC_ACQUIRE);
+    process_cpu_cache_slot_t* slots = &cache->slots[group * PROCESS_CPU_CACHE_GROUP];
+
+    // Slot of pid, else first empty slot, else the oldest slot of group
+    size_t target = PROCESS_CPU_CACHE_GROUP;
+    for (uint64_t match = process_cpu_cache_match(tags, tag); match && target == PROCESS_CPU_CACHE_GROUP; match &= match - 1)
+    {
+        size_t index = (size_t)__builtin_ctzll(match) / 8;
+        if (__atomic_load_n(&slots[index].pid, __ATOMIC_RELAXED) == pid)
+        {
+            target = index;
+        }
+    }
+    uint64_t empty = process_cpu_cache_match(tags, 0);
+    if (target == PROCESS_CPU_CACHE_GROUP && empty)
+    {
+        target = (size_t)__builtin_ctzll(empty) / 8;
+    }
+    if (target == PROCESS_CPU_CACHE_GROUP)
+    {
+        target = 0;
+        for (size_t index = 1; index < PROCESS_CPU_CACHE_GROUP; index++)
+        {
+            if (__atomic_load_n(&slots[index].time_ms, __ATOMIC_RELAXED) < __atomic_load_n(&slots[target].time_ms, __ATOMIC_RELAXED))
+            {
+                target = index;
+            }
+        }
+    }
+
+    // Writers exclude each other by making sequence odd, result is dropped if slot is taken
+    process_cpu_cache_slot_t* slot = &slots[target];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    if ((sequence & 1) || !__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    int64_t time_ms = process_cpu_cache_now_ms();
+    __atomic_store_n(&slot->pid, pid, __ATOMIC_RELAXED);
+    __atomic_store(&slot->cpu_usage, &cpu_usage, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->time_ms, time_ms, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    process_cpu_cache_set_tag(&cache->tags[group], target, tag);
+}
@@ -0,0 +1,53 @@
+#ifndef PROCESS_CPU_CACHE_H
+#define PROCESS_CPU_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Recent measurement results by pid, request with staleness bound is answered from it without measurement
+// Pid which was not found is kept as missing (negative result), requests for it are answered without reading /proc,
+// only with a kill(pid, 0) check that the pid was not created since
+// Table is in a MAP_SHARED mapping, created before workers are forked it is shared by all of them:
+//   slots are grouped by PROCESS_CPU_CACHE_GROUP, pid is looked up only in group of its hash (the oldest result of a full group is replaced)
+//   every group has a word of one byte tags (high bits of hash, 0 for empty slot) compared at once, so only slots with matching tag are read
+//   slot is a seqlock: writer makes sequence odd while it writes, reader retries if sequence is odd or has changed, readers never block
+#define PROCESS_CPU_CACHE_GROUP 8
+#define PROCESS_CPU_CACHE_READ_ATTEMPTS 4
+
+typedef struct process_cpu_cache_slot
+{
+    uint32_t sequence;    // odd while slot is written
+    pid_t pid;            // 0 for empty slot
+    double cpu_usage;     // negative if pid was not found
+    int64_t time_ms;      // CLOCK_MONOTONIC time when measurement finished
+} process_cpu_cache_slot_t;
+
+// Handle is private to process (counters are of this process), tags and slots are shared
+typedef struct process_cpu_cache
+{
+    size_t group_mask;    // groups - 1, groups is power of two
+    uint64_t hits;
+    uint64_t misses;
+    size_t map_size;
+    uint64_t* tags;                     // tag word of every group
+    process_cpu_cache_slot_t* slots;    // PROCESS_CPU_CACHE_GROUP slots of every group
+} process_cpu_cache_t;
+
+// Create cache for about capacity pids (rounded up to power of two groups), fork after it to share it
+process_cpu_cache_t* process_cpu_cache_create(size_t capacity);
+
+void process_cpu_cache_delete(process_cpu_cache_t* cache);
+
+// Find result of pid not older than max_staleness_ms, return 1 and set cpu_usage on hit, 0 on miss (missing pid is a miss, see process_cpu_cache_missing)
+int process_cpu_cache_get(process_cpu_cache_t* cache, pid_t pid, int64_t max_staleness_ms, double* cpu_usage);
+
+// Return 1 if pid was not found within last ttl_ms and was not measured since, counters are not changed
+// If pid exists now, its negative result is dropped and 0 is returned, so it is measured
+int process_cpu_cache_missing(process_cpu_cache_t* cache, pid_t pid, int64_t ttl_ms);
+
+// Publish result of pid measured now (negative if pid was not found, result of pid which appeared replaces it)
+// It is skipped if another process is writing the same slot
+void process_cpu_cache_put(process_cpu_cache_t* cache, pid_t pid, double cpu_usage);
+
+#endif    // PROCESS_CPU_CACHE_H
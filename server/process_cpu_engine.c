@@ -0,0 +1,577 @@
+#include "process_cpu_engine.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "process_cpu_usage.h"
+#include "utility.h"
+
+static uint64_t process_cpu_engine_now_tick(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000) / PROCESS_CPU_ENGINE_TICK_MS;
+}
+
+static size_t process_cpu_engine_bucket(const process_cpu_engine_t* engine, pid_t pid)
+{
+    return (size_t)(((uint32_t)pid * 2654435761u) >> 8) & engine->bucket_mask;
+}
+
+static process_cpu_measurement_t* process_cpu_engine_find(const process_cpu_engine_t* engine, pid_t pid, process_cpu_backend_t backend)
+{
+    process_cpu_measurement_t* measurement = engine->in_flight[process_cpu_engine_bucket(engine, pid)];
+    while (measurement && (measurement->pid != pid || measurement->backend != backend))
+    {
+        measurement = measurement->bucket_next;
+    }
+
+    return measurement;
+}
+
+static void process_cpu_engine_unlink(process_cpu_engine_t* engine, process_cpu_measurement_t* measurement)
+{
+    process_cpu_measurement_t** link = &engine->in_flight[process_cpu_engine_bucket(engine, measurement->pid)];
+    while (*link != measurement)
+    {
+        link = &(*link)->bucket_next;
+    }
+    *link = measurement->bucket_next;
+}
+
+static process_cpu_measurement_t* process_cpu_engine_take(process_cpu_engine_t* engine, process_cpu_callback_t callback, void* context)
+{
+    process_cpu_measurement_t* measurement = engine->free_list;
+    engine->free_list = measurement->next;
+    engine->in_use++;
+
+    measurement->callback = callback;
+    measurement->context = context;
+    measurement->waiters = NULL;
+    measurement->bucket_next = NULL;
+
+    return measurement;
+}
+
+static uint64_t process_cpu_engine_window_ticks(unsigned window_ms)
+{
+    uint64_t window_ticks = (window_ms + PROCESS_CPU_ENGINE_TICK_MS - 1) / PROCESS_CPU_ENGINE_TICK_MS;
+    if (window_ticks == 0)
+    {
+        window_ticks = 1;
+    }
+    if (window_ticks >= PROCESS_CPU_ENGINE_WHEEL_SLOTS)
+    {
+        window_ticks = PROCESS_CPU_ENGINE_WHEEL_SLOTS - 1;
+    }
+
+    return window_ticks;
+}
+
+static void process_cpu_engine_schedule(process_cpu_engine_t* engine, process_cpu_measurement_t* measurement)
+{
+    process_cpu_measurement_t** slot = &engine->wheel[measurement->due_tick % PROCESS_CPU_ENGINE_WHEEL_SLOTS];
+    measurement->next = *slot;
+    *slot = measurement;
+}
+
+// Taskstats socket is opened once, by first use, so engines which do not use it do not probe netlink
+static process_cpu_taskstats_t* process_cpu_engine_taskstats(process_cpu_engine_t* engine)
+{
+    if (!engine->taskstats_probed)
+    {
+        engine->taskstats = process_cpu_taskstats_create();
+        engine->taskstats_probed = 1;
+    }
+
+    return engine->taskstats;
+}
+
+// Cpu time of pid with backend, -1 if pid is not found or backend is not available
+static long long process_cpu_engine_process_time(process_cpu_engine_t* engine, process_cpu_backend_t backend, pid_t pid)
+{
+    switch (backend)
+    {
+        case PROCESS_CPU_BACKEND_SCHEDSTAT:
+            return process_cpu_schedstat_time(pid);
+        case PROCESS_CPU_BACKEND_TASKSTATS:
+            return process_cpu_taskstats_time(process_cpu_engine_taskstats(engine), pid);
+        default:
+            return process_cpu_process_time(pid);
+    }
+}
+
+// Total time sample of tick, it is read once for all measurements of the tick
+static long long process_cpu_engine_total(process_cpu_engine_t* engine, uint64_t tick)
+{
+    if (engine->total_tick != tick)
+    {
+        engine->total = process_cpu_total_time();
+        engine->total_tick = engine->total == -1 ? UINT64_MAX : tick;
+    }
+
+    return engine->total;
+}
+
+// Timer ticks only while measurements are pending
+static int process_cpu_engine_arm(process_cpu_engine_t* engine, int armed)
+{
+    if (engine->timer_armed == armed)
+    {
+        return 0;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (armed)
+    {
+        spec.it_value.tv_nsec = PROCESS_CPU_ENGINE_TICK_MS * 1000000L;
+        spec.it_interval.tv_nsec = PROCESS_CPU_ENGINE_TICK_MS * 1000000L;
+    }
+
+    if (timerfd_settime(engine->timer_fd, 0, &spec, NULL) != 0)
+    {
+        DEBUG_LOG("process_cpu_engine_arm: timerfd_settime error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    engine->timer_armed = armed;
+    return 0;
+}
+
+process_cpu_engine_t* process_cpu_engine_create(unsigned window_ms, size_t capacity)
+{
+    if (capacity == 0)
+    {
+        DEBUG_LOG("process_cpu_engine_create: capacity is zero\n");
+        return NULL;
+    }
+
+    process_cpu_engine_t* engine = (process_cpu_engine_t*)calloc(1, sizeof(process_cpu_engine_t));
+    if (!engine)
+    {
+        DEBUG_LOG("process_cpu_engine_create: calloc failed\n");
+        return NULL;
+    }
+
+    engine->measurements = (process_cpu_measurement_t*)calloc(capacity, sizeof(process_cpu_measurement_t));
+    if (!engine->measurements)
+    {
+        DEBUG_LOG("process_cpu_engine_create: calloc of %zu measurements failed\n", capacity);
+        goto process_cpu_engine_create_failed;
+    }
+
+    size_t buckets = 1;
+    while (buckets < capacity)
+    {
+        buckets <<= 1;
+    }
+    engine->in_flight = (process_cpu_measurement_t**)calloc(buckets, sizeof(process_cpu_measurement_t*));
+    if (!engine->in_flight)
+    {
+        DEBUG_LOG("process_cpu_engine_create: calloc of %zu buckets failed\n", buckets);
+        goto process_cpu_engine_create_failed;
+    }
+    engine->bucket_mask = buckets - 1;
+
+    engine->due = (process_cpu_measurement_t**)calloc(capacity, sizeof(process_cpu_measurement_t*));
+    engine->due_pids = (pid_t*)calloc(capacity, sizeof(pid_t));
+    engine->due_times = (long long*)calloc(capacity, sizeof(long long));
+    if (!engine->due || !engine->due_pids || !engine->due_times)
+    {
+        DEBUG_LOG("process_cpu_engine_create: calloc of due arrays of %zu measurements failed\n", capacity);
+        goto process_cpu_engine_create_failed;
+    }
+
+    engine->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (engine->timer_fd == -1)
+    {
+        DEBUG_LOG("process_cpu_engine_create: timerfd_create error: %s\n", strerror(errno));
+        goto process_cpu_engine_create_failed;
+    }
+
+    for (int backend = 0; backend < PROCESS_CPU_BACKEND_COUNT; backend++)
+    {
+        engine->window_ticks[backend] = process_cpu_engine_window_ticks(window_ms);
+    }
+
+    engine->capacity = capacity;
+    engine->total_tick = UINT64_MAX;
+    engine->dispatched_tick = process_cpu_engine_now_tick();
+    for (size_t i = 0; i < capacity; i++)
+    {
+        engine->measurements[i].next = i + 1 < capacity ? &engine->measurements[i + 1] : NULL;
+    }
+    engine->free_list = engine->measurements;
+
+    return engine;
+
+process_cpu_engine_create_failed:
+    SAFE_FREE(engine->due_times);
+    SAFE_FREE(engine->due_pids);
+    SAFE_FREE(engine->due);
+    SAFE_FREE(engine->in_flight);
+    SAFE_FREE(engine->measurements);
+    SAFE_FREE(engine);
+
+    return NULL;
+}
+
+void process_cpu_engine_delete(process_cpu_engine_t* engine)
+{
+    if (!engine)
+    {
+        return;
+    }
+
+    close(engine->timer_fd);
+    process_cpu_taskstats_delete(engine->taskstats);
+    SAFE_FREE(engine->due_times);
+    SAFE_FREE(engine->due_pids);
+    SAFE_FREE(engine->due);
+    SAFE_FREE(engine->in_flight);
+    SAFE_FREE(engine->measurements);
+    SAFE_FREE(engine);
+}
+
+void process_cpu_engine_set_window(process_cpu_engine_t* engine, process_cpu_backend_t backend, unsigned window_ms)
+{
+    if (!engine || backend >= PROCESS_CPU_BACKEND_COUNT)
+    {
+        DEBUG_LOG("process_cpu_engine_set_window: engine is NULL or backend is invalid\n");
+        return;
+    }
+
+    engine->window_ticks[backend] = process_cpu_engine_window_ticks(window_ms);
+}
+
+void process_cpu_engine_set_accuracy(process_cpu_engine_t* engine, unsigned max_window_ms, unsigned accuracy_percent)
+{
+    if (!engine)
+    {
+        DEBUG_LOG("process_cpu_engine_set_accuracy: engine is NULL\n");
+        return;
+    }
+
+    engine->max_window_ticks = process_cpu_engine_window_ticks(max_window_ms);
+    engine->accuracy_percent = accuracy_percent;
+}
+
+int process_cpu_engine_fd(const process_cpu_engine_t* engine)
+{
+    return engine ? engine->timer_fd : -1;
+}
+
+process_cpu_status_t process_cpu_engine_start(process_cpu_engine_t* engine, pid_t pid, process_cpu_callback_t callback, void* context)
+{
+    return process_cpu_engine_start_backend(engine, pid, PROCESS_CPU_BACKEND_TICKS, callback, context);
+}
+
+process_cpu_status_t process_cpu_engine_start_backend(process_cpu_engine_t* engine, pid_t pid, process_cpu_backend_t backend, process_cpu_callback_t callback,
+                                                      void* context)
+{
+    if (!engine || !callback)
+    {
+        DEBUG_LOG("process_cpu_engine_start: engine or callback is NULL\n");
+        return PROCESS_CPU_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    if (!engine->free_list)
+    {
+        DEBUG_LOG("process_cpu_engine_start: %zu measurements are in flight\n", engine->in_use);
+        return PROCESS_CPU_STATUS_ERROR_FULL;
+    }
+
+    uint64_t tick = process_cpu_engine_now_tick();
+    long long start_process = -1;
+    long long start_total = -1;
+
+    if (backend == PROCESS_CPU_BACKEND_SCHEDSTAT || backend == PROCESS_CPU_BACKEND_TASKSTATS)
+    {
+        start_total = process_cpu_monotonic_ns();
+        start_process = process_cpu_engine_process_time(engine, backend, pid);
+        if (start_process == -1)
+        {
+            backend = PROCESS_CPU_BACKEND_TICKS;
+        }
+    }
+    else
+    {
+        backend = PROCESS_CPU_BACKEND_TICKS;
+    }
+
+    // Pid in flight: wait for its measurement instead of starting another one
+    process_cpu_measurement_t* primary = process_cpu_engine_find(engine, pid, backend);
+    if (primary)
+    {
+        process_cpu_measurement_t* waiter = process_cpu_engine_take(engine, callback, context);
+        waiter->pid = pid;
+        waiter->backend = backend;
+        waiter->next = primary->waiters;
+        primary->waiters = waiter;
+        engine->coalesced++;
+
+        return PROCESS_CPU_STATUS_SUCCESS;
+    }
+
+    if (backend == PROCESS_CPU_BACKEND_TICKS)
+    {
+        start_total = process_cpu_engine_total(engine, tick);
+        if (start_total == -1)
+        {
+            return PROCESS_CPU_STATUS_ERROR_READ;
+        }
+
+        start_process = process_cpu_process_time(pid);
+        if (start_process == -1)
+        {
+            return PROCESS_CPU_STATUS_ERROR_NOT_FOUND;
+        }
+    }
+
+    if (process_cpu_engine_arm(engine, 1) != 0)
+    {
+        return PROCESS_CPU_STATUS_ERROR_TIMER;
+    }
+
+    process_cpu_measurement_t* measurement = process_cpu_engine_take(engine, callback, context);
+    measurement->pid = pid;
+    measurement->backend = backend;
+    measurement->start_process = start_process;
+    measurement->start_total = start_total;
+    measurement->start_tick = tick;
+    measurement->due_tick = tick + engine->window_ticks[backend];
+    measurement->max_tick = measurement->due_tick;
+    if (backend != PROCESS_CPU_BACKEND_SCHEDSTAT && engine->accuracy_percent > 0 && engine->max_window_ticks > engine->window_ticks[backend])
+    {
+        measurement->max_tick = tick + engine->max_window_ticks;
+    }
+
+    size_t bucket = process_cpu_engine_bucket(engine, pid);
+    measurement->bucket_next = engine->in_flight[bucket];
+    engine->in_flight[bucket] = measurement;
+
+    process_cpu_engine_schedule(engine, measurement);
+    engine->pending++;
+
+    return PROCESS_CPU_STATUS_SUCCESS;
+}
+
+// Every tick of total (clock ticks of all cpus) is a sample of whether process ran, so the result is a rate r = process / total of them
+// with relative standard error sqrt((1 - r) / process), it is compared with accuracy target squared (no sqrt)
+// Rate without process ticks says nothing yet, its window is extended up to max window
+static int process_cpu_engine_accurate(const process_cpu_engine_t* engine, double process, double total)
+{
+    if (process <= 0.0 || total <= 0.0)
+    {
+        return 0;
+    }
+
+    double rate = process < total ? process / total : 1.0;
+    return 10000.0 * (1.0 - rate) <= (double)engine->accuracy_percent * engine->accuracy_percent * process;
+}
+
+// Cpu usage of measurement sampled in tick, schedstat and taskstats measurements do not read /proc/stat
+// end_process is the end sample of ticks backend, it is read by dispatch in one batch for all due measurements
+// accurate is 0 if error of the result is above accuracy target of ticks and taskstats backends
+static double process_cpu_engine_usage(process_cpu_engine_t* engine, const process_cpu_measurement_t* measurement, uint64_t tick, long long end_process,
+                                       int* accurate)
+{
+    *accurate = 1;
+
+    if (measurement->backend != PROCESS_CPU_BACKEND_TICKS)
+    {
+        long long end_process = process_cpu_engine_process_time(engine, measurement->backend, measurement->pid);
+        if (end_process == -1)
+        {
+            return -1.0;
+        }
+
+        long long process_ns = end_process - measurement->start_process;
+        long long elapsed_ns = process_cpu_monotonic_ns() - measurement->start_total;
+        if (measurement->backend == PROCESS_CPU_BACKEND_TASKSTATS)
+        {
+            process_ns *= 1000;
+
+            // Taskstats time grows by scheduler ticks unless kernel has precise accounting, so it is judged in clock ticks too,
+            // elapsed time counts ticks of all cpus like total of /proc/stat in ticks backend
+            if (engine->accuracy_percent > 0)
+            {
+                double tick_ns = 1e9 / (double)sysconf(_SC_CLK_TCK);
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                *accurate = process_cpu_engine_accurate(engine, (double)process_ns / tick_ns, (double)elapsed_ns * (double)(cpus > 0 ? cpus : 1) / tick_ns);
+            }
+        }
+
+        return process_cpu_ns_usage(process_ns, elapsed_ns);
+    }
+
+    long long end_total = process_cpu_engine_total(engine, tick);
+    if (end_process == -1 || end_total == -1)
+    {
+        return -1.0;
+    }
+
+    long long total_diff = end_total - measurement->start_total;
+    long long process_diff = end_process - measurement->start_process;
+    if (engine->accuracy_percent > 0)
+    {
+        *accurate = process_cpu_engine_accurate(engine, (double)process_diff, (double)total_diff);
+    }
+
+    return total_diff > 0 ? (100.0 * (double)(end_process - measurement->start_process)) / (double)total_diff : 0.0;
+}
+
+// Finish measurement and its waiters, return count of callbacks
+static size_t process_cpu_engine_finish(process_cpu_engine_t* engine, process_cpu_measurement_t* measurement, double cpu_usage, unsigned window_ms)
+{
+    process_cpu_engine_unlink(engine, measurement);
+    engine->pending--;
+
+    // Measurements are released before callbacks, so callback can start a new one
+    size_t finished = 0;
+    process_cpu_measurement_t* waiters = measurement->waiters;
+    measurement->next = waiters;
+    while (measurement)
+    {
+        process_cpu_measurement_t* next = measurement->next;
+        process_cpu_callback_t callback = measurement->callback;
+        void* context = measurement->context;
+        pid_t pid = measurement->pid;
+
+        measurement->next = engine->free_list;
+        engine->free_list = measurement;
+        engine->in_use--;
+
+        callback(context, pid, cpu_usage, window_ms);
+        finished++;
+        measurement = next;
+    }
+
+    return finished;
+}
+
+long long process_cpu_engine_sample_cost_ns(process_cpu_engine_t* engine, process_cpu_backend_t backend, pid_t pid, unsigned samples)
+{
+    if (!engine || backend >= PROCESS_CPU_BACKEND_COUNT || samples == 0)
+    {
+        DEBUG_LOG("process_cpu_engine_sample_cost_ns: engine is NULL, backend is invalid or no samples\n");
+        return -1;
+    }
+
+    if (process_cpu_engine_process_time(engine, backend, pid) == -1)
+    {
+        return -1;
+    }
+
+    long long start = process_cpu_monotonic_ns();
+    for (unsigned i = 0; i < samples; i++)
+    {
+        process_cpu_engine_process_time(engine, backend, pid);
+    }
+
+    return (process_cpu_monotonic_ns() - start) / samples;
+}
+
+size_t process_cpu_engine_dispatch(process_cpu_engine_t* engine)
+{
+    if (!engine)
+    {
+        return 0;
+    }
+
+    // Expirations are only a wake up, due measurements are found by clock
+    uint64_t expirations;
+    while (read(engine->timer_fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+        ;
+
+    uint64_t now = process_cpu_engine_now_tick();
+    size_t finished = 0;
+    size_t due = 0;
+    size_t due_ticks = 0;
+
+    // Each slot is visited once even if dispatch was late for more than a wheel turn
+    uint64_t last = now - engine->dispatched_tick > PROCESS_CPU_ENGINE_WHEEL_SLOTS ? engine->dispatched_tick + PROCESS_CPU_ENGINE_WHEEL_SLOTS : now;
+    for (uint64_t tick = engine->dispatched_tick + 1; tick <= last && engine->pending > due; tick++)
+    {
+        process_cpu_measurement_t** slot = &engine->wheel[tick % PROCESS_CPU_ENGINE_WHEEL_SLOTS];
+        process_cpu_measurement_t* measurement = *slot;
+        *slot = NULL;
+
+        while (measurement)
+        {
+            process_cpu_measurement_t* next = measurement->next;
+            if (measurement->due_tick <= now)
+            {
+                engine->due[due++] = measurement;
+                if (measurement->backend == PROCESS_CPU_BACKEND_TICKS)
+                {
+                    engine->due_pids[due_ticks++] = measurement->pid;
+                }
+            }
+            else
+            {
+                measurement->next = *slot;
+                *slot = measurement;
+            }
+            measurement = next;
+        }
+    }
+    engine->dispatched_tick = now;
+
+    // End samples of all due measurements of ticks backend are read together (io_uring batch if kernel has it)
+    if (due_ticks > 0)
+    {
+        process_cpu_process_times(engine->due_pids, due_ticks, engine->due_times);
+    }
+
+    due_ticks = 0;
+    for (size_t i = 0; i < due; i++)
+    {
+        process_cpu_measurement_t* measurement = engine->due[i];
+        long long end_process = measurement->backend == PROCESS_CPU_BACKEND_TICKS ? engine->due_times[due_ticks++] : -1;
+
+        int accurate = 1;
+        double cpu_usage = process_cpu_engine_usage(engine, measurement, now, end_process, &accurate);
+        if (!accurate && cpu_usage >= 0 && now < measurement->max_tick)
+        {
+            // Window is doubled, so an idle process is sampled a few times and not every tick
+            uint64_t due_tick = now + (now - measurement->start_tick);
+            measurement->due_tick = due_tick < measurement->max_tick ? due_tick : measurement->max_tick;
+            process_cpu_engine_schedule(engine, measurement);
+        }
+        else
+        {
+            unsigned window_ms = (unsigned)((now - measurement->start_tick) * PROCESS_CPU_ENGINE_TICK_MS);
+            finished += process_cpu_engine_finish(engine, measurement, cpu_usage, window_ms);
+        }
+    }
+
+    if (engine->pending == 0)
+    {
+        process_cpu_engine_arm(engine, 0);
+    }
+
+    return finished;
+}
+
+size_t process_cpu_engine_wait(process_cpu_engine_t* engine, int timeout_ms)
+{
+    if (!engine)
+    {
+        return 0;
+    }
+
+    struct pollfd pfd = {.fd = engine->timer_fd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, timeout_ms) == -1 && errno != EINTR)
+    {
+        DEBUG_LOG("process_cpu_engine_wait: poll error: %s\n", strerror(errno));
+    }
+
+    return process_cpu_engine_dispatch(engine);
+}
@@ -0,0 +1,100 @@
+#ifndef PROCESS_CPU_ENGINE_H
+#define PROCESS_CPU_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "process_cpu_taskstats.h"
+#include "process_cpu_usage.h"
+
+// Measurement is split in start and finish samples, pending measurements wait in a timer wheel driven by timerfd
+// Measurements started or finished in the same tick share one read of /proc/stat, finished ones read their /proc/<pid>/stat in one batch
+// Start of pid which is already in flight with the same backend is coalesced: caller waits for that measurement and gets its result
+#define PROCESS_CPU_ENGINE_TICK_MS 1
+#define PROCESS_CPU_ENGINE_WHEEL_SLOTS 256    // window is limited to (slots - 1) ticks
+
+// Called when measurement is finished, cpu_usage is in percent or -1.0 if process has exited during window
+// window_ms is the window which was used, it differs from the configured one with accuracy target
+typedef void (*process_cpu_callback_t)(void* context, pid_t pid, double cpu_usage, unsigned window_ms);
+
+typedef struct process_cpu_measurement
+{
+    pid_t pid;
+    process_cpu_backend_t backend;
+    long long start_process;    // clock ticks, schedstat ns or taskstats us
+    long long start_total;      // clock ticks of all cpus or monotonic ns
+    uint64_t start_tick;
+    uint64_t due_tick;    // next sample, measurement is finished at it unless it is extended for accuracy
+    uint64_t max_tick;
+    process_cpu_callback_t callback;
+    void* context;
+    struct process_cpu_measurement* next;           // in wheel slot or free list
+    struct process_cpu_measurement* waiters;        // coalesced starts of the same pid, they are not in wheel
+    struct process_cpu_measurement* bucket_next;    // in in-flight bucket of pid
+} process_cpu_measurement_t;
+
+typedef struct process_cpu_engine
+{
+    int timer_fd;
+    int timer_armed;
+    uint64_t window_ticks[PROCESS_CPU_BACKEND_COUNT];
+    uint64_t max_window_ticks;    // ticks and taskstats backends with accuracy target
+    unsigned accuracy_percent;    // target relative error of ticks and taskstats backend result in percent, 0 is fixed window
+    uint64_t dispatched_tick;    // last tick which wheel slot was dispatched
+    long long total;             // /proc/stat sample of total_tick
+    uint64_t total_tick;         // UINT64_MAX if there is no sample
+    size_t pending;              // measurements in wheel
+    size_t in_use;               // measurements in wheel and their waiters
+    size_t capacity;
+    uint64_t coalesced;    // starts which waited for measurement in flight
+    process_cpu_measurement_t* measurements;    // pool of capacity measurements
+    process_cpu_measurement_t* free_list;
+    process_cpu_measurement_t* wheel[PROCESS_CPU_ENGINE_WHEEL_SLOTS];
+    size_t bucket_mask;
+    process_cpu_measurement_t** in_flight;    // measurements in wheel by pid, bucket_mask + 1 buckets
+    process_cpu_measurement_t** due;          // measurements due in dispatch, capacity of them
+    pid_t* due_pids;                          // pids of due measurements of ticks backend, their end samples are read in one batch
+    long long* due_times;
+    process_cpu_taskstats_t* taskstats;       // opened by first taskstats start, NULL if interface is not available
+    int taskstats_probed;
+} process_cpu_engine_t;
+
+// Create engine for measurements over window_ms with at most capacity of them in flight
+process_cpu_engine_t* process_cpu_engine_create(unsigned window_ms, size_t capacity);
+
+// Set window of measurements of backend started after the call, window_ms of create is used for all backends by default
+void process_cpu_engine_set_window(process_cpu_engine_t* engine, process_cpu_backend_t backend, unsigned window_ms);
+
+// Windows of ticks and taskstats backends become adaptive: their window is the first sample, then the window is doubled
+// until relative standard error of the rate of process ticks among total ticks of all cpus, sqrt((1 - r) / process ticks),
+// is at most accuracy_percent or max_window_ms is reached (about 10000 / accuracy_percent^2 process ticks are needed)
+// (taskstats time may grow by scheduler ticks, it is counted in clock ticks against elapsed time of all cpus); schedstat window stays fixed
+// Busy process is answered early, idle one (no process ticks) is measured up to max_window_ms; accuracy_percent 0 restores fixed window
+void process_cpu_engine_set_accuracy(process_cpu_engine_t* engine, unsigned max_window_ms, unsigned accuracy_percent);
+
+// Delete engine, pending measurements are dropped without callback
+void process_cpu_engine_delete(process_cpu_engine_t* engine);
+
+// Timer descriptor, readable when a tick has passed and measurements may be due (for poll/epoll of caller)
+int process_cpu_engine_fd(const process_cpu_engine_t* engine);
+
+// Take start sample of pid, callback is called from process_cpu_engine_dispatch after window
+// If pid is in flight, start is attached to that measurement and callback gets its result
+process_cpu_status_t process_cpu_engine_start(process_cpu_engine_t* engine, pid_t pid, process_cpu_callback_t callback, void* context);
+
+// Same as process_cpu_engine_start with backend, schedstat and taskstats fall back to ticks if their interface is not available
+process_cpu_status_t process_cpu_engine_start_backend(process_cpu_engine_t* engine, pid_t pid, process_cpu_backend_t backend, process_cpu_callback_t callback,
+                                                      void* context);
+
+// Average cost of one cpu time sample of pid with backend over samples samples in ns, -1 if backend is not available
+// Comparison of backends on the host, e.g. to choose the default one
+long long process_cpu_engine_sample_cost_ns(process_cpu_engine_t* engine, process_cpu_backend_t backend, pid_t pid, unsigned samples);
+
+// Finish measurements whose window has ended and call their callbacks, return count of them
+size_t process_cpu_engine_dispatch(process_cpu_engine_t* engine);
+
+// Wait up to timeout_ms for next tick (returns at once if nothing is pending and timeout is 0) and dispatch
+size_t process_cpu_engine_wait(process_cpu_engine_t* engine, int timeout_ms);
+
+#endif    // PROCESS_CPU_ENGINE_H
@@ -0,0 +1,137 @@
+#include "process_cpu_samples.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "utility.h"
+
+static size_t process_cpu_samples_hash(pid_t pid)
+{
+    return (size_t)((uint32_t)pid * 2654435761u);
+}
+
+static int64_t process_cpu_samples_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+process_cpu_samples_t* process_cpu_samples_create(size_t capacity)
+{
+    size_t slots = PROCESS_CPU_SAMPLES_PROBE;
+    while (slots < capacity)
+    {
+        slots <<= 1;
+    }
+
+    process_cpu_samples_t* samples = (process_cpu_samples_t*)calloc(1, sizeof(process_cpu_samples_t));
+    if (!samples)
+    {
+        DEBUG_LOG("process_cpu_samples_create: calloc failed\n");
+        return NULL;
+    }
+
+    samples->slots = (process_cpu_sample_t*)calloc(slots, sizeof(process_cpu_sample_t));
+    if (!samples->slots)
+    {
+        DEBUG_LOG("process_cpu_samples_create: calloc of %zu slots failed\n", slots);
+        SAFE_FREE(samples);
+        return NULL;
+    }
+    samples->mask = slots - 1;
+
+    return samples;
+}
+
+void process_cpu_samples_delete(process_cpu_samples_t* samples)
+{
+    if (!samples)
+    {
+        return;
+    }
+
+    SAFE_FREE(samples->slots);
+    SAFE_FREE(samples);
+}
+
+process_cpu_status_t process_cpu_samples_exchange(process_cpu_samples_t* samples, const process_cpu_sample_t* sample, process_cpu_sample_t* previous)
+{
+    if (!samples || !sample || !previous || sample->pid == 0)
+    {
+        DEBUG_LOG("process_cpu_samples_exchange: Null argument(s) or zero pid\n");
+        return PROCESS_CPU_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    size_t start = process_cpu_samples_hash(sample->pid);
+    process_cpu_sample_t* target = NULL;
+    for (size_t i = 0; i < PROCESS_CPU_SAMPLES_PROBE; i++)
+    {
+        process_cpu_sample_t* slot = &samples->slots[(start + i) & samples->mask];
+        if (slot->pid == sample->pid)
+        {
+            *previous = *slot;
+            *slot = *sample;
+            return PROCESS_CPU_STATUS_SUCCESS;
+        }
+
+        // First empty slot, otherwise the oldest sample is evicted
+        if (slot->pid == 0)
+        {
+            if (!target || target->pid != 0)
+            {
+                target = slot;
+            }
+        }
+        else if (!target || (target->pid != 0 && slot->time_ms < target->time_ms))
+        {
+            target = slot;
+        }
+    }
+
+    if (target->pid == 0)
+    {
+        samples->count++;
+    }
+    *target = *sample;
+
+    return PROCESS_CPU_STATUS_ERROR_NO_SAMPLE;
+}
+
+process_cpu_status_t process_cpu_samples_delta(process_cpu_samples_t* samples, pid_t pid, double* cpu_usage, int64_t* window_ms)
+{
+    if (!samples || !cpu_usage || !window_ms)
+    {
+        DEBUG_LOG("process_cpu_samples_delta: Null argument(s)\n");
+        return PROCESS_CPU_STATUS_ERROR_PARAMS_NULL;
+    }
+
+    process_cpu_sample_t sample = {.pid = pid, .process = process_cpu_process_time(pid), .total = process_cpu_total_time(), .time_ms = process_cpu_samples_now_ms()};
+    if (sample.process == -1)
+    {
+        return PROCESS_CPU_STATUS_ERROR_NOT_FOUND;
+    }
+    if (sample.total == -1)
+    {
+        return PROCESS_CPU_STATUS_ERROR_READ;
+    }
+
+    process_cpu_sample_t previous;
+    process_cpu_status_t status = process_cpu_samples_exchange(samples, &sample, &previous);
+    if (status != PROCESS_CPU_STATUS_SUCCESS)
+    {
+        return status;
+    }
+
+    // Process time going back means pid was reused by another process
+    if (sample.process < previous.process || sample.total < previous.total)
+    {
+        return PROCESS_CPU_STATUS_ERROR_NO_SAMPLE;
+    }
+
+    long long total_diff = sample.total - previous.total;
+    *cpu_usage = total_diff > 0 ? (100.0 * (double)(sample.process - previous.process)) / (double)total_diff : 0.0;
+    *window_ms = sample.time_ms - previous.time_ms;
+
+    return PROCESS_CPU_STATUS_SUCCESS;
+}
@@ -0,0 +1,41 @@
+#ifndef PROCESS_CPU_SAMPLES_H
+#define PROCESS_CPU_SAMPLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "process_cpu_usage.h"
+
+// Last cpu time sample of each pid for usage since previous request of the pid
+// Table is bounded: open addressing with probe of PROCESS_CPU_SAMPLES_PROBE slots, the oldest sample of the probe is replaced
+#define PROCESS_CPU_SAMPLES_PROBE 8
+
+typedef struct process_cpu_sample
+{
+    pid_t pid;              // 0 for empty slot
+    long long process;      // utime + stime of process in clock ticks
+    long long total;        // total time of all cpus in clock ticks
+    int64_t time_ms;        // CLOCK_MONOTONIC time of sample
+} process_cpu_sample_t;
+
+typedef struct process_cpu_samples
+{
+    size_t mask;    // capacity - 1, capacity is power of two
+    size_t count;
+    process_cpu_sample_t* slots;
+} process_cpu_samples_t;
+
+// Create table for about capacity pids (rounded up to power of two)
+process_cpu_samples_t* process_cpu_samples_create(size_t capacity);
+
+void process_cpu_samples_delete(process_cpu_samples_t* samples);
+
+// Store sample and return previous sample of the same pid in previous, PROCESS_CPU_STATUS_ERROR_NO_SAMPLE if there is none
+process_cpu_status_t process_cpu_samples_exchange(process_cpu_samples_t* samples, const process_cpu_sample_t* sample, process_cpu_sample_t* previous);
+
+// Take sample of pid now and compute cpu usage since previous sample of pid and its window in ms
+// Returns PROCESS_CPU_STATUS_ERROR_NO_SAMPLE for first request of pid (or pid reused by new process), sample is stored anyway
+process_cpu_status_t process_cpu_samples_delta(process_cpu_samples_t* samples, pid_t pid, double* cpu_usage, int64_t* window_ms);
+
+#endif    // PROCESS_CPU_SAMPLES_H
@@ -0,0 +1,246 @@
+#include "process_cpu_taskstats.h"
+
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "utility.h"
+
+#define PROCESS_CPU_TASKSTATS_GENL_DATA(nlh) ((uint8_t*)NLMSG_DATA(nlh) + GENL_HDRLEN)
+#define PROCESS_CPU_TASKSTATS_NLA_DATA(nla) ((uint8_t*)(nla) + NLA_HDRLEN)
+
+typedef struct process_cpu_taskstats_request
+{
+    struct nlmsghdr header;
+    struct genlmsghdr genl;
+    uint8_t attributes[64];
+} process_cpu_taskstats_request_t;
+
+// Append attribute to request, returns 0 if it does not fit
+static int process_cpu_taskstats_put(process_cpu_taskstats_request_t* request, uint16_t type, const void* data, uint16_t length)
+{
+    uint32_t offset = request->header.nlmsg_len - (uint32_t)offsetof(process_cpu_taskstats_request_t, attributes);
+    if (offset + NLA_HDRLEN + NLA_ALIGN(length) > sizeof(request->attributes))
+    {
+        return 0;
+    }
+
+    struct nlattr* attribute = (struct nlattr*)(request->attributes + offset);
+    attribute->nla_type = type;
+    attribute->nla_len = (uint16_t)(NLA_HDRLEN + length);
+    memcpy(PROCESS_CPU_TASKSTATS_NLA_DATA(attribute), data, length);
+    request->header.nlmsg_len += NLA_HDRLEN + NLA_ALIGN(length);
+
+    return 1;
+}
+
+// Find attribute of type among attributes of length bytes, NULL if there is none
+static struct nlattr* process_cpu_taskstats_find(uint8_t* attributes, int length, uint16_t type)
+{
+    while (length >= NLA_HDRLEN)
+    {
+        struct nlattr* attribute = (struct nlattr*)attributes;
+        if (attribute->nla_len < NLA_HDRLEN || attribute->nla_len > length)
+        {
+            return NULL;
+        }
+        if ((attribute->nla_type & NLA_TYPE_MASK) == type)
+        {
+            return attribute;
+        }
+
+        attributes += NLA_ALIGN(attribute->nla_len);
+        length -= NLA_ALIGN(attribute->nla_len);
+    }
+
+    return NULL;
+}
+
+// Send request and receive its response in buffer, returns generic netlink response or NULL (errno is set from netlink error)
+static struct nlmsghdr* process_cpu_taskstats_transact(process_cpu_taskstats_t* taskstats, process_cpu_taskstats_request_t* request)
+{
+    request->header.nlmsg_seq = ++taskstats->sequence;
+
+    struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+    if (sendto(taskstats->fd, request, request->header.nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0)
+    {
+        DEBUG_LOG("process_cpu_taskstats_transact: sendto error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    // Responses of earlier requests which timed out are skipped by sequence
+    for (;;)
+    {
+        ssize_t length = recv(taskstats->fd, taskstats->buffer, sizeof(taskstats->buffer), 0);
+        if (length < 0)
+        {
+            DEBUG_LOG("process_cpu_taskstats_transact: recv error: %s\n", strerror(errno));
+            return NULL;
+        }
+
+        struct nlmsghdr* response = (struct nlmsghdr*)taskstats->buffer;
+        if (!NLMSG_OK(response, (uint32_t)length))
+        {
+            errno = EBADMSG;
+            return NULL;
+        }
+        if (response->nlmsg_seq != request->header.nlmsg_seq)
+        {
+            continue;
+        }
+
+        if (response->nlmsg_type == NLMSG_ERROR)
+        {
+            struct nlmsgerr* error = (struct nlmsgerr*)NLMSG_DATA(response);
+            errno = error->error ? -error->error : EBADMSG;
+            return NULL;
+        }
+
+        return response;
+    }
+}
+
+static void process_cpu_taskstats_request_init(process_cpu_taskstats_request_t* request, uint16_t type, uint8_t command, uint8_t version)
+{
+    memset(request, 0, sizeof(*request));
+    request->header.nlmsg_len = (uint32_t)offsetof(process_cpu_taskstats_request_t, attributes);
+    request->header.nlmsg_type = type;
+    request->header.nlmsg_flags = NLM_F_REQUEST;
+    request->header.nlmsg_pid = 0;
+    request->genl.cmd = command;
+    request->genl.version = version;
+}
+
+// Id of TASKSTATS family from generic netlink controller, 0 if kernel has no such family
+static uint16_t process_cpu_taskstats_family(process_cpu_taskstats_t* taskstats)
+{
+    process_cpu_taskstats_request_t request;
+    process_cpu_taskstats_request_init(&request, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1);
+    process_cpu_taskstats_put(&request, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME));
+
+    struct nlmsghdr* response = process_cpu_taskstats_transact(taskstats, &request);
+    if (!response)
+    {
+        DEBUG_LOG("process_cpu_taskstats_family: family is not found: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct nlattr* id = process_cpu_taskstats_find(PROCESS_CPU_TASKSTATS_GENL_DATA(response), (int)(response->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN)), CTRL_ATTR_FAMILY_ID);
+    if (!id || id->nla_len < NLA_HDRLEN + sizeof(uint16_t))
+    {
+        return 0;
+    }
+
+    uint16_t family_id;
+    memcpy(&family_id, PROCESS_CPU_TASKSTATS_NLA_DATA(id), sizeof(family_id));
+    return family_id;
+}
+
+process_cpu_taskstats_t* process_cpu_taskstats_create(void)
+{
+    process_cpu_taskstats_t* taskstats = (process_cpu_taskstats_t*)calloc(1, sizeof(process_cpu_taskstats_t));
+    if (!taskstats)
+    {
+        DEBUG_LOG("process_cpu_taskstats_create: calloc failed\n");
+        return NULL;
+    }
+
+    taskstats->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (taskstats->fd == -1)
+    {
+        DEBUG_LOG("process_cpu_taskstats_create: socket error: %s\n", strerror(errno));
+        SAFE_FREE(taskstats);
+        return NULL;
+    }
+
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = PROCESS_CPU_TASKSTATS_TIMEOUT_MS * 1000};
+    setsockopt(taskstats->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_nl local = {.nl_family = AF_NETLINK};
+    if (bind(taskstats->fd, (struct sockaddr*)&local, sizeof(local)) != 0)
+    {
+        DEBUG_LOG("process_cpu_taskstats_create: bind error: %s\n", strerror(errno));
+        goto process_cpu_taskstats_create_failed;
+    }
+
+    taskstats->family_id = process_cpu_taskstats_family(taskstats);
+    if (taskstats->family_id == 0)
+    {
+        goto process_cpu_taskstats_create_failed;
+    }
+
+    // Family exists but per-process requests may be refused (no CAP_NET_ADMIN)
+    if (process_cpu_taskstats_time(taskstats, getpid()) == -1)
+    {
+        DEBUG_LOG("process_cpu_taskstats_create: probe request failed\n");
+        goto process_cpu_taskstats_create_failed;
+    }
+
+    return taskstats;
+
+process_cpu_taskstats_create_failed:
+    close(taskstats->fd);
+    SAFE_FREE(taskstats);
+
+    return NULL;
+}
+
+void process_cpu_taskstats_delete(process_cpu_taskstats_t* taskstats)
+{
+    if (!taskstats)
+    {
+        return;
+    }
+
+    close(taskstats->fd);
+    SAFE_FREE(taskstats);
+}
+
+long long process_cpu_taskstats_time(process_cpu_taskstats_t* taskstats, pid_t pid)
+{
+    if (!taskstats || pid <= 0)
+    {
+        return -1;
+    }
+
+    process_cpu_taskstats_request_t request;
+    process_cpu_taskstats_request_init(&request, taskstats->family_id, TASKSTATS_CMD_GET, TASKSTATS_GENL_VERSION);
+    uint32_t tgid = (uint32_t)pid;
+    process_cpu_taskstats_put(&request, TASKSTATS_CMD_ATTR_TGID, &tgid, sizeof(tgid));
+
+    struct nlmsghdr* response = process_cpu_taskstats_transact(taskstats, &request);
+    if (!response)
+    {
+        DEBUG_LOG("process_cpu_taskstats_time: request for %d failed: %s\n", pid, strerror(errno));
+        return -1;
+    }
+
+    // Stats of thread group are nested in TASKSTATS_TYPE_AGGR_TGID next to its tgid
+    struct nlattr* aggregate =
+        process_cpu_taskstats_find(PROCESS_CPU_TASKSTATS_GENL_DATA(response), (int)(response->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN)), TASKSTATS_TYPE_AGGR_TGID);
+    if (!aggregate)
+    {
+        return -1;
+    }
+
+    struct nlattr* stats = process_cpu_taskstats_find(PROCESS_CPU_TASKSTATS_NLA_DATA(aggregate), aggregate->nla_len - NLA_HDRLEN, TASKSTATS_TYPE_STATS);
+    if (!stats || stats->nla_len < NLA_HDRLEN + offsetof(struct taskstats, ac_stime) + sizeof(uint64_t))
+    {
+        return -1;
+    }
+
+    // Payload is not aligned for struct taskstats, fields are copied out
+    uint64_t utime;
+    uint64_t stime;
+    memcpy(&utime, PROCESS_CPU_TASKSTATS_NLA_DATA(stats) + offsetof(struct taskstats, ac_utime), sizeof(utime));
+    memcpy(&stime, PROCESS_CPU_TASKSTATS_NLA_DATA(stats) + offsetof(struct taskstats, ac_stime), sizeof(stime));
+
+    return (long long)(utime + stime);
+}
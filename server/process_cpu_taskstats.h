@@ -0,0 +1,29 @@
+#ifndef PROCESS_CPU_TASKSTATS_H
+#define PROCESS_CPU_TASKSTATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Cpu time of process from TASKSTATS generic netlink family: one binary request and response per sample over a persistent socket,
+// no open, read and parse of /proc/<pid>/stat
+// Kernel answers only with CONFIG_TASKSTATS and CAP_NET_ADMIN, create probes it and returns NULL if it does not answer (use procfs then)
+#define PROCESS_CPU_TASKSTATS_BUFFER_SIZE 2048    // response with struct taskstats of any kernel version
+#define PROCESS_CPU_TASKSTATS_TIMEOUT_MS 100      // response wait, socket is not left blocked by a lost response
+
+typedef struct process_cpu_taskstats
+{
+    int fd;
+    uint16_t family_id;    // resolved id of TASKSTATS family
+    uint32_t sequence;
+    uint8_t buffer[PROCESS_CPU_TASKSTATS_BUFFER_SIZE];
+} process_cpu_taskstats_t;
+
+// Open socket, resolve family and take probe sample of this process, NULL if interface is not available
+process_cpu_taskstats_t* process_cpu_taskstats_create(void);
+
+void process_cpu_taskstats_delete(process_cpu_taskstats_t* taskstats);
+
+// User and system time of process (ac_utime + ac_stime of its thread group) in us, -1 if process is not found or request failed
+long long process_cpu_taskstats_time(process_cpu_taskstats_t* taskstats, pid_t pid);
+
+#endif    // PROCESS_CPU_TASKSTATS_H
@@ -0,0 +1,343 @@
+#include "process_cpu_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "process_cpu_usage.h"
+#include "utility.h"
+
+// Operation of chain in low bits of user_data, file of batch in the rest
+#define PROCESS_CPU_URING_OP_OPEN 0
+#define PROCESS_CPU_URING_OP_READ 1
+#define PROCESS_CPU_URING_OP_CLOSE 2
+
+static int process_cpu_uring_enter(int fd, unsigned to_submit, unsigned min_complete)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static struct io_uring_sqe* process_cpu_uring_sqe(process_cpu_uring_t* uring, unsigned* tail, uint8_t opcode, size_t file, unsigned op)
+{
+    unsigned index = *tail & uring->sq_mask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = ((uint64_t)file << 2) | op;
+    uring->sq_array[index] = index;
+    (*tail)++;
+
+    return sqe;
+}
+
+// Fixed slot of OPENAT and CLOSE by file_index came in 5.15 with LINKAT, older kernel ignores file_index: it opens files
+// into fd table and closes fd 0, so ring is used only if it supports LINKAT as well
+static int process_cpu_uring_probe(int fd)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (!probe)
+    {
+        DEBUG_LOG("process_cpu_uring_probe: calloc failed\n");
+        return -1;
+    }
+
+    int status = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) != 0)
+    {
+        DEBUG_LOG("process_cpu_uring_probe: register of probe error: %s\n", strerror(errno));
+        status = -1;
+    }
+
+    const uint8_t ops[] = {IORING_OP_OPENAT, IORING_OP_READ_FIXED, IORING_OP_CLOSE, IORING_OP_LINKAT};
+    for (size_t i = 0; status == 0 && i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        if (ops[i] >= probe->ops_len || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+        {
+            DEBUG_LOG("process_cpu_uring_probe: opcode %u is not supported\n", ops[i]);
+            status = -1;
+        }
+    }
+    SAFE_FREE(probe);
+
+    return status;
+}
+
+process_cpu_uring_t* process_cpu_uring_create(void)
+{
+    process_cpu_uring_t* uring = (process_cpu_uring_t*)calloc(1, sizeof(process_cpu_uring_t));
+    if (!uring)
+    {
+        DEBUG_LOG("process_cpu_uring_create: calloc failed\n");
+        return NULL;
+    }
+    uring->fd = -1;
+    uring->sq_ring = MAP_FAILED;
+    uring->sqes = MAP_FAILED;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    uring->fd = (int)syscall(__NR_io_uring_setup, PROCESS_CPU_URING_BATCH * 3, &params);
+    if (uring->fd == -1)
+    {
+        DEBUG_LOG("process_cpu_uring_create: io_uring_setup error: %s\n", strerror(errno));
+        goto process_cpu_uring_create_failed;
+    }
+
+    if (process_cpu_uring_probe(uring->fd) != 0)
+    {
+        goto process_cpu_uring_create_failed;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) && uring->cq_ring_size > uring->sq_ring_size)
+    {
+        uring->sq_ring_size = uring->cq_ring_size;
+    }
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED)
+    {
+        DEBUG_LOG("process_cpu_uring_create: mmap of sq ring error: %s\n", strerror(errno));
+        goto process_cpu_uring_create_failed;
+    }
+
+    uint8_t* cq_ring = (uint8_t*)uring->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED)
+        {
+            DEBUG_LOG("process_cpu_uring_create: mmap of cq ring error: %s\n", strerror(errno));
+            uring->cq_ring = NULL;
+            goto process_cpu_uring_create_failed;
+        }
+        cq_ring = (uint8_t*)uring->cq_ring;
+    }
+
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe*)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED)
+    {
+        DEBUG_LOG("process_cpu_uring_create: mmap of sqes error: %s\n", strerror(errno));
+        goto process_cpu_uring_create_failed;
+    }
+
+    uint8_t* sq_ring = (uint8_t*)uring->sq_ring;
+    uring->sq_head = (unsigned*)(sq_ring + params.sq_off.head);
+    uring->sq_tail = (unsigned*)(sq_ring + params.sq_off.tail);
+    uring->sq_mask = *(unsigned*)(sq_ring + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned*)(sq_ring + params.sq_off.array);
+    uring->cq_head = (unsigned*)(cq_ring + params.cq_off.head);
+    uring->cq_tail = (unsigned*)(cq_ring + params.cq_off.tail);
+    uring->cq_mask = *(unsigned*)(cq_ring + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+
+    uring->buffers = calloc(PROCESS_CPU_URING_BATCH, PROCESS_CPU_URING_STAT_SIZE);
+    uring->paths = calloc(PROCESS_CPU_URING_BATCH, sizeof(*uring->paths));
+    uring->results = (int*)calloc(PROCESS_CPU_URING_BATCH, sizeof(int));
+    if (!uring->buffers || !uring->paths || !uring->results)
+    {
+        DEBUG_LOG("process_cpu_uring_create: calloc of batch failed\n");
+        goto process_cpu_uring_create_failed;
+    }
+
+    // Reads go to one registered buffer, files are opened into empty fixed slots, neither is looked up per operation
+    struct iovec buffer = {.iov_base = uring->buffers, .iov_len = PROCESS_CPU_URING_BATCH * PROCESS_CPU_URING_STAT_SIZE};
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_BUFFERS, &buffer, 1) != 0)
+    {
+        DEBUG_LOG("process_cpu_uring_create: register of buffers error: %s\n", strerror(errno));
+        goto process_cpu_uring_create_failed;
+    }
+
+    int files[PROCESS_CPU_URING_BATCH];
+    memset(files, -1, sizeof(files));
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_FILES, files, PROCESS_CPU_URING_BATCH) != 0)
+    {
+        DEBUG_LOG("process_cpu_uring_create: register of files error: %s\n", strerror(errno));
+        goto process_cpu_uring_create_failed;
+    }
+
+    // Chain is tried once on stat of this process, ring is not used if it cannot read it (seccomp, restricted ring)
+    pid_t self = getpid();
+    long long time;
+    if (process_cpu_uring_process_times(uring, &self, 1, &time) != 1)
+    {
+        DEBUG_LOG("process_cpu_uring_create: read of /proc/%d/stat failed\n", self);
+        goto process_cpu_uring_create_failed;
+    }
+
+    return uring;
+
+process_cpu_uring_create_failed:
+    process_cpu_uring_delete(uring);
+
+    return NULL;
+}
+
+void process_cpu_uring_delete(process_cpu_uring_t* uring)
+{
+    if (!uring)
+    {
+        return;
+    }
+
+    if (uring->sqes != MAP_FAILED)
+    {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+    if (uring->cq_ring)
+    {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+    if (uring->sq_ring != MAP_FAILED)
+    {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+    if (uring->fd != -1)
+    {
+        close(uring->fd);
+    }
+
+    SAFE_FREE(uring->buffers);
+    SAFE_FREE(uring->paths);
+    SAFE_FREE(uring->results);
+    SAFE_FREE(uring);
+}
+
+// Remove file from fixed slot by registration update
+static void process_cpu_uring_clear_slot(process_cpu_uring_t* uring, unsigned slot)
+{
+    int fd = -1;
+    struct io_uring_files_update update = {.offset = slot, .fds = (uint64_t)(uintptr_t)&fd};
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0)
+    {
+        DEBUG_LOG("process_cpu_uring_clear_slot: update of slot %u error: %s\n", slot, strerror(errno));
+    }
+}
+
+// Submit chains of batch files and wait for all their completions, results get bytes read or negative errno
+static int process_cpu_uring_read_batch(process_cpu_uring_t* uring, const pid_t* pids, size_t batch)
+{
+    unsigned tail = *uring->sq_tail;
+    for (size_t i = 0; i < batch; i++)
+    {
+        snprintf(uring->paths[i], sizeof(uring->paths[i]), "/proc/%d/stat", pids[i]);
+        uring->results[i] = 0;
+
+        // Failed open cancels read and close of the same chain, read is hard linked: it is short for every stat smaller
+        // than the buffer, which would break a plain link and cancel the close, leaving the file in its slot
+        struct io_uring_sqe* sqe = process_cpu_uring_sqe(uring, &tail, IORING_OP_OPENAT, i, PROCESS_CPU_URING_OP_OPEN);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)uring->paths[i];
+        sqe->open_flags = O_RDONLY;    // O_CLOEXEC is refused for fixed slot, file is never in fd table anyway
+        sqe->file_index = (uint32_t)i + 1;
+        sqe->flags = IOSQE_IO_LINK;
+
+        sqe = process_cpu_uring_sqe(uring, &tail, IORING_OP_READ_FIXED, i, PROCESS_CPU_URING_OP_READ);
+        sqe->fd = (int)i;
+        sqe->addr = (uint64_t)(uintptr_t)uring->buffers[i];
+        sqe->len = PROCESS_CPU_URING_STAT_SIZE - 1;
+        sqe->buf_index = 0;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+        sqe = process_cpu_uring_sqe(uring, &tail, IORING_OP_CLOSE, i, PROCESS_CPU_URING_OP_CLOSE);
+        sqe->file_index = (uint32_t)i + 1;
+    }
+    __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    unsigned submitted = (unsigned)batch * 3;
+    unsigned completed = 0;
+    unsigned to_submit = submitted;
+    while (completed < submitted)
+    {
+        int ret = process_cpu_uring_enter(uring->fd, to_submit, submitted - completed);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            DEBUG_LOG("process_cpu_uring_read_batch: io_uring_enter error: %s\n", strerror(errno));
+            uring->failed = 1;
+            return -1;
+        }
+        to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+
+        unsigned head = *uring->cq_head;
+        unsigned cq_tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++, completed++)
+        {
+            struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+            int* result = &uring->results[cqe->user_data >> 2];
+            if ((cqe->user_data & 3) == PROCESS_CPU_URING_OP_OPEN && cqe->res < 0)
+            {
+                *result = cqe->res;
+            }
+            else if ((cqe->user_data & 3) == PROCESS_CPU_URING_OP_READ && (cqe->res != -ECANCELED || *result == 0))
+            {
+                // Read cancelled by failed open keeps error of open
+                *result = cqe->res;
+            }
+            else if ((cqe->user_data & 3) == PROCESS_CPU_URING_OP_CLOSE && cqe->res < 0 && cqe->res != -ECANCELED)
+            {
+                // Close is cancelled only with failed open, other error leaves file in slot
+                DEBUG_LOG("process_cpu_uring_read_batch: close of slot %llu error: %s\n", (unsigned long long)(cqe->user_data >> 2), strerror(-cqe->res));
+                process_cpu_uring_clear_slot(uring, (unsigned)(cqe->user_data >> 2));
+            }
+        }
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // Pid that is gone fails with ENOENT or ESRCH, if every file fails otherwise the ring does not work here
+    size_t errors = 0;
+    for (size_t i = 0; i < batch; i++)
+    {
+        errors += uring->results[i] < 0 && uring->results[i] != -ENOENT && uring->results[i] != -ESRCH;
+    }
+    if (errors == batch)
+    {
+        DEBUG_LOG("process_cpu_uring_read_batch: every read failed: %s\n", strerror(-uring->results[0]));
+        uring->failed = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+size_t process_cpu_uring_process_times(process_cpu_uring_t* uring, const pid_t* pids, size_t count, long long* times)
+{
+    if (!uring || !pids || !times)
+    {
+        DEBUG_LOG("process_cpu_uring_process_times: uring, pids or times is NULL\n");
+        return 0;
+    }
+
+    size_t found = 0;
+    for (size_t done = 0; done < count; done += PROCESS_CPU_URING_BATCH)
+    {
+        size_t batch = count - done < PROCESS_CPU_URING_BATCH ? count - done : PROCESS_CPU_URING_BATCH;
+        int status = uring->failed ? -1 : process_cpu_uring_read_batch(uring, pids + done, batch);
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            times[done + i] = -1;
+            if (status == 0 && uring->results[i] > 0)
+            {
+                uring->buffers[i][uring->results[i]] = '\0';
+                times[done + i] = process_cpu_parse_process_time(uring->buffers[i]);
+            }
+            found += times[done + i] != -1;
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,47 @@
+#ifndef PROCESS_CPU_URING_H
+#define PROCESS_CPU_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Batched reads of /proc/<pid>/stat with io_uring: every file is openat, read and close linked in one chain (close is hard linked to read),
+// file goes to a registered (fixed) file slot and is read into a registered buffer, so a batch is one io_uring_enter
+// Ring is private to process that created it, after fork the child may only delete its copy (unmap and close, kernel ring stays with parent)
+#define PROCESS_CPU_URING_BATCH 128       // files per io_uring_enter, ring has 3 entries per file
+#define PROCESS_CPU_URING_STAT_SIZE 256   // read of /proc/<pid>/stat, utime and stime are in the first fields
+
+typedef struct process_cpu_uring
+{
+    int fd;
+    unsigned sq_mask;
+    unsigned cq_mask;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;    // NULL if it is in sq_ring mapping (IORING_FEAT_SINGLE_MMAP)
+    size_t cq_ring_size;
+    size_t sqes_size;
+    char (*buffers)[PROCESS_CPU_URING_STAT_SIZE];    // registered buffer, one stat per file of batch
+    char (*paths)[32];
+    int* results;    // bytes read by file of batch, negative errno
+    int failed;      // io_uring_enter failed or every read of batch failed not by missing pid, ring must not be used
+} process_cpu_uring_t;
+
+// Set up ring with registered buffers and file slots, NULL if kernel has no io_uring, it is disabled, lacks fixed slots of OPENAT
+// and CLOSE (5.15) or the chain cannot read /proc/self/stat
+process_cpu_uring_t* process_cpu_uring_create(void);
+
+void process_cpu_uring_delete(process_cpu_uring_t* uring);
+
+// Read /proc/<pid>/stat of count pids and parse utime + stime into times (-1 if pid is not found), returns count of found pids
+// If a batch fails, failed is set and the rest of times are -1
+size_t process_cpu_uring_process_times(process_cpu_uring_t* uring, const pid_t* pids, size_t count, long long* times);
+
+#endif    // PROCESS_CPU_URING_H
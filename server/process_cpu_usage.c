@@ -2,26 +2,30 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "process_cpu_uring.h"
 #include "utility.h"
 
-static long long get_total_time()
+long long process_cpu_total_time(void)
 {
     FILE* file = fopen("/proc/stat", "r");
     if (!file)
     {
-        DEBUG_LOG("get_total_time: Error open /proc/stat: %s\n", strerror(errno));
+        DEBUG_LOG("process_cpu_total_time: Error open /proc/stat: %s\n", strerror(errno));
         return -1;
     }
 
     char buffer[128];
     if (fgets(buffer, sizeof(buffer), file) == NULL)
     {
-        DEBUG_LOG("get_total_time: Error read из /proc/stat: %s\n", strerror(errno));
+        DEBUG_LOG("process_cpu_total_time: Error read из /proc/stat: %s\n", strerror(errno));
         fclose(file);
         return -1;
     }
@@ -30,14 +34,14 @@ static long long get_total_time()
     long long user, nice, system, idle, iowait, irq, softirq, steal;
     if (sscanf(buffer, "cpu  %lld %lld %lld %lld %lld %lld %lld %lld", &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) != 8)
     {
-        DEBUG_LOG("get_total_time: Error parsing /proc/stat\n");
+        DEBUG_LOG("process_cpu_total_time: Error parsing /proc/stat\n");
         return -1;
     }
 
     return user + nice + system + idle + iowait + irq + softirq + steal;
 }
 
-static long long get_process_time(int pid)
+long long process_cpu_process_time(pid_t pid)
 {
     char path[64];
     snprintf(path, sizeof(path), "/proc/%d/stat", pid);
@@ -45,42 +49,192 @@ static long long get_process_time(int pid)
     FILE* file = fopen(path, "r");
     if (!file)
     {
-        DEBUG_LOG("get_process_time: Error open %s: %s\n", path, strerror(errno));
+        DEBUG_LOG("process_cpu_process_time: Error open %s: %s\n", path, strerror(errno));
         return -1;
     }
 
-    char buffer[256];
+    char buffer[PROCESS_CPU_URING_STAT_SIZE];
     if (fgets(buffer, sizeof(buffer), file) == NULL)
     {
-        DEBUG_LOG("get_process_time: Error read %s: %s\n", path, strerror(errno));
+        DEBUG_LOG("process_cpu_process_time: Error read %s: %s\n", path, strerror(errno));
         fclose(file);
         return -1;
     }
     fclose(file);
 
+    long long process_time = process_cpu_parse_process_time(buffer);
+    if (process_time == -1)
+    {
+        DEBUG_LOG("process_cpu_process_time: Error parse %s\n", path);
+    }
+
+    return process_time;
+}
+
+long long process_cpu_parse_process_time(const char* stat)
+{
     long long utime, stime;
     unsigned long long dummy;
-    if (sscanf(buffer, "%llu %*s %*c %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %lld %lld", &dummy, &utime, &stime) != 3)
+    if (sscanf(stat, "%llu %*s %*c %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %*llu %lld %lld", &dummy, &utime, &stime) != 3)
     {
-        DEBUG_LOG("get_process_time: Error parse %s\n", path);
         return -1;
     }
 
     return utime + stime;
 }
 
+// Ring of this process, it is created by first batch, child of fork deletes the copy of parent ring and creates its own
+static process_cpu_uring_t* process_cpu_uring;
+static pid_t process_cpu_uring_owner;
+
+size_t process_cpu_process_times(const pid_t* pids, size_t count, long long* times)
+{
+    if (process_cpu_uring_owner != getpid())
+    {
+        process_cpu_uring_delete(process_cpu_uring);
+        process_cpu_uring_owner = getpid();
+        process_cpu_uring = PROCESS_CPU_URING ? process_cpu_uring_create() : NULL;
+    }
+
+    if (process_cpu_uring && !process_cpu_uring->failed)
+    {
+        size_t found = process_cpu_uring_process_times(process_cpu_uring, pids, count, times);
+        if (!process_cpu_uring->failed)
+        {
+            return found;
+        }
+
+        process_cpu_uring_delete(process_cpu_uring);
+        process_cpu_uring = NULL;
+    }
+
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        times[i] = process_cpu_process_time(pids[i]);
+        found += times[i] != -1;
+    }
+
+    return found;
+}
+
+long long process_cpu_schedstat_time(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+
+    // /proc/<pid>/schedstat is the time of the main thread only, every thread has its own in task/<tid>/schedstat
+    DIR* tasks = opendir(path);
+    if (!tasks)
+    {
+        DEBUG_LOG("process_cpu_schedstat_time: Error open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    long long run_ns = -1;
+    struct dirent* task;
+    while ((task = readdir(tasks)) != NULL)
+    {
+        if (task->d_name[0] < '0' || task->d_name[0] > '9')
+        {
+            continue;
+        }
+
+        // Thread may exit meanwhile, it is skipped
+        char task_path[NAME_MAX + 16];
+        snprintf(task_path, sizeof(task_path), "%s/schedstat", task->d_name);
+        int fd = openat(dirfd(tasks), task_path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            continue;
+        }
+
+        char buffer[96];
+        ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (length <= 0)
+        {
+            continue;
+        }
+        buffer[length] = '\0';
+
+        char* end = NULL;
+        long long task_ns = strtoll(buffer, &end, 10);
+        if (end == buffer)
+        {
+            DEBUG_LOG("process_cpu_schedstat_time: Error parse %s/%s\n", path, task_path);
+            continue;
+        }
+        run_ns = (run_ns == -1 ? 0 : run_ns) + task_ns;
+    }
+    closedir(tasks);
+
+    return run_ns;
+}
+
+long long process_cpu_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+double process_cpu_ns_usage(long long process_ns, long long elapsed_ns)
+{
+    static long cpus = 0;
+    if (cpus <= 0)
+    {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpus = cpus > 0 ? cpus : 1;
+    }
+
+    // Time of threads which exit during the window is no longer in the sum, so it may go back
+    if (elapsed_ns <= 0 || process_ns <= 0)
+    {
+        return 0.0;
+    }
+
+    return (100.0 * (double)process_ns) / ((double)elapsed_ns * (double)cpus);
+}
+
+double get_process_cpu_usage_backend(pid_t pid, process_cpu_backend_t backend)
+{
+    if (backend != PROCESS_CPU_BACKEND_SCHEDSTAT)
+    {
+        return get_process_cpu_usage(pid);
+    }
+
+    long long start_time = process_cpu_monotonic_ns();
+    long long start_proc = process_cpu_schedstat_time(pid);
+    if (start_proc == -1)
+    {
+        return get_process_cpu_usage(pid);
+    }
+
+    usleep(PROCESS_CPU_SCHEDSTAT_WINDOW_US);
+
+    long long end_proc = process_cpu_schedstat_time(pid);
+    long long end_time = process_cpu_monotonic_ns();
+    if (end_proc == -1)
+    {
+        return -1.0;
+    }
+
+    return process_cpu_ns_usage(end_proc - start_proc, end_time - start_time);
+}
+
 double get_process_cpu_usage(pid_t pid)
 {
-    long long start_total = get_total_time();
-    long long start_proc = get_process_time(pid);
+    long long start_total = process_cpu_total_time();
+    long long start_proc = process_cpu_process_time(pid);
 
     if (start_total == -1 || start_proc == -1)
         return -1.0;
 
     usleep(20000);    // 0.02s
 
-    long long end_total = get_total_time();
-    long long end_proc = get_process_time(pid);
+    long long end_total = process_cpu_total_time();
+    long long end_proc = process_cpu_process_time(pid);
 
     if (end_total == -1 || end_proc == -1)
         return -1.0;
@@ -3,6 +3,60 @@
 
 #include <sys/types.h>
 
+#define PROCESS_CPU_SCHEDSTAT_WINDOW_US 2000    // window of get_process_cpu_usage_backend with schedstat
+#define PROCESS_CPU_URING 1                     // read batches of process_cpu_process_times with io_uring if kernel has it
+
+// Source of process cpu time:
+//   ticks      utime + stime from /proc/<pid>/stat against total time of /proc/stat, both in clock ticks (usually 10 ms)
+//   schedstat  on-cpu time of all threads from /proc/<pid>/task/*/schedstat in ns against CLOCK_MONOTONIC time of all cpus, usable with windows of 1-2 ms
+//   taskstats  ac_utime + ac_stime from TASKSTATS netlink in us against CLOCK_MONOTONIC time of all cpus (engine only, see process_cpu_taskstats.h)
+typedef enum process_cpu_backend
+{
+    PROCESS_CPU_BACKEND_TICKS = 0,
+    PROCESS_CPU_BACKEND_SCHEDSTAT,
+    PROCESS_CPU_BACKEND_TASKSTATS,
+    PROCESS_CPU_BACKEND_COUNT
+} process_cpu_backend_t;
+
+typedef enum process_cpu_status
+{
+    PROCESS_CPU_STATUS_SUCCESS = 0,
+    PROCESS_CPU_STATUS_ERROR_PARAMS_NULL,
+    PROCESS_CPU_STATUS_ERROR_NOT_FOUND,    // process does not exist
+    PROCESS_CPU_STATUS_ERROR_FULL,         // capacity of measurements in flight is reached
+    PROCESS_CPU_STATUS_ERROR_READ,         // /proc/stat is not readable
+    PROCESS_CPU_STATUS_ERROR_TIMER,
+    PROCESS_CPU_STATUS_ERROR_NO_SAMPLE     // there is no previous sample of process
+} process_cpu_status_t;
+
+// Cpu usage of process in percent over 20 ms window, -1.0 if process is not found (blocks for the window)
 double get_process_cpu_usage(pid_t pid);
 
+// Same as get_process_cpu_usage with backend, schedstat falls back to ticks if /proc/<pid>/schedstat is not readable, taskstats is measured with ticks
+double get_process_cpu_usage_backend(pid_t pid, process_cpu_backend_t backend);
+
+// Sum of cpu times of all cpus from /proc/stat in clock ticks, -1 on error
+long long process_cpu_total_time(void);
+
+// User and system time of process from /proc/<pid>/stat in clock ticks, -1 if process is not found
+long long process_cpu_process_time(pid_t pid);
+
+// User and system time from contents of /proc/<pid>/stat in clock ticks, -1 if it is malformed
+long long process_cpu_parse_process_time(const char* stat);
+
+// process_cpu_process_time of count pids into times (-1 for pid which is not found), returns count of found pids
+// Batch is read with io_uring (see process_cpu_uring.h): a few syscalls for hundreds of pids instead of open, read and close of each
+// Without io_uring the files are read one by one
+size_t process_cpu_process_times(const pid_t* pids, size_t count, long long* times);
+
+// On-cpu time of all threads of process (sum of /proc/<pid>/task/<tid>/schedstat) in ns, -1 if process is not found or kernel has no schedstat
+// Threads which exit are no longer counted, so the time may go back
+long long process_cpu_schedstat_time(pid_t pid);
+
+// CLOCK_MONOTONIC time in ns
+long long process_cpu_monotonic_ns(void);
+
+// Usage in percent of all online cpus for cpu time in ns over elapsed ns (the same scale as ticks backend)
+double process_cpu_ns_usage(long long process_ns, long long elapsed_ns);
+
 #endif    // PROCESS_CPU_USAGE_H
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,7 +13,11 @@
 #include "config.h"
 #include "journal.h"
 #include "journal_transfer.h"
+#include "process_cpu_cache.h"
+#include "process_cpu_engine.h"
+#include "process_cpu_samples.h"
 #include "process_cpu_usage.h"
+#include "server_stats.h"
 #include "server_worker.h"
 
 #include "safe_process.h"
@@ -31,6 +36,13 @@ typedef struct server_state
 } server_state_t;
 
 static journal_t* journal;
+static server_worker_t* server_worker;         // worker of this process, replies deferred messages
+static process_cpu_engine_t* cpu_engine;       // NULL if engine is not created
+static process_cpu_samples_t* cpu_samples;     // last sample of each pid for delta requests
+static process_cpu_cache_t* cpu_cache;         // recent results for requests with staleness bound, shared by workers
+static server_stats_t* server_stats;           // counters of all workers, shared with main process
+static server_stats_worker_t* worker_stats;    // counters of this worker process
+static process_cpu_backend_t cpu_backend = PROCESS_CPU_BACKEND_TICKS;    // backend of requests without MESSAGE_FLAG_SCHEDSTAT
 
 void message_set_data(message_t* message, const char* data)
 {
@@ -56,6 +68,156 @@ void message_set_data(message_t* message, const char* data)
     message->header.length = strlen(data) + 1;
 }
 
+// Journal measurement of pid and set it as reply, cpu_usage < 0 if process is not found
+// Reply of delta request and of measurement (window_ms > 0) has window after cpu usage, result from cache has none
+static void worker_reply_cpu_usage(message_t* message, pid_t pid, double cpu_usage, int64_t window_ms)
+{
+    char buffer[256];
+    time_t now = time(NULL);
+    struct tm* tm_info = localtime(&now);
+
+    char time_str[64];
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    journal_entry_t entry = {.pid = pid, .status = JOURNAL_RECORD_STATUS_NOT_FOUND, .cpu = 0.0, .channel = JOURNAL_CHANNEL_RESULTS};
+
+    if (cpu_usage < 0)
+    {
+        if (snprintf(buffer, sizeof(buffer), "%s: %d not found\n", time_str, pid) < 0)
+        {
+            perror("Failed to scnprintf process cpu usage");
+            return;
+        }
+
+        journal_write_entry(journal, &entry, buffer, strlen(buffer) + 1);
+        message_set_data(message, SERVER_RESPONSE_CPU_NOT_FOUND);
+    }
+    else
+    {
+        if (snprintf(buffer, sizeof(buffer), "%s%s%d%s%f\n", time_str, ": ", pid, " %", cpu_usage) < 0)
+        {
+            perror("Failed to scnprintf process cpu usage");
+            return;
+        }
+        printf("Write: %s", buffer);
+        entry.status = JOURNAL_RECORD_STATUS_OK;
+        entry.cpu = cpu_usage;
+        journal_write_entry(journal, &entry, buffer, strlen(buffer) + 1);
+
+        int length = message->header.type == MESSAGE_TYPE_PID_DELTA || window_ms > 0 ? snprintf(buffer, sizeof(buffer), "%f %lld", cpu_usage, (long long)window_ms)
+                                                                    : snprintf(buffer, sizeof(buffer), "%f", cpu_usage);
+        if (length < 0)
+        {
+            perror("Failed to scnprintf process cpu usage");
+            return;
+        }
+
+        message_set_data(message, buffer);
+    }
+}
+
+static process_cpu_backend_t worker_cpu_backend(const message_t* message)
+{
+    return (message->header.flags & MESSAGE_FLAG_SCHEDSTAT) ? PROCESS_CPU_BACKEND_SCHEDSTAT : cpu_backend;
+}
+
+// Taskstats is used for requests without flags if the host has it and its sample is cheaper than procfs
+static process_cpu_backend_t worker_choose_cpu_backend(process_cpu_engine_t* engine)
+{
+    if (!SERVER_CPU_TASKSTATS || !engine)
+    {
+        return PROCESS_CPU_BACKEND_TICKS;
+    }
+
+    long long procfs_ns = process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TICKS, getpid(), SERVER_CPU_BACKEND_PROBE_SAMPLES);
+    long long taskstats_ns = process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TASKSTATS, getpid(), SERVER_CPU_BACKEND_PROBE_SAMPLES);
+    printf("Cpu time sample cost (PID %d): procfs %lld ns, taskstats %lld ns\n", getpid(), procfs_ns, taskstats_ns);
+
+    return taskstats_ns != -1 && taskstats_ns < procfs_ns ? PROCESS_CPU_BACKEND_TASKSTATS : PROCESS_CPU_BACKEND_TICKS;
+}
+
+// Measure pid in place, without engine
+static double worker_measure_cpu(const message_t* message, pid_t pid, int64_t* window_ms)
+{
+    process_cpu_backend_t backend = worker_cpu_backend(message);
+    *window_ms = backend == PROCESS_CPU_BACKEND_SCHEDSTAT ? PROCESS_CPU_SCHEDSTAT_WINDOW_US / 1000 : SERVER_CPU_WINDOW_MS;
+
+    return get_process_cpu_usage_backend(pid, backend);
+}
+
+// Reply with new measurement over window_ms and keep it for requests with staleness bound, pid which is not found is kept as missing
+static void worker_reply_cpu_measured(message_t* message, pid_t pid, double cpu_usage, int64_t window_ms)
+{
+    process_cpu_cache_put(cpu_cache, pid, cpu_usage);
+    worker_reply_cpu_usage(message, pid, cpu_usage, window_ms);
+}
+
+// Reply "not found" to request for pid which was not found shortly before, without reading /proc
+static int worker_reply_cpu_missing(message_t* message, pid_t pid)
+{
+    if (!process_cpu_cache_missing(cpu_cache, pid, SERVER_CPU_MISSING_TTL_MS))
+    {
+        return 0;
+    }
+
+    if (worker_stats)
+    {
+        server_stats_increment(&worker_stats->missing);
+    }
+    worker_reply_cpu_usage(message, pid, -1.0, 0);
+
+    return 1;
+}
+
+// Reply to delta request from previous sample of pid, returns 0 if there is no sample and pid must be measured over window
+static int worker_reply_cpu_delta(message_t* message, pid_t pid)
+{
+    if (message->header.type != MESSAGE_TYPE_PID_DELTA)
+    {
+        return 0;
+    }
+
+    double cpu_usage = 0.0;
+    int64_t window_ms = 0;
+    process_cpu_status_t status = process_cpu_samples_delta(cpu_samples, pid, &cpu_usage, &window_ms);
+    if (status == PROCESS_CPU_STATUS_SUCCESS)
+    {
+        worker_reply_cpu_usage(message, pid, cpu_usage, window_ms);
+        return 1;
+    }
+
+    if (status == PROCESS_CPU_STATUS_ERROR_NOT_FOUND)
+    {
+        worker_reply_cpu_measured(message, pid, -1.0, 0);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Reply to request with staleness bound from result cache, returns 0 if there is no fresh result
+static int worker_reply_cpu_cached(message_t* message, pid_t pid)
+{
+    if (message->header.type != MESSAGE_TYPE_PID || message->header.max_staleness_ms == 0)
+    {
+        return 0;
+    }
+
+    double cpu_usage = 0.0;
+    int hit = process_cpu_cache_get(cpu_cache, pid, message->header.max_staleness_ms, &cpu_usage);
+    if (worker_stats)
+    {
+        server_stats_increment(hit ? &worker_stats->cache_hits : &worker_stats->cache_misses);
+    }
+
+    if (hit)
+    {
+        worker_reply_cpu_usage(message, pid, cpu_usage, 0);
+    }
+
+    return hit;
+}
+
 void worker_on_message(message_t* message)
 {
     char buffer[256];
@@ -74,48 +236,69 @@ void worker_on_message(message_t* message)
             perror("Failed to scnprintf cpu invalid");
             return;
         }
-        journal_write(journal, buffer, strlen(buffer) + 1);
+        journal_entry_t entry = {.pid = JOURNAL_PID_NONE, .status = JOURNAL_RECORD_STATUS_INVALID, .cpu = 0.0, .channel = JOURNAL_CHANNEL_ERRORS};
+        journal_write_entry(journal, &entry, buffer, strlen(buffer) + 1);
         message_set_data(message, SERVER_RESPONSE_CPU_INVALID);
     }
-    else if (message->header.type == MESSAGE_TYPE_PID)
+    else if (message->header.type == MESSAGE_TYPE_PID || message->header.type == MESSAGE_TYPE_PID_DELTA)
     {
         pid_t pid = *((int*)message->data);
         printf("New message: type:%d, pid: %d\n", message->header.type, pid);
 
-        double proc_cpu_usage = get_process_cpu_usage(pid);
-
-        if (proc_cpu_usage < 0)
-        {
-            if (snprintf(buffer, sizeof(buffer), "%s: %d not found\n", time_str, pid) < 0)
-            {
-                perror("Failed to scnprintf process cpu usage");
-                return;
-            }
-
-            journal_write(journal, buffer, strlen(buffer) + 1);
-            message_set_data(message, SERVER_RESPONSE_CPU_NOT_FOUND);
-        }
-        else
+        if (!worker_reply_cpu_missing(message, pid) && !worker_reply_cpu_delta(message, pid) && !worker_reply_cpu_cached(message, pid))
         {
-            if (snprintf(buffer, sizeof(buffer), "%s%s%d%s%f\n", time_str, ": ", pid, " %", proc_cpu_usage) < 0)
-            {
-                perror("Failed to scnprintf process cpu usage");
-                return;
-            }
-            printf("Write: %s", buffer);
-            journal_write(journal, buffer, strlen(buffer) + 1);
-
-            if (snprintf(buffer, sizeof(buffer), "%f", proc_cpu_usage) < 0)
-            {
-                perror("Failed to scnprintf process cpu usage");
-                return;
-            }
-
-            message_set_data(message, buffer);
+            int64_t window_ms = 0;
+            double cpu_usage = worker_measure_cpu(message, pid, &window_ms);
+            worker_reply_cpu_measured(message, pid, cpu_usage, window_ms);
         }
     }
 }
 
+static void worker_on_cpu_measured(void* context, pid_t pid, double cpu_usage, unsigned window_ms)
+{
+    message_t* message = (message_t*)context;
+
+    worker_reply_cpu_measured(message, pid, cpu_usage, window_ms);
+    server_worker_send_message(server_worker, message);
+}
+
+// Measurement of pid is started in cpu engine and replied when its window ends, worker does not block in it
+int worker_on_message_deferred(message_t* message)
+{
+    if ((message->header.type != MESSAGE_TYPE_PID && message->header.type != MESSAGE_TYPE_PID_DELTA) || !cpu_engine)
+    {
+        worker_on_message(message);
+        return 0;
+    }
+
+    pid_t pid = *((int*)message->data);
+    printf("New message: type:%d, pid: %d\n", message->header.type, pid);
+
+    // Missing pid, delta and fresh enough cached result are answered at once, first request of pid is measured over window
+    if (worker_reply_cpu_missing(message, pid) || worker_reply_cpu_delta(message, pid) || worker_reply_cpu_cached(message, pid))
+    {
+        return 0;
+    }
+
+    process_cpu_status_t status = process_cpu_engine_start_backend(cpu_engine, pid, worker_cpu_backend(message), worker_on_cpu_measured, message);
+    if (status == PROCESS_CPU_STATUS_SUCCESS)
+    {
+        return 1;
+    }
+
+    if (status == PROCESS_CPU_STATUS_ERROR_NOT_FOUND)
+    {
+        worker_reply_cpu_measured(message, pid, -1.0, 0);
+        return 0;
+    }
+
+    // Engine is full, measure in place
+    int64_t window_ms = 0;
+    double cpu_usage = worker_measure_cpu(message, pid, &window_ms);
+    worker_reply_cpu_measured(message, pid, cpu_usage, window_ms);
+    return 0;
+}
+
 void worker_process_job(void* args, safe_process_t sp)
 {
     server_state_t* server_state = (server_state_t*)args;
@@ -129,7 +312,37 @@ void worker_process_job(void* args, safe_process_t sp)
         exit(EXIT_FAILURE);
     }
 
+    server_worker = worker;
+    cpu_engine = process_cpu_engine_create(SERVER_CPU_WINDOW_MS, SERVER_CPU_ENGINE_CAPACITY);
+    if (!cpu_engine)
+    {
+        DEBUG_LOG("process_cpu_engine_create failed, requests are measured one by one\n");
+    }
+    else
+    {
+        // Requests without flags go to taskstats or procfs ticks, both with adaptive window; schedstat keeps its short fixed window
+        process_cpu_engine_set_window(cpu_engine, PROCESS_CPU_BACKEND_SCHEDSTAT, SERVER_CPU_SCHEDSTAT_WINDOW_MS);
+        cpu_backend = worker_choose_cpu_backend(cpu_engine);
+        if (SERVER_CPU_ACCURACY_PERCENT > 0)
+        {
+            process_cpu_engine_set_window(cpu_engine, PROCESS_CPU_BACKEND_TICKS, SERVER_CPU_MIN_WINDOW_MS);
+            process_cpu_engine_set_window(cpu_engine, PROCESS_CPU_BACKEND_TASKSTATS, SERVER_CPU_MIN_WINDOW_MS);
+            process_cpu_engine_set_accuracy(cpu_engine, SERVER_CPU_MAX_WINDOW_MS, SERVER_CPU_ACCURACY_PERCENT);
+        }
+        printf("Cpu backend of requests without flags: %s, window %d..%d ms\n", cpu_backend == PROCESS_CPU_BACKEND_TASKSTATS ? "taskstats" : "procfs",
+               SERVER_CPU_ACCURACY_PERCENT > 0 ? SERVER_CPU_MIN_WINDOW_MS : SERVER_CPU_WINDOW_MS, SERVER_CPU_ACCURACY_PERCENT > 0 ? SERVER_CPU_MAX_WINDOW_MS : SERVER_CPU_WINDOW_MS);
+    }
+
+    cpu_samples = process_cpu_samples_create(SERVER_CPU_SAMPLES_CAPACITY);
+    if (!cpu_samples)
+    {
+        DEBUG_LOG("process_cpu_samples_create failed, delta requests are measured over window\n");
+    }
+
+    worker_stats = server_stats_worker(server_stats, (size_t)(server_state->base_server_port - SERVER_BASE_PORT));
+
     server_worker_set_on_message(worker, worker_on_message);
+    server_worker_set_on_message_deferred(worker, worker_on_message_deferred);
 
     if (server_worker_start(worker) != SERVER_WORKER_STATUS_SUCCESS)
     {
@@ -140,8 +353,20 @@ void worker_process_job(void* args, safe_process_t sp)
     while (true)
     {
         safe_process_check_status(sp, worker);
-        server_worker_update(worker, 100);
-        sleep(1);
+        server_worker_poll(worker, SERVER_MESSAGES_PER_POLL);
+        if (cpu_engine && worker_stats)
+        {
+            server_stats_set(&worker_stats->coalesced, cpu_engine->coalesced);
+        }
+
+        if (cpu_engine)
+        {
+            process_cpu_engine_wait(cpu_engine, SERVER_CPU_ENGINE_IDLE_MS);
+        }
+        else
+        {
+            usleep(SERVER_CPU_ENGINE_IDLE_MS * 1000);
+        }
     }
 }
 
@@ -149,6 +374,11 @@ void worker_process_clear(void* args)
 {
     server_worker_t* worker = (server_worker_t*)args;
     server_worker_delete(worker);
+
+    process_cpu_engine_delete(cpu_engine);
+    cpu_engine = NULL;
+    process_cpu_samples_delete(cpu_samples);
+    cpu_samples = NULL;
 }
 
 void* sp_check_status_loop(void* arg)
@@ -161,6 +391,11 @@ void* sp_check_status_loop(void* arg)
     }
 }
 
+static char* server_stats_text(size_t* length)
+{
+    return server_stats_to_string(server_stats, length);
+}
+
 void* journal_receiver_job(void* data)
 {
     server_state_t* server = (server_state_t*)data;
@@ -173,23 +408,126 @@ void* journal_receiver_job(void* data)
     DEBUG_LOG("journal_transfer_run_receiver failed in journal_receiver\n");
 }
 
+// Parse size like "1048576", "512M" or "16G"; returns 0 on error
+static size_t parse_journal_size(const char* str)
+{
+    char* end = NULL;
+    errno = 0;
+    unsigned long long size = strtoull(str, &end, 10);
+    if (errno != 0 || end == str)
+    {
+        return 0;
+    }
+
+    int shift = 0;
+    switch (*end)
+    {
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        case '\0':
+            break;
+        default:
+            return 0;
+    }
+
+    if (shift && *(end + 1) != '\0')
+    {
+        return 0;
+    }
+
+    if (size > (SIZE_MAX >> shift))
+    {
+        return 0;
+    }
+
+    return (size_t)size << shift;
+}
+
 // "Usage: %s <server_addr> <count_ports> <base_port> <max_journal_size> <unix_socket>\n"
 int main(int argc, char* argv[])
 {
-    ssize_t journal_size = SERVER_MAX_JOURNAL_SIZE;
-    journal = journal_create(journal_size);
+    size_t journal_size = SERVER_MAX_JOURNAL_SIZE;
+    if (argc > 4)
+    {
+        journal_size = parse_journal_size(argv[4]);
+        if (journal_size == 0)
+        {
+            fprintf(stderr, "Invalid max_journal_size: %s\n", argv[4]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    journal = journal_create_with_options(journal_size, SERVER_JOURNAL_OPTIONS);
     if (!journal)
     {
         DEBUG_LOG("Journal create failed. Exiting.\n");
         return EXIT_FAILURE;
     }
 
+    printf("Journal reserved: %zu bytes\n", journal->max_size);
+
+    if (journal_set_sample_rate(journal, SERVER_JOURNAL_SAMPLE_RATE) != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("Journal sample rate is not set, every request is journaled\n");
+    }
+
+    if (journal_set_fold_window(journal, SERVER_JOURNAL_FOLD_WINDOW_MS) != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("Journal fold window is not set, repeated requests are not folded\n");
+    }
+
+    // Invalid requests and server messages can not take space of measurements
+    if (journal_channel_set_quota(journal, JOURNAL_CHANNEL_ERRORS, journal->max_size / 100 * SERVER_JOURNAL_ERRORS_QUOTA_PERCENT, JOURNAL_OVERFLOW_DROP)
+            != JOURNAL_STATUS_SUCCESS
+        || journal_channel_set_quota(journal, JOURNAL_CHANNEL_SYSTEM, journal->max_size / 100 * SERVER_JOURNAL_SYSTEM_QUOTA_PERCENT, JOURNAL_OVERFLOW_REJECT)
+               != JOURNAL_STATUS_SUCCESS)
+    {
+        DEBUG_LOG("Journal channel quotas are not set\n");
+    }
+
+    char requested_options[64], journal_options[64];
+    printf("Journal options requested: %s, in effect: %s\n", journal_options_to_string(SERVER_JOURNAL_OPTIONS, requested_options, sizeof(requested_options)),
+        journal_options_to_string(journal->options, journal_options, sizeof(journal_options)));
+
+    // Workers are forked after it, so they share results of measurements
+    cpu_cache = process_cpu_cache_create(SERVER_CPU_CACHE_CAPACITY);
+    if (!cpu_cache)
+    {
+        DEBUG_LOG("process_cpu_cache_create failed, every request is measured\n");
+    }
+
+    // and counters with receiver of "STATS" requests
+    server_stats = server_stats_create(SERVER_NUM_WORKERS);
+    if (server_stats)
+    {
+        journal_transfer_set_stats(server_stats_text);
+    }
+    else
+    {
+        DEBUG_LOG("Server stats are not created, they are not exported\n");
+    }
+
     // Test write
     journal_write(journal, "Hello from server journal\n", strlen("Hello from server journal\n"));
 
     server_state_t server_state = {
         .num_workers = SERVER_NUM_WORKERS, .base_server_port = SERVER_BASE_PORT, .server_addr = SERVER_ADDR, .unix_socket_path = SERVER_UNIX_SOCKET_PATH, .journal = journal};
 
+    if (argc > 5)
+    {
+        server_state.unix_socket_path = argv[5];
+    }
+
     for (int i = 0; i < SERVER_NUM_WORKERS; i++)
     {
         server_state.base_server_port = SERVER_BASE_PORT + i;
@@ -205,6 +543,8 @@ int main(int argc, char* argv[])
 
     wait(NULL);
 
+    server_stats_delete(server_stats);
+    process_cpu_cache_delete(cpu_cache);
     journal_delete(journal);
 
     return EXIT_SUCCESS;
@@ -0,0 +1,89 @@
+#include "server_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "utility.h"
+
+#define SERVER_STATS_LINE_SIZE 128
+
+server_stats_t* server_stats_create(size_t workers)
+{
+    if (workers == 0 || workers > SERVER_STATS_MAX_WORKERS)
+    {
+        DEBUG_LOG("server_stats_create: %zu workers, at most %d are supported\n", workers, SERVER_STATS_MAX_WORKERS);
+        return NULL;
+    }
+
+    server_stats_t* stats = (server_stats_t*)mmap(NULL, sizeof(server_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+    {
+        DEBUG_LOG("server_stats_create: mmap failed\n");
+        return NULL;
+    }
+
+    // Anonymous mapping is zeroed
+    stats->workers = workers;
+
+    return stats;
+}
+
+void server_stats_delete(server_stats_t* stats)
+{
+    if (stats)
+    {
+        munmap(stats, sizeof(server_stats_t));
+    }
+}
+
+server_stats_worker_t* server_stats_worker(server_stats_t* stats, size_t index)
+{
+    if (!stats || index >= stats->workers)
+    {
+        return NULL;
+    }
+
+    return &stats->worker[index];
+}
+
+char* server_stats_to_string(const server_stats_t* stats, size_t* length)
+{
+    if (!stats || !length)
+    {
+        DEBUG_LOG("server_stats_to_string: stats or length is NULL\n");
+        return NULL;
+    }
+
+    size_t capacity = (stats->workers + 2) * SERVER_STATS_LINE_SIZE;
+    char* text = (char*)malloc(capacity);
+    if (!text)
+    {
+        DEBUG_LOG("server_stats_to_string: malloc failed\n");
+        return NULL;
+    }
+
+    size_t used = (size_t)snprintf(text, capacity, "worker cache_hits cache_misses coalesced missing\n");
+    server_stats_worker_t total = {0};
+    for (size_t i = 0; i < stats->workers; i++)
+    {
+        const server_stats_worker_t* worker = &stats->worker[i];
+        uint64_t cache_hits = __atomic_load_n(&worker->cache_hits, __ATOMIC_RELAXED);
+        uint64_t cache_misses = __atomic_load_n(&worker->cache_misses, __ATOMIC_RELAXED);
+        uint64_t coalesced = __atomic_load_n(&worker->coalesced, __ATOMIC_RELAXED);
+        uint64_t missing = __atomic_load_n(&worker->missing, __ATOMIC_RELAXED);
+
+        total.cache_hits += cache_hits;
+        total.cache_misses += cache_misses;
+        total.coalesced += coalesced;
+        total.missing += missing;
+        used += (size_t)snprintf(text + used, capacity - used, "%zu %llu %llu %llu %llu\n", i, (unsigned long long)cache_hits, (unsigned long long)cache_misses,
+                                 (unsigned long long)coalesced, (unsigned long long)missing);
+    }
+    used += (size_t)snprintf(text + used, capacity - used, "total %llu %llu %llu %llu\n", (unsigned long long)total.cache_hits, (unsigned long long)total.cache_misses,
+                             (unsigned long long)total.coalesced, (unsigned long long)total.missing);
+
+    *length = used;
+    return text;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Counters of worker processes in shared memory, created before workers are forked
+// Each worker writes only its own slot, so counters are updated with relaxed atomics without lock
+#define SERVER_STATS_MAX_WORKERS 64
+
+typedef struct server_stats_worker
+{
+    uint64_t cache_hits;      // requests answered from result cache
+    uint64_t cache_misses;    // requests with staleness bound measured because cache had no fresh result
+    uint64_t coalesced;       // requests which waited for measurement of the same pid in flight
+    uint64_t missing;         // requests for pid known to be missing answered without reading /proc
+} __attribute__((aligned(64))) server_stats_worker_t;
+
+typedef struct server_stats
+{
+    size_t workers;
+    server_stats_worker_t worker[SERVER_STATS_MAX_WORKERS];
+} server_stats_t;
+
+// Map counters of workers shared with child processes, NULL on error
+server_stats_t* server_stats_create(size_t workers);
+
+void server_stats_delete(server_stats_t* stats);
+
+// Slot of worker with index, NULL if stats is NULL or index is out of range
+server_stats_worker_t* server_stats_worker(server_stats_t* stats, size_t index);
+
+static inline void server_stats_increment(uint64_t* counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Publish counter kept by worker itself
+static inline void server_stats_set(uint64_t* counter, uint64_t value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+// Table "worker cache_hits cache_misses coalesced missing" with line per worker and total, returns malloc'ed text or NULL
+char* server_stats_to_string(const server_stats_t* stats, size_t* length);
+
+#endif    // SERVER_STATS_H
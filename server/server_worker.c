@@ -19,6 +19,7 @@ server_worker_t* server_worker_create(in_addr_t addr, in_port_t port)
 
     worker->connection = NULL;
     worker->worker_function = NULL;
+    worker->deferred_function = NULL;
 
     udp_socket_t* udp_socket = udp_socket_create(addr, htons(port));
     if (!udp_socket)
@@ -157,6 +158,11 @@ void server_worker_set_on_message(server_worker_t* worker, void (*worker_functio
     worker->worker_function = worker_function;
 }
 
+void server_worker_set_on_message_deferred(server_worker_t* worker, int (*deferred_function)(message_t*))
+{
+    worker->deferred_function = deferred_function;
+}
+
 void server_worker_wait_for_connection(server_worker_t* worker)
 {
     if (!worker)
@@ -213,19 +219,48 @@ void server_worker_update(server_worker_t* worker, size_t max_messages)
         message_t* message = net_connection_receive_nonblocking(worker->connection);
         if (message)
         {
-            server_worker_on_message(worker, message);
-            server_worker_send_message(worker, message);
+            if (!server_worker_on_message(worker, message))
+            {
+                server_worker_send_message(worker, message);
+            }
             message_count++;
         }
     }
 }
 
-void server_worker_on_message(server_worker_t* worker, message_t* message)
+size_t server_worker_poll(server_worker_t* worker, size_t max_messages)
+{
+    if (!worker)
+    {
+        DEBUG_LOG("server_worker_poll: Null worker argument");
+        return 0;
+    }
+
+    size_t message_count = 0;
+    while (message_count < max_messages && worker->is_running)
+    {
+        message_t* message = net_connection_receive_nonblocking(worker->connection);
+        if (!message)
+        {
+            break;
+        }
+
+        if (!server_worker_on_message(worker, message))
+        {
+            server_worker_send_message(worker, message);
+        }
+        message_count++;
+    }
+
+    return message_count;
+}
+
+int server_worker_on_message(server_worker_t* worker, message_t* message)
 {
     if (!worker || !message)
     {
         DEBUG_LOG("server_worker_on_message: Null argument(s)\n");
-        return;
+        return 0;
     }
 
     struct sockaddr_in* client_addr = &message->header.owner_addr;
@@ -234,10 +269,17 @@ void server_worker_on_message(server_worker_t* worker, message_t* message)
         DEBUG_LOG("Received message from IP: %s and port: %i\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
     }
 
+    if (worker->deferred_function)
+    {
+        return worker->deferred_function(message);
+    }
+
     if (worker->worker_function)
     {
         worker->worker_function(message);
     }
 
     DEBUG_LOG("Message from client: %.*s\n", message->header.length, (char*)message->data);
+
+    return 0;
 }
@@ -25,6 +25,7 @@ typedef struct server_worker
 {
     net_connection_t* connection;
     void (*worker_function)(message_t*);
+    int (*deferred_function)(message_t*);    // returns nonzero if message is kept and replied later by server_worker_send_message
     int is_running;
 } server_worker_t;
 
@@ -43,6 +44,9 @@ server_worker_status_t server_worker_stop(server_worker_t* worker);
 // Set receiver on message in worker
 void server_worker_set_on_message(server_worker_t* worker, void (*worker_function)(message_t*));
 
+// Set receiver which can defer reply (used instead of worker_function), messages it keeps are not sent by server_worker_update / server_worker_poll
+void server_worker_set_on_message_deferred(server_worker_t* worker, int (*deferred_function)(message_t*));
+
 // Is waiting for the first message = incoming connection
 void server_worker_wait_for_connection(server_worker_t* worker);
 
@@ -52,7 +56,11 @@ server_worker_status_t server_worker_send_message(server_worker_t* worker, messa
 // Updates the status of the worker by processing incoming messages from the queue
 void server_worker_update(server_worker_t* worker, size_t max_messages);
 
+// Processes messages which are already in the queue without waiting for more, returns their count
+size_t server_worker_poll(server_worker_t* worker, size_t max_messages);
+
 // Message processing function
-void server_worker_on_message(server_worker_t* worker, message_t* message);
+// Returns nonzero if reply is deferred
+int server_worker_on_message(server_worker_t* worker, message_t* message);
 
 #endif    // SERVER_WORKER_H
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <CUnit/Basic.h>
 
@@ -82,6 +83,571 @@ void test_journal_read_empty_journal(void)
     CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
 }
 
+void test_journal_create_with_options(void)
+{
+    int requested = JOURNAL_OPTION_HUGETLB | JOURNAL_OPTION_POPULATE | JOURNAL_OPTION_MLOCK;
+    journal_t* journal = journal_create_with_options(1024, requested);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_TRUE(journal->map_size >= journal->max_size);
+
+    // HUGETLB may fall back to THP, the rest can only be dropped
+    CU_ASSERT_EQUAL(journal->options & ~(requested | JOURNAL_OPTION_THP), 0);
+    CU_ASSERT_TRUE(journal->options & JOURNAL_OPTION_POPULATE);
+
+    const char* data = "Test data";
+    size_t data_size = strlen(data) + 1;
+    CU_ASSERT_EQUAL(journal_write(journal, data, data_size), JOURNAL_STATUS_SUCCESS);
+
+    char buffer[1024];
+    size_t buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read(journal, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_STRING_EQUAL(buffer, data);
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_options_to_string(void)
+{
+    char buffer[64];
+    CU_ASSERT_STRING_EQUAL(journal_options_to_string(JOURNAL_OPTION_NONE, buffer, sizeof(buffer)), "none");
+    CU_ASSERT_STRING_EQUAL(journal_options_to_string(JOURNAL_OPTION_THP | JOURNAL_OPTION_MLOCK, buffer, sizeof(buffer)), "thp|mlock");
+}
+
+void test_journal_grow_on_demand(void)
+{
+    // Address space is only reserved and committed in chunks as records are written
+    size_t journal_size = (size_t)8 * JOURNAL_COMMIT_CHUNK_SIZE;
+    journal_t* journal = journal_create_with_options(journal_size, JOURNAL_OPTION_POPULATE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal->max_size, journal_size);
+    CU_ASSERT_EQUAL(journal->header->committed, JOURNAL_COMMIT_CHUNK_SIZE);
+
+    static char chunk[JOURNAL_RECORD_MAX_DATA_SIZE];
+    memset(chunk, 'a', sizeof(chunk));
+
+    // Several grow steps, still far below the reservation
+    size_t written = 0;
+    while (written <= 3 * JOURNAL_COMMIT_CHUNK_SIZE)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_write(journal, chunk, sizeof(chunk)), JOURNAL_STATUS_SUCCESS);
+        written += JOURNAL_RECORD_SIZE(sizeof(chunk));
+    }
+
+    CU_ASSERT_TRUE(journal->header->committed > written);
+    CU_ASSERT_TRUE(journal->header->committed <= written + JOURNAL_COMMIT_CHUNK_SIZE);
+
+    size_t size = 0;
+    CU_ASSERT_EQUAL(journal_get_size(journal, &size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(size, written);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_write_above_max_size(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    static char data[JOURNAL_RECORD_MAX_DATA_SIZE + 1];
+    memset(data, 'a', sizeof(data));
+    CU_ASSERT_EQUAL(journal_write(journal, data, sizeof(data)), JOURNAL_STATUS_ERROR_WRITE);
+    CU_ASSERT_EQUAL(journal_write(journal, data, sizeof(data) - 1), JOURNAL_STATUS_SUCCESS);
+
+    // Largest record is read by range in one chunk of transfer size
+    journal_range_t range;
+    CU_ASSERT_EQUAL(journal_range_begin(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, &range), JOURNAL_STATUS_SUCCESS);
+    static char buffer[64 * 1024];
+    size_t buffer_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_range_read_records(journal, &range, buffer, &buffer_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buffer_size, JOURNAL_RECORD_SIZE(JOURNAL_RECORD_MAX_DATA_SIZE));
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_read_at(void)
+{
+    journal_t* journal = journal_create(1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal_write(journal, "0123456789", 10), JOURNAL_STATUS_SUCCESS);
+
+    // Raw data is the record header followed by payload
+    char buffer[16];
+    size_t buf_size = 4;
+    CU_ASSERT_EQUAL(journal_read_at(journal, sizeof(journal_record_t) + 3, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 4);
+    CU_ASSERT_EQUAL(memcmp(buffer, "3456", 4), 0);
+
+    size_t size = 0;
+    CU_ASSERT_EQUAL(journal_get_size(journal, &size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(size, JOURNAL_RECORD_SIZE(10));
+
+    buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read_at(journal, size - 2, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 2);
+
+    buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read_at(journal, size + 1, buffer, &buf_size), JOURNAL_STATUS_ERROR_READ);
+    CU_ASSERT_EQUAL(buf_size, 0);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_read_range(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    CU_ASSERT_EQUAL(journal_write(journal, "first;", 6), JOURNAL_STATUS_SUCCESS);
+    usleep(20000);
+    CU_ASSERT_EQUAL(journal_write(journal, "second;", 7), JOURNAL_STATUS_SUCCESS);
+    usleep(20000);
+    CU_ASSERT_EQUAL(journal_write(journal, "third;", 6), JOURNAL_STATUS_SUCCESS);
+
+    const journal_record_t* first = (const journal_record_t*)journal->data;
+    const journal_record_t* second = (const journal_record_t*)(journal->data + JOURNAL_RECORD_SIZE(6));
+    const journal_record_t* third = (const journal_record_t*)(journal->data + JOURNAL_RECORD_SIZE(6) + JOURNAL_RECORD_SIZE(7));
+    CU_ASSERT_TRUE(first->timestamp < second->timestamp && second->timestamp < third->timestamp);
+
+    char buffer[64];
+    size_t buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read_range(journal, second->timestamp, second->timestamp, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 7);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "second;", 7);
+
+    buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read_range(journal, second->timestamp, JOURNAL_TIME_MAX, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 13);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "second;third;", 13);
+
+    buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read_range(journal, third->timestamp + 1, JOURNAL_TIME_MAX, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 0);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_index_sparse(void)
+{
+    journal_t* journal = journal_create(256 * 1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    // Fill index over capacity to make it sparser
+    size_t records = (size_t)JOURNAL_INDEX_CAPACITY * JOURNAL_INDEX_RECORD_INTERVAL + 1;
+    for (size_t i = 0; i < records; i++)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_write(journal, "x", 1), JOURNAL_STATUS_SUCCESS);
+    }
+
+    CU_ASSERT_TRUE(journal->header->index_count <= JOURNAL_INDEX_CAPACITY);
+    CU_ASSERT_EQUAL(journal->header->index_record_interval, 2 * JOURNAL_INDEX_RECORD_INTERVAL);
+
+    for (size_t i = 1; i < journal->header->index_count; i++)
+    {
+        CU_ASSERT_TRUE(journal->index[i - 1].offset < journal->index[i].offset);
+        CU_ASSERT_TRUE(journal->index[i - 1].timestamp <= journal->index[i].timestamp);
+    }
+
+    journal_range_t range;
+    CU_ASSERT_EQUAL(journal_range_begin(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, &range), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(range.size, records);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_find_pid(void)
+{
+    journal_t* journal = journal_create(16 * JOURNAL_BLOCK_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    // Pid 7 is written only in the middle of journal, other blocks must be skipped
+    size_t records = 8 * JOURNAL_BLOCK_SIZE / JOURNAL_RECORD_SIZE(8);
+    size_t expected = 0;
+    for (size_t i = 0; i < records; i++)
+    {
+        journal_entry_t entry = {.pid = (i >= records / 2 && i < records / 2 + 10) ? 7 : (int32_t)(1000 + i % 50)};
+        expected += entry.pid == 1001;
+        CU_ASSERT_EQUAL_FATAL(journal_write_entry(journal, &entry, &i, sizeof(i)), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL(journal_write(journal, "no pid", 6), JOURNAL_STATUS_SUCCESS);
+
+    size_t written = 0;
+    journal_pid_iterator_t iterator;
+    const journal_record_t* record = NULL;
+    CU_ASSERT_EQUAL(journal_find_pid(journal, 7, &iterator), JOURNAL_STATUS_SUCCESS);
+    while (journal_pid_next(journal, &iterator, &record) == JOURNAL_STATUS_SUCCESS && record)
+    {
+        size_t value = 0;
+        memcpy(&value, record + 1, sizeof(value));
+        CU_ASSERT_EQUAL(value, records / 2 + written);
+        CU_ASSERT_EQUAL(record->pid, 7);
+        written++;
+    }
+    CU_ASSERT_EQUAL(written, 10);
+
+    // Records of other pids are found in every block
+    written = 0;
+    CU_ASSERT_EQUAL(journal_find_pid(journal, 1001, &iterator), JOURNAL_STATUS_SUCCESS);
+    while (journal_pid_next(journal, &iterator, &record) == JOURNAL_STATUS_SUCCESS && record)
+    {
+        written++;
+    }
+    CU_ASSERT_EQUAL(written, expected);
+
+    CU_ASSERT_EQUAL(journal_find_pid(journal, 42, &iterator), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_pid_next(journal, &iterator, &record), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_PTR_NULL(record);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_aggregate(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    journal_entry_t entry = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 3.0};
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    entry.cpu = 50.0;
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    entry.status = JOURNAL_RECORD_STATUS_NOT_FOUND;
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    entry.pid = 20;
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "x", 1), JOURNAL_STATUS_SUCCESS);
+
+    journal_aggregate_t aggregate;
+    CU_ASSERT_EQUAL_FATAL(journal_aggregate_get(journal, 10, &aggregate), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(aggregate.count, 3);
+    CU_ASSERT_EQUAL(aggregate.cpu_count, 2);
+    CU_ASSERT_DOUBLE_EQUAL(aggregate.cpu_sum, 53.0, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(aggregate.cpu_min, 3.0, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(aggregate.cpu_max, 50.0, 1e-9);
+
+    const journal_aggregate_bucket_t* bucket = &aggregate.buckets[(aggregate.last_timestamp / JOURNAL_AGGREGATE_BUCKET_MS) % JOURNAL_AGGREGATE_BUCKETS];
+    CU_ASSERT_EQUAL(bucket->count, 3);
+    CU_ASSERT_EQUAL(bucket->cpu_count, 2);
+    CU_ASSERT_EQUAL(bucket->histogram[2], 1);    // [2, 5)
+    CU_ASSERT_EQUAL(bucket->histogram[8], 1);    // [50, 60)
+
+    CU_ASSERT_EQUAL(journal_aggregate_get(journal, 30, &aggregate), JOURNAL_STATUS_ERROR_READ);
+
+    journal_aggregate_t all[4];
+    size_t count = 4;
+    CU_ASSERT_EQUAL(journal_aggregate_get_all(journal, all, &count), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(count, 2);
+    CU_ASSERT_EQUAL(journal->header->aggregate_count, 2);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_aggregate_capacity(void)
+{
+    // Small journal keeps small table, pids above 3/4 of it are counted as dropped
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal->aggregate_capacity, JOURNAL_AGGREGATE_MIN_CAPACITY);
+
+    journal_entry_t entry = {.pid = 1, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+    for (; entry.pid <= JOURNAL_AGGREGATE_MIN_CAPACITY; entry.pid++)
+    {
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL(journal->header->aggregate_count, 3 * JOURNAL_AGGREGATE_MIN_CAPACITY / 4);
+    CU_ASSERT_EQUAL(journal->header->aggregate_dropped, JOURNAL_AGGREGATE_MIN_CAPACITY / 4);
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+
+    journal = journal_create((size_t)JOURNAL_AGGREGATE_SIZE_RATIO * JOURNAL_AGGREGATE_MAX_CAPACITY * sizeof(journal_aggregate_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal->aggregate_capacity, JOURNAL_AGGREGATE_MAX_CAPACITY);
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_sample(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal_set_sample_rate(journal, 10), JOURNAL_STATUS_SUCCESS);
+
+    size_t entries = 5000;
+    for (size_t i = 0; i < entries; i++)
+    {
+        journal_entry_t entry = {.pid = i % 2 ? 20 : 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = i % 2 ? 4.0 : 2.0};
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+    }
+
+    // Turning sampling off writes pending entries as summary records
+    CU_ASSERT_EQUAL(journal_set_sample_rate(journal, 0), JOURNAL_STATUS_SUCCESS);
+
+    size_t records = 0;
+    uint64_t weights[2] = {0, 0};
+    double cpu_sum = 0.0;
+    size_t offset = 0;
+    const journal_record_t* record = NULL;
+    while ((record = journal_record_next(journal, &offset, journal->header->size)))
+    {
+        CU_ASSERT(record->weight >= 1);
+        weights[record->pid == 20] += record->weight;
+        cpu_sum += record->cpu * record->weight;
+        records++;
+        offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+    CU_ASSERT(records < entries / 4);
+    CU_ASSERT_EQUAL(weights[0], entries / 2);
+    CU_ASSERT_EQUAL(weights[1], entries / 2);
+    CU_ASSERT_DOUBLE_EQUAL(cpu_sum, 3.0 * (double)entries, 1e-6);
+
+    // Aggregates are exact
+    journal_aggregate_t aggregate;
+    CU_ASSERT_EQUAL_FATAL(journal_aggregate_get(journal, 20, &aggregate), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(aggregate.count, entries / 2);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_sample_read(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal_set_sample_rate(journal, 10), JOURNAL_STATUS_SUCCESS);
+
+    // Sampling stays on, read writes pending entries of the flood
+    size_t entries = 3000;
+    double entries_cpu = 0.0;
+    for (size_t i = 0; i < entries; i++)
+    {
+        journal_entry_t entry = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = (double)(i % 7)};
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+        entries_cpu += entry.cpu;
+    }
+
+    size_t size = 0;
+    CU_ASSERT_EQUAL_FATAL(journal_get_size(journal, &size), JOURNAL_STATUS_SUCCESS);
+
+    uint64_t weight = 0;
+    double cpu_sum = 0.0;
+    size_t offset = 0;
+    const journal_record_t* record = NULL;
+    while ((record = journal_record_next(journal, &offset, size)))
+    {
+        weight += record->weight;
+        cpu_sum += record->cpu * record->weight;
+        offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+    CU_ASSERT_EQUAL(weight, entries);
+    CU_ASSERT_DOUBLE_EQUAL(cpu_sum, entries_cpu, 1e-6);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_channels(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    size_t record_size = JOURNAL_RECORD_SIZE(1);
+    CU_ASSERT_EQUAL(journal_channel_set_quota(journal, JOURNAL_CHANNEL_ERRORS, 10 * record_size, JOURNAL_OVERFLOW_DROP), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_channel_set_quota(journal, JOURNAL_CHANNEL_SYSTEM, 2 * record_size, JOURNAL_OVERFLOW_REJECT), JOURNAL_STATUS_SUCCESS);
+
+    // Flood of invalid requests is dropped above quota, measurements are still written
+    journal_entry_t error = {.pid = JOURNAL_PID_NONE, .status = JOURNAL_RECORD_STATUS_INVALID, .cpu = 0.0, .channel = JOURNAL_CHANNEL_ERRORS};
+    journal_entry_t result = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0, .channel = JOURNAL_CHANNEL_RESULTS};
+    for (int i = 0; i < 100; i++)
+    {
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &error, "e", 1), JOURNAL_STATUS_SUCCESS);
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &result, "r", 1), JOURNAL_STATUS_SUCCESS);
+    }
+
+    CU_ASSERT_EQUAL(journal_write(journal, "s", 1), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "s", 1), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "s", 1), JOURNAL_STATUS_ERROR_NO_SPACE);
+
+    journal_channel_state_t state;
+    CU_ASSERT_EQUAL_FATAL(journal_channel_get(journal, JOURNAL_CHANNEL_ERRORS, &state), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.records, 10);
+    CU_ASSERT_EQUAL(state.dropped, 90);
+    CU_ASSERT_EQUAL(state.used, 10 * record_size);
+    CU_ASSERT_TRUE(state.closed);
+    CU_ASSERT_EQUAL_FATAL(journal_channel_get(journal, JOURNAL_CHANNEL_RESULTS, &state), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.records, 100);
+    CU_ASSERT_EQUAL(state.dropped, 0);
+    CU_ASSERT_EQUAL_FATAL(journal_channel_get(journal, JOURNAL_CHANNEL_SYSTEM, &state), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.records, 2);
+    CU_ASSERT_EQUAL(state.dropped, 1);
+
+    // Readers select channels
+    uint32_t channel_mask = 0;
+    CU_ASSERT_EQUAL(journal_channel_parse("errors,system", &channel_mask), 0);
+    CU_ASSERT_EQUAL(channel_mask, JOURNAL_CHANNEL_BIT(JOURNAL_CHANNEL_ERRORS) | JOURNAL_CHANNEL_BIT(JOURNAL_CHANNEL_SYSTEM));
+    CU_ASSERT_NOT_EQUAL(journal_channel_parse("errors,debug", &channel_mask), 0);
+    CU_ASSERT_STRING_EQUAL(journal_channel_name(JOURNAL_CHANNEL_RESULTS), "results");
+
+    journal_range_t range;
+    char buffer[256];
+    size_t buffer_size = sizeof(buffer);
+    CU_ASSERT_EQUAL_FATAL(journal_range_begin_channels(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, channel_mask, &range), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(range.size, 12);
+    CU_ASSERT_EQUAL(journal_range_read(journal, &range, buffer, &buffer_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buffer_size, 12);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "eeeeeeeeeess", 12);
+
+    CU_ASSERT_EQUAL(journal_range_begin(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, &range), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(range.size, 112);
+
+    // Aggregates keep counting entries of pid over quota of closed channel
+    CU_ASSERT_EQUAL(journal_channel_set_quota(journal, JOURNAL_CHANNEL_RESULTS, 101 * record_size, JOURNAL_OVERFLOW_DROP), JOURNAL_STATUS_SUCCESS);
+    for (int i = 0; i < 10; i++)
+    {
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &result, "r", 1), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL_FATAL(journal_channel_get(journal, JOURNAL_CHANNEL_RESULTS, &state), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.records, 101);
+    CU_ASSERT_EQUAL(state.dropped, 9);
+    CU_ASSERT_TRUE(state.closed);
+    journal_aggregate_t aggregate;
+    CU_ASSERT_EQUAL_FATAL(journal_aggregate_get(journal, result.pid, &aggregate), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(aggregate.count, 110);
+    CU_ASSERT_EQUAL(aggregate.cpu_count, 110);
+
+    // Channel is opened again by new quota
+    CU_ASSERT_EQUAL(journal_channel_set_quota(journal, JOURNAL_CHANNEL_ERRORS, 0, JOURNAL_OVERFLOW_DROP), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &error, "e", 1), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_channel_get(journal, JOURNAL_CHANNEL_ERRORS, &state), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.records, 11);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_fold(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal_set_fold_window(journal, 60 * 1000), JOURNAL_STATUS_SUCCESS);
+
+    // Run of pid 10 is folded, single entry of pid 20 is written as plain record
+    for (int i = 0; i < 100; i++)
+    {
+        journal_entry_t entry = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = (double)(i % 10)};
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, i == 0 ? "first;" : "next;", i == 0 ? 6 : 5), JOURNAL_STATUS_SUCCESS);
+    }
+    journal_entry_t other = {.pid = 20, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &other, "other;", 6), JOURNAL_STATUS_SUCCESS);
+
+    journal_aggregate_t aggregate;
+    CU_ASSERT_EQUAL_FATAL(journal_aggregate_get(journal, 10, &aggregate), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(aggregate.count, 100);
+
+    // Reading closes the pending run
+    char buffer[64];
+    size_t buffer_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read(journal, buffer, &buffer_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buffer_size, 12);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "first;other;", 12);
+
+    size_t offset = 0;
+    const journal_record_t* record = journal_record_next(journal, &offset, journal->header->size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(record);
+    CU_ASSERT_EQUAL(record->flags, JOURNAL_RECORD_FLAG_FOLDED);
+    CU_ASSERT_EQUAL(record->weight, 100);
+    CU_ASSERT_EQUAL(record->pid, 10);
+    CU_ASSERT_DOUBLE_EQUAL(record->cpu, 4.5, 1e-9);
+    const journal_fold_t* fold = (const journal_fold_t*)(record + 1);
+    CU_ASSERT_DOUBLE_EQUAL(fold->cpu_min, 0.0, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(fold->cpu_max, 9.0, 1e-9);
+    CU_ASSERT(fold->last_timestamp >= record->timestamp);
+    CU_ASSERT_EQUAL(record->size, sizeof(journal_fold_t) + 6);
+
+    offset += JOURNAL_RECORD_SIZE(record->size);
+    record = journal_record_next(journal, &offset, journal->header->size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(record);
+    CU_ASSERT_EQUAL(record->flags, 0);
+    CU_ASSERT_EQUAL(record->weight, 1);
+    CU_ASSERT_EQUAL(record->pid, 20);
+    offset += JOURNAL_RECORD_SIZE(record->size);
+    CU_ASSERT_EQUAL(offset, journal->header->size);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_fold_interleaved(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    CU_ASSERT_EQUAL(journal_set_fold_window(journal, 60 * 1000), JOURNAL_STATUS_SUCCESS);
+
+    // Pids polled in turns keep their own runs
+    for (int i = 0; i < 100; i++)
+    {
+        journal_entry_t entry = {.pid = i % 2 ? 20 : 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x;", 2), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL(journal->header->size, 0);
+
+    size_t size = 0;
+    CU_ASSERT_EQUAL_FATAL(journal_get_size(journal, &size), JOURNAL_STATUS_SUCCESS);
+    size_t offset = 0;
+    const journal_record_t* record = NULL;
+    size_t records = 0;
+    while ((record = journal_record_next(journal, &offset, size)))
+    {
+        CU_ASSERT_EQUAL(record->flags, JOURNAL_RECORD_FLAG_FOLDED);
+        CU_ASSERT_EQUAL(record->weight, 50);
+        records++;
+        offset += JOURNAL_RECORD_SIZE(record->size);
+    }
+    CU_ASSERT_EQUAL(records, 2);
+
+    // Run is written by the first write after its window, though another pid is written
+    CU_ASSERT_EQUAL(journal_set_fold_window(journal, 20), JOURNAL_STATUS_SUCCESS);
+    journal_entry_t first = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+    journal_entry_t second = {.pid = 20, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &first, "x;", 2), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &second, "x;", 2), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal->header->size, size);
+    usleep(30 * 1000);
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &second, "x;", 2), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal->header->size, size + 2 * JOURNAL_RECORD_SIZE(2));
+    CU_ASSERT_EQUAL(journal->header->fold_run_count, 1);
+
+    // Slots are full, the oldest run is written for a new pid
+    CU_ASSERT_EQUAL(journal_set_fold_window(journal, 60 * 1000), JOURNAL_STATUS_SUCCESS);
+    for (int i = 0; i <= JOURNAL_FOLD_SLOTS; i++)
+    {
+        journal_entry_t entry = {.pid = 100 + i, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+        CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x;", 2), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL(journal->header->fold_run_count, JOURNAL_FOLD_SLOTS);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_record_damaged(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    CU_ASSERT_EQUAL(journal_write(journal, "first;", 6), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "second;", 7), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "third;", 6), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(journal_write(journal, "fourth;", 7), JOURNAL_STATUS_SUCCESS);
+
+    // Flip payload byte of second record and overwrite header of third one with garbage
+    journal->data[JOURNAL_RECORD_SIZE(6) + sizeof(journal_record_t)] ^= 1;
+    memset(journal->data + JOURNAL_RECORD_SIZE(6) + JOURNAL_RECORD_SIZE(7), 0xAB, sizeof(journal_record_t));
+
+    char buffer[64];
+    size_t buf_size = sizeof(buffer);
+    CU_ASSERT_EQUAL(journal_read(journal, buffer, &buf_size), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(buf_size, 13);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "first;fourth;", 13);
+
+    size_t offset = JOURNAL_RECORD_ALIGN;
+    const journal_record_t* record = journal_record_next(journal, &offset, JOURNAL_RECORD_SIZE(6) + JOURNAL_RECORD_SIZE(7) + JOURNAL_RECORD_SIZE(6) + JOURNAL_RECORD_SIZE(7));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(record);
+    CU_ASSERT_EQUAL(offset, JOURNAL_RECORD_SIZE(6) + JOURNAL_RECORD_SIZE(7) + JOURNAL_RECORD_SIZE(6));
+    CU_ASSERT_EQUAL(record->magic, JOURNAL_RECORD_MAGIC);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
 int main(void)
 {
     CU_pSuite pSuite = NULL;
@@ -101,7 +667,18 @@ int main(void)
     if ((NULL == CU_add_test(pSuite, "create_success", test_journal_create_success)) || (NULL == CU_add_test(pSuite, "write_success", test_journal_write_success))
         || (NULL == CU_add_test(pSuite, "write_no_space", test_journal_write_no_space)) || (NULL == CU_add_test(pSuite, "read_success", test_journal_read_success))
         || (NULL == CU_add_test(pSuite, "read_buffer_too_small", test_journal_read_buffer_too_small))
-        || (NULL == CU_add_test(pSuite, "read_empty_journal", test_journal_read_empty_journal)))
+        || (NULL == CU_add_test(pSuite, "read_empty_journal", test_journal_read_empty_journal))
+        || (NULL == CU_add_test(pSuite, "create_with_options", test_journal_create_with_options))
+        || (NULL == CU_add_test(pSuite, "options_to_string", test_journal_options_to_string))
+        || (NULL == CU_add_test(pSuite, "grow_on_demand", test_journal_grow_on_demand)) || (NULL == CU_add_test(pSuite, "read_at", test_journal_read_at))
+        || (NULL == CU_add_test(pSuite, "write_above_max_size", test_journal_write_above_max_size))
+        || (NULL == CU_add_test(pSuite, "read_range", test_journal_read_range)) || (NULL == CU_add_test(pSuite, "index_sparse", test_journal_index_sparse))
+        || (NULL == CU_add_test(pSuite, "find_pid", test_journal_find_pid)) || (NULL == CU_add_test(pSuite, "aggregate", test_journal_aggregate))
+        || (NULL == CU_add_test(pSuite, "aggregate_capacity", test_journal_aggregate_capacity))
+        || (NULL == CU_add_test(pSuite, "record_damaged", test_journal_record_damaged)) || (NULL == CU_add_test(pSuite, "sample", test_journal_sample))
+        || (NULL == CU_add_test(pSuite, "sample_read", test_journal_sample_read))
+        || (NULL == CU_add_test(pSuite, "channels", test_journal_channels)) || (NULL == CU_add_test(pSuite, "fold", test_journal_fold))
+        || (NULL == CU_add_test(pSuite, "fold_interleaved", test_journal_fold_interleaved)))
     {
         CU_cleanup_registry();
         return CU_get_error();
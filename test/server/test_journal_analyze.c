@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+
+#include "journal.h"
+#include "journal_analyze.h"
+#include "journal_columnar.h"
+
+#define JOURNAL_ANALYZE_TEST_FILE "JOURNAL_ANALYZE_TEST.txt"
+
+// 2024-01-01 00:00:00 as seconds since epoch without time zone
+#define JOURNAL_ANALYZE_TEST_TIME 1704067200LL
+
+static void check_text_result(const journal_analyze_result_t* result, size_t lines)
+{
+    CU_ASSERT_EQUAL(result->records, lines + 1);
+    CU_ASSERT_EQUAL(result->invalid, 1);
+    CU_ASSERT_EQUAL(result->skipped, 1);
+    CU_ASSERT_EQUAL_FATAL(result->pid_count, 3);
+
+    // pid 10: cpu 0..99, pid 20: cpu 50, pid 30: not found only
+    CU_ASSERT_EQUAL(result->pids[0].key, 10);
+    CU_ASSERT_EQUAL(result->pids[0].count, lines / 3);
+    CU_ASSERT_DOUBLE_EQUAL(result->pids[0].cpu_sum / (double)result->pids[0].cpu_count, 49.5, 1e-6);
+    CU_ASSERT_DOUBLE_EQUAL(result->pids[0].cpu_min, 0.0, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(result->pids[0].cpu_max, 99.0, 1e-9);
+    CU_ASSERT_EQUAL(result->pids[1].key, 20);
+    CU_ASSERT_EQUAL(result->pids[2].key, 30);
+    CU_ASSERT_EQUAL(result->pids[2].cpu_count, 0);
+
+    // One line per second
+    uint64_t bucket_records = 0;
+    CU_ASSERT_EQUAL(result->buckets[0].key, JOURNAL_ANALYZE_TEST_TIME);
+    for (size_t i = 0; i < result->bucket_count; i++)
+    {
+        bucket_records += result->buckets[i].count;
+    }
+    CU_ASSERT_EQUAL(bucket_records, result->records);
+    CU_ASSERT_EQUAL(result->bucket_count, (lines + 59) / 60);
+
+    journal_analyze_stats_t top[2];
+    CU_ASSERT_EQUAL(journal_analyze_top(result, 2, top), 2);
+    CU_ASSERT_EQUAL(top[0].key, 20);
+    CU_ASSERT_EQUAL(top[1].key, 10);
+}
+
+void test_journal_analyze_text_parallel(void)
+{
+    FILE* file = fopen(JOURNAL_ANALYZE_TEST_FILE, "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    // Lines are written by server with terminating '\0' after '\n', sized to split in several chunks
+    size_t lines = 30000;
+    fprintf(file, "Hello from server journal\n");
+    for (size_t i = 0; i < lines; i++)
+    {
+        int64_t t = (int64_t)i;
+        char buffer[128];
+        int length;
+        if (i % 3 == 0)
+            length = snprintf(buffer, sizeof(buffer), "2024-01-%02lld %02lld:%02lld:%02lld: 10 %%%f\n", 1 + t / 86400, t / 3600 % 24, t / 60 % 60, t % 60, (double)(i / 3 % 100));
+        else if (i % 3 == 1)
+            length = snprintf(buffer, sizeof(buffer), "2024-01-%02lld %02lld:%02lld:%02lld: 20 %%50.000000\n", 1 + t / 86400, t / 3600 % 24, t / 60 % 60, t % 60);
+        else
+            length = snprintf(buffer, sizeof(buffer), "2024-01-%02lld %02lld:%02lld:%02lld: 30 not found\n", 1 + t / 86400, t / 3600 % 24, t / 60 % 60, t % 60);
+        fwrite(buffer, 1, (size_t)length + 1, file);
+    }
+    fprintf(file, "2024-01-01 00:00:00: invalid request");
+    fclose(file);
+
+    journal_analyze_result_t result;
+    journal_analyze_options_t options = {.threads = 1, .bucket_seconds = 60};
+    CU_ASSERT_EQUAL_FATAL(journal_analyze_file(JOURNAL_ANALYZE_TEST_FILE, &options, &result), JOURNAL_ANALYZE_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(result.threads, 1);
+    check_text_result(&result, lines);
+    journal_analyze_result_free(&result);
+
+    options.threads = 4;
+    CU_ASSERT_EQUAL_FATAL(journal_analyze_file(JOURNAL_ANALYZE_TEST_FILE, &options, &result), JOURNAL_ANALYZE_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(result.threads, 4);
+    check_text_result(&result, lines);
+
+    size_t length = 0;
+    char* report = journal_analyze_result_to_string(&result, 2, &length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(report);
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "records 30001 invalid 1 skipped 1 threads 4\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "top 2 by avg\npid count avg max\n20 10000 50.000 50.000\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "2024-01-01 00:00:00 "));
+    free(report);
+
+    journal_analyze_result_free(&result);
+    unlink(JOURNAL_ANALYZE_TEST_FILE);
+
+    CU_ASSERT_EQUAL(journal_analyze_file("/nonexistent/journal.txt", NULL, &result), JOURNAL_ANALYZE_STATUS_ERROR_OPEN);
+}
+
+void test_journal_analyze_columnar(void)
+{
+    journal_columnar_writer_t* writer = journal_columnar_writer_open(JOURNAL_ANALYZE_TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(writer);
+
+    // Every 8th record is sampled and stands for 3 entries
+    size_t records = 3 * JOURNAL_COLUMNAR_BLOCK_RECORDS + 5;
+    uint64_t entries = 0;
+    for (size_t i = 0; i < records; i++)
+    {
+        journal_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.magic = JOURNAL_RECORD_MAGIC;
+        record.timestamp = 1700000000000LL + (int64_t)i * 100;
+        record.pid = 100 + (int32_t)(i % 4);
+        record.status = JOURNAL_RECORD_STATUS_OK;
+        record.cpu = (double)(i % 4);
+        record.weight = i % 8 == 0 ? 3 : 1;
+        entries += record.weight;
+        CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_add(writer, &record), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_close(writer), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+
+    journal_analyze_result_t result;
+    journal_analyze_options_t options = {.threads = 8, .bucket_seconds = 3600};
+    CU_ASSERT_EQUAL_FATAL(journal_analyze_file(JOURNAL_ANALYZE_TEST_FILE, &options, &result), JOURNAL_ANALYZE_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(result.threads, 4);
+    CU_ASSERT_EQUAL(result.records, entries);
+    CU_ASSERT_EQUAL_FATAL(result.pid_count, 4);
+
+    uint64_t pid_records = 0;
+    for (size_t i = 0; i < result.pid_count; i++)
+    {
+        CU_ASSERT_EQUAL(result.pids[i].key, 100 + (int64_t)i);
+        CU_ASSERT_DOUBLE_EQUAL(result.pids[i].cpu_max, (double)i, 1e-9);
+        pid_records += result.pids[i].count;
+    }
+    CU_ASSERT_EQUAL(pid_records, entries);
+
+    journal_analyze_stats_t top[1];
+    CU_ASSERT_EQUAL(journal_analyze_top(&result, 1, top), 1);
+    CU_ASSERT_EQUAL(top[0].key, 103);
+
+    journal_analyze_result_free(&result);
+    unlink(JOURNAL_ANALYZE_TEST_FILE);
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("JournalAnalyzeTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "text_parallel", test_journal_analyze_text_parallel)) || (NULL == CU_add_test(pSuite, "columnar", test_journal_analyze_columnar)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+
+#include "journal.h"
+#include "journal_columnar.h"
+
+#define JOURNAL_COLUMNAR_TEST_FILE "JOURNAL_COLUMNAR_TEST.bin"
+
+static journal_record_t make_record(int64_t timestamp, int32_t pid, journal_record_status_t status, double cpu)
+{
+    journal_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = JOURNAL_RECORD_MAGIC;
+    record.timestamp = timestamp;
+    record.pid = pid;
+    record.status = status;
+    record.cpu = cpu;
+    return record;
+}
+
+void test_journal_columnar_roundtrip(void)
+{
+    journal_columnar_writer_t* writer = journal_columnar_writer_open(JOURNAL_COLUMNAR_TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(writer);
+
+    // Two full blocks and one partial, second block is for pids 2000.. only
+    size_t records = 2 * JOURNAL_COLUMNAR_BLOCK_RECORDS + 10;
+    for (size_t i = 0; i < records; i++)
+    {
+        int32_t pid = (i / JOURNAL_COLUMNAR_BLOCK_RECORDS == 1) ? 2000 + (int32_t)(i % 7) : 100 + (int32_t)(i % 5);
+        journal_record_t record = make_record(1700000000000LL + (int64_t)i * 250, pid, i % 3 ? JOURNAL_RECORD_STATUS_OK : JOURNAL_RECORD_STATUS_NOT_FOUND, (double)(i % 100));
+        record.weight = (uint32_t)(i % 4);
+        record.flags = i % 11 == 0 ? JOURNAL_RECORD_FLAG_FOLDED : 0;
+        CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_add(writer, &record), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_close(writer), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+
+    journal_columnar_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_columnar_reader_open(JOURNAL_COLUMNAR_TEST_FILE, &reader), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(reader.block_count, 3);
+    CU_ASSERT_EQUAL(reader.blocks[2].record_count, 10);
+    CU_ASSERT_EQUAL(reader.blocks[1].pid_min, 2000);
+    CU_ASSERT_EQUAL(reader.blocks[1].pid_max, 2006);
+    CU_ASSERT_EQUAL(reader.blocks[0].status_mask, (1u << JOURNAL_RECORD_STATUS_OK) | (1u << JOURNAL_RECORD_STATUS_NOT_FOUND));
+
+    CU_ASSERT_FALSE(journal_columnar_block_may_match(&reader.blocks[0], JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, 2003));
+    CU_ASSERT_TRUE(journal_columnar_block_may_match(&reader.blocks[1], JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, 2003));
+    CU_ASSERT_FALSE(journal_columnar_block_may_match(&reader.blocks[2], JOURNAL_TIME_MIN, reader.blocks[1].t_max, JOURNAL_PID_NONE));
+
+    static journal_columnar_block_t block;
+    size_t index = 0;
+    for (size_t b = 0; b < reader.block_count; b++)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_columnar_read_block(&reader, b, &block), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+        for (size_t i = 0; i < block.record_count; i++, index++)
+        {
+            CU_ASSERT_EQUAL(block.timestamps[i], 1700000000000LL + (int64_t)index * 250);
+            CU_ASSERT_EQUAL(block.statuses[i], index % 3 ? JOURNAL_RECORD_STATUS_OK : JOURNAL_RECORD_STATUS_NOT_FOUND);
+            CU_ASSERT_DOUBLE_EQUAL(block.cpu[i], index % 3 ? (double)(index % 100) : 0.0, 1e-9);
+            CU_ASSERT_EQUAL(block.weights[i], index % 4 ? index % 4 : 1);
+            CU_ASSERT_EQUAL(block.flags[i], index % 11 == 0 ? JOURNAL_RECORD_FLAG_FOLDED : 0);
+        }
+    }
+    CU_ASSERT_EQUAL(index, records);
+
+    journal_columnar_reader_close(&reader);
+    unlink(JOURNAL_COLUMNAR_TEST_FILE);
+}
+
+void test_journal_columnar_invalid_file(void)
+{
+    FILE* file = fopen(JOURNAL_COLUMNAR_TEST_FILE, "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fputs("2024-01-01 00:00:00: 1 %1.000000\n", file);
+    fclose(file);
+
+    journal_columnar_reader_t reader;
+    CU_ASSERT_EQUAL(journal_columnar_reader_open(JOURNAL_COLUMNAR_TEST_FILE, &reader), JOURNAL_COLUMNAR_STATUS_ERROR_FORMAT);
+    CU_ASSERT_EQUAL(journal_columnar_reader_open("/nonexistent/journal.bin", &reader), JOURNAL_COLUMNAR_STATUS_ERROR_OPEN);
+
+    unlink(JOURNAL_COLUMNAR_TEST_FILE);
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("JournalColumnarTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "roundtrip", test_journal_columnar_roundtrip)) || (NULL == CU_add_test(pSuite, "invalid_file", test_journal_columnar_invalid_file)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
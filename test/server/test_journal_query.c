@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include "journal.h"
+#include "journal_query.h"
+
+static void write_entry(journal_t* journal, int32_t pid, journal_record_status_t status, double cpu)
+{
+    journal_entry_t entry = {.pid = pid, .status = status, .cpu = cpu};
+    CU_ASSERT_EQUAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_query_parse(void)
+{
+    journal_query_t query;
+    CU_ASSERT_EQUAL(journal_query_parse("pid=42 from=10 to=20 status=ok,invalid group=none p=50,99.9", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(query.pid, 42);
+    CU_ASSERT_EQUAL(query.t_from, 10);
+    CU_ASSERT_EQUAL(query.t_to, 20);
+    CU_ASSERT_EQUAL(query.status_mask, JOURNAL_QUERY_STATUS_BIT(JOURNAL_RECORD_STATUS_OK) | JOURNAL_QUERY_STATUS_BIT(JOURNAL_RECORD_STATUS_INVALID));
+    CU_ASSERT_FALSE(query.group_by_pid);
+    CU_ASSERT_EQUAL(query.percentile_count, 2);
+    CU_ASSERT_DOUBLE_EQUAL(query.percentiles[1], 99.9, 1e-9);
+
+    CU_ASSERT_EQUAL(journal_query_parse("", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(query.pid, JOURNAL_PID_NONE);
+    CU_ASSERT_TRUE(query.group_by_pid);
+    CU_ASSERT_EQUAL(query.percentile_count, 3);
+    CU_ASSERT_EQUAL(query.channel_mask, 0);
+
+    CU_ASSERT_EQUAL(journal_query_parse("channel=results,system", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(query.channel_mask, JOURNAL_CHANNEL_BIT(JOURNAL_CHANNEL_RESULTS) | JOURNAL_CHANNEL_BIT(JOURNAL_CHANNEL_SYSTEM));
+
+    CU_ASSERT_EQUAL(journal_query_parse("pid=abc", &query), JOURNAL_QUERY_STATUS_ERROR_PARSE);
+    CU_ASSERT_EQUAL(journal_query_parse("channel=debug", &query), JOURNAL_QUERY_STATUS_ERROR_PARSE);
+    CU_ASSERT_EQUAL(journal_query_parse("status=running", &query), JOURNAL_QUERY_STATUS_ERROR_PARSE);
+    CU_ASSERT_EQUAL(journal_query_parse("p=101", &query), JOURNAL_QUERY_STATUS_ERROR_PARSE);
+    CU_ASSERT_EQUAL(journal_query_parse("limit=10", &query), JOURNAL_QUERY_STATUS_ERROR_PARSE);
+}
+
+void test_journal_query_group_by_pid(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    for (int i = 1; i <= 100; i++)
+    {
+        write_entry(journal, 10, JOURNAL_RECORD_STATUS_OK, (double)i);
+        write_entry(journal, 20, JOURNAL_RECORD_STATUS_OK, 5.0);
+    }
+    write_entry(journal, 20, JOURNAL_RECORD_STATUS_NOT_FOUND, 0.0);
+    write_entry(journal, JOURNAL_PID_NONE, JOURNAL_RECORD_STATUS_INVALID, 0.0);
+    CU_ASSERT_EQUAL(journal_write(journal, "text", 4), JOURNAL_STATUS_SUCCESS);
+
+    journal_query_t query;
+    journal_query_result_t result;
+    CU_ASSERT_EQUAL(journal_query_parse("status=ok,not_found", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_query_run(journal, &query, &result), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(result.group_count, 2);
+
+    const journal_query_group_t* first = &result.groups[0];
+    CU_ASSERT_EQUAL(first->pid, 10);
+    CU_ASSERT_EQUAL(first->count, 100);
+    CU_ASSERT_DOUBLE_EQUAL(first->cpu_sum / first->cpu_count, 50.5, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(first->cpu_max, 100.0, 1e-9);
+    CU_ASSERT_DOUBLE_EQUAL(journal_query_percentile(first, 50.0), 50.0, JOURNAL_QUERY_HISTOGRAM_RESOLUTION);
+    CU_ASSERT_DOUBLE_EQUAL(journal_query_percentile(first, 99.0), 99.0, JOURNAL_QUERY_HISTOGRAM_RESOLUTION);
+    CU_ASSERT_DOUBLE_EQUAL(journal_query_percentile(first, 100.0), 100.0, 1e-9);
+
+    const journal_query_group_t* second = &result.groups[1];
+    CU_ASSERT_EQUAL(second->pid, 20);
+    CU_ASSERT_EQUAL(second->count, 101);
+    CU_ASSERT_EQUAL(second->cpu_count, 100);
+    CU_ASSERT_DOUBLE_EQUAL(journal_query_percentile(second, 90.0), 5.0, 1e-9);
+
+    size_t length = 0;
+    char* text = journal_query_result_to_string(&query, &result, &length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+    CU_ASSERT_EQUAL(length, strlen(text));
+    CU_ASSERT_NSTRING_EQUAL(text, "pid count avg max p50 p90 p99\n10 100 50.500 100.000 ", strlen("pid count avg max p50 p90 p99\n10 100 50.500 100.000 "));
+    free(text);
+
+    journal_query_result_free(&result);
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_query_filters(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        write_entry(journal, 100 + i % 10, JOURNAL_RECORD_STATUS_OK, 1.0);
+    }
+
+    journal_query_t query;
+    journal_query_result_t result;
+
+    // One pid is looked up through bloom filters
+    CU_ASSERT_EQUAL(journal_query_parse("pid=103 group=none", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_query_run(journal, &query, &result), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(result.group_count, 1);
+    CU_ASSERT_EQUAL(result.groups[0].pid, JOURNAL_PID_NONE);
+    CU_ASSERT_EQUAL(result.groups[0].count, 100);
+    journal_query_result_free(&result);
+
+    const journal_record_t* last = (const journal_record_t*)(journal->data + 999 * JOURNAL_RECORD_SIZE(1));
+    char text[128];
+    snprintf(text, sizeof(text), "from=%lld group=none", (long long)last->timestamp + 1);
+    CU_ASSERT_EQUAL(journal_query_parse(text, &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_query_run(journal, &query, &result), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(result.groups[0].count, 0);
+    journal_query_result_free(&result);
+
+    CU_ASSERT_EQUAL(journal_query_parse("status=invalid", &query), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_query_run(journal, &query, &result), JOURNAL_QUERY_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(result.group_count, 0);
+    journal_query_result_free(&result);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+void test_journal_query_aggregates_to_string(void)
+{
+    journal_t* journal = journal_create(64 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    write_entry(journal, 10, JOURNAL_RECORD_STATUS_OK, 1.0);
+    write_entry(journal, 10, JOURNAL_RECORD_STATUS_OK, 3.0);
+
+    journal_aggregate_t aggregate;
+    CU_ASSERT_EQUAL_FATAL(journal_aggregate_get(journal, 10, &aggregate), JOURNAL_STATUS_SUCCESS);
+
+    size_t length = 0;
+    char* text = journal_query_aggregates_to_string(&aggregate, 1, 1, &length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+
+    char expected[256];
+    snprintf(expected, sizeof(expected), "pid count avg min max last\n10 2 2.000 1.000 3.000 %lld\nbucket ", (long long)aggregate.last_timestamp);
+    CU_ASSERT_NSTRING_EQUAL(text, expected, strlen(expected));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, " 2 2.000 3.000 0,1,1,0,"));
+    free(text);
+
+    CU_ASSERT_EQUAL(journal_delete(journal), JOURNAL_STATUS_SUCCESS);
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("JournalQueryTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "parse", test_journal_query_parse)) || (NULL == CU_add_test(pSuite, "group_by_pid", test_journal_query_group_by_pid))
+        || (NULL == CU_add_test(pSuite, "filters", test_journal_query_filters))
+        || (NULL == CU_add_test(pSuite, "aggregates_to_string", test_journal_query_aggregates_to_string)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+
+#include "journal.h"
+#include "journal_columnar.h"
+#include "journal_reader.h"
+
+#define JOURNAL_READER_TEST_FILE "JOURNAL_READER_TEST.txt"
+
+// 2024-01-01 00:00:00 as seconds since epoch without time zone
+#define JOURNAL_READER_TEST_TIME 1704067200LL
+
+static int64_t local_ms(int year, int month, int day, int hour, int minute, int second)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1;
+    return (int64_t)mktime(&tm) * 1000;
+}
+
+void test_journal_reader_parse_line(void)
+{
+    journal_reader_record_t record;
+    int64_t time = 0;
+    const char* text = "2024-01-01 00:01:05: 1234 %12.500000";
+    CU_ASSERT_EQUAL_FATAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    CU_ASSERT_EQUAL(time, JOURNAL_READER_TEST_TIME + 65);
+    CU_ASSERT_EQUAL(record.pid, 1234);
+    CU_ASSERT_EQUAL(record.source, -1);
+    CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_OK);
+    CU_ASSERT_DOUBLE_EQUAL(record.cpu, 12.5, 1e-9);
+
+    text = "2024-01-01 00:00:00: 77 not found";
+    CU_ASSERT_EQUAL_FATAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    CU_ASSERT_EQUAL(record.pid, 77);
+    CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_NOT_FOUND);
+
+    text = "2024-01-01 00:00:00: invalid request";
+    CU_ASSERT_EQUAL_FATAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    CU_ASSERT_EQUAL(record.pid, JOURNAL_PID_NONE);
+    CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_INVALID);
+
+    // Time is known, message is not
+    text = "2024-01-01 00:00:00: 77 %abc";
+    CU_ASSERT_EQUAL_FATAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_NONE);
+
+    // Line of merged journal
+    text = "[3] 2024-01-01 00:00:00: 77 not found";
+    CU_ASSERT_EQUAL_FATAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    CU_ASSERT_EQUAL(record.source, 3);
+    CU_ASSERT_EQUAL(record.pid, 77);
+    CU_ASSERT_EQUAL(time, JOURNAL_READER_TEST_TIME);
+
+    text = "Hello from server journal";
+    CU_ASSERT_NOT_EQUAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+    text = "2024-13-01 00:00:00: 77 not found";
+    CU_ASSERT_NOT_EQUAL(journal_reader_parse_line(text, strlen(text), &time, &record), 0);
+}
+
+void test_journal_reader_find_separator(void)
+{
+    char buffer[100];
+    memset(buffer, 'a', sizeof(buffer));
+    const char* end = buffer + sizeof(buffer);
+
+    CU_ASSERT_PTR_EQUAL(journal_reader_find_separator(buffer, end), end);
+
+    buffer[37] = '\0';
+    buffer[70] = '\n';
+    CU_ASSERT_PTR_EQUAL(journal_reader_find_separator(buffer, end), buffer + 37);
+    CU_ASSERT_PTR_EQUAL(journal_reader_find_separator(buffer + 38, end), buffer + 70);
+    buffer[98] = '\n';
+    CU_ASSERT_PTR_EQUAL(journal_reader_find_separator(buffer + 71, end), buffer + 98);
+}
+
+void test_journal_reader_text(void)
+{
+    FILE* file = fopen(JOURNAL_READER_TEST_FILE, "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    // One line per second from 2024-01-01 00:00:00, large enough for binary search by time
+    size_t lines = 20000;
+    fprintf(file, "Hello from server journal\n");
+    for (size_t i = 0; i < lines; i++)
+    {
+        long long t = (long long)i;
+        fprintf(file, "2024-01-01 %02lld:%02lld:%02lld: %lld %%%f\n", t / 3600, t / 60 % 60, t % 60, t % 7, (double)(i % 100));
+        fputc('\0', file);
+    }
+    fclose(file);
+
+    journal_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_reader_open(JOURNAL_READER_TEST_FILE, &reader), JOURNAL_READER_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(reader.format, JOURNAL_READER_FORMAT_TEXT);
+
+    journal_reader_iterator_t* iterator = (journal_reader_iterator_t*)malloc(sizeof(journal_reader_iterator_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(iterator);
+    journal_reader_record_t record;
+
+    journal_reader_iterator_init(&reader, iterator);
+    CU_ASSERT_TRUE_FATAL(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_NONE);
+    CU_ASSERT_EQUAL(record.text_size, strlen("Hello from server journal"));
+
+    size_t count = 0;
+    uint64_t cursor_100 = 0;
+    while (journal_reader_next(iterator, &record))
+    {
+        CU_ASSERT_EQUAL(record.status, JOURNAL_RECORD_STATUS_OK);
+        CU_ASSERT_EQUAL(record.pid, (int32_t)(count % 7));
+        if (count == 100)
+        {
+            cursor_100 = record.cursor;
+            CU_ASSERT_EQUAL(record.timestamp, local_ms(2024, 1, 1, 0, 1, 40));
+        }
+        count++;
+    }
+    CU_ASSERT_EQUAL(count, lines);
+
+    journal_reader_seek_cursor(iterator, cursor_100);
+    CU_ASSERT_TRUE(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(record.cursor, cursor_100);
+
+    // Cursor inside a line moves to the next line
+    journal_reader_seek_cursor(iterator, cursor_100 + 3);
+    CU_ASSERT_TRUE(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(record.timestamp, local_ms(2024, 1, 1, 0, 1, 41));
+
+    journal_reader_iterator_init(&reader, iterator);
+    journal_reader_seek_time(iterator, local_ms(2024, 1, 1, 3, 0, 0));
+    CU_ASSERT_TRUE_FATAL(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(strncmp(record.text, "2024-01-01 03:00:00: ", 21), 0);
+
+    journal_reader_seek_time(iterator, JOURNAL_TIME_MAX);
+    CU_ASSERT_FALSE(journal_reader_next(iterator, &record));
+
+    // Parts of split file have every record once
+    size_t split_count = 0;
+    for (size_t part = 0; part < 3; part++)
+    {
+        journal_reader_iterator_init(&reader, iterator);
+        journal_reader_seek_cursor(iterator, journal_reader_split(&reader, part, 3));
+        journal_reader_set_end(iterator, journal_reader_split(&reader, part + 1, 3));
+        while (journal_reader_next(iterator, &record))
+        {
+            split_count++;
+        }
+    }
+    CU_ASSERT_EQUAL(split_count, lines + 1);
+
+    free(iterator);
+    journal_reader_close(&reader);
+    unlink(JOURNAL_READER_TEST_FILE);
+
+    CU_ASSERT_EQUAL(journal_reader_open("/nonexistent/journal.txt", &reader), JOURNAL_READER_STATUS_ERROR_OPEN);
+}
+
+void test_journal_reader_records(void)
+{
+    journal_t* journal = journal_create(1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+    for (int i = 0; i < 10; i++)
+    {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "record %d", i);
+        journal_entry_t entry = {.pid = 100 + i, .status = JOURNAL_RECORD_STATUS_OK, .cpu = (double)i};
+        CU_ASSERT_EQUAL_FATAL(journal_write_entry(journal, &entry, text, (size_t)length), JOURNAL_STATUS_SUCCESS);
+    }
+
+    journal_range_t range;
+    char buffer[4096];
+    size_t size = sizeof(buffer);
+    CU_ASSERT_EQUAL_FATAL(journal_range_begin(journal, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX, &range), JOURNAL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(journal_range_read_records(journal, &range, buffer, &size), JOURNAL_STATUS_SUCCESS);
+    journal_delete(journal);
+
+    // Damage payload of fifth record, reader skips it
+    size_t record_size = JOURNAL_RECORD_SIZE(strlen("record 0"));
+    buffer[record_size * 4 + sizeof(journal_record_t)] ^= 0x5A;
+
+    FILE* file = fopen(JOURNAL_READER_TEST_FILE, "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fwrite(buffer, 1, size, file);
+    fclose(file);
+
+    journal_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_reader_open(JOURNAL_READER_TEST_FILE, &reader), JOURNAL_READER_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(reader.format, JOURNAL_READER_FORMAT_RECORDS);
+
+    journal_reader_iterator_t* iterator = (journal_reader_iterator_t*)malloc(sizeof(journal_reader_iterator_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(iterator);
+    journal_reader_iterator_init(&reader, iterator);
+
+    journal_reader_record_t record;
+    int expected[] = {0, 1, 2, 3, 5, 6, 7, 8, 9};
+    size_t count = 0;
+    while (journal_reader_next(iterator, &record) && count < sizeof(expected) / sizeof(expected[0]))
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "record %d", expected[count]);
+        CU_ASSERT_EQUAL(record.pid, 100 + expected[count]);
+        CU_ASSERT_DOUBLE_EQUAL(record.cpu, (double)expected[count], 1e-9);
+        CU_ASSERT_EQUAL(record.text_size, strlen(text));
+        CU_ASSERT_EQUAL(memcmp(record.text, text, record.text_size), 0);
+        count++;
+    }
+    CU_ASSERT_EQUAL(count, sizeof(expected) / sizeof(expected[0]));
+
+    free(iterator);
+    journal_reader_close(&reader);
+    unlink(JOURNAL_READER_TEST_FILE);
+}
+
+void test_journal_reader_columnar(void)
+{
+    journal_columnar_writer_t* writer = journal_columnar_writer_open(JOURNAL_READER_TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(writer);
+
+    size_t records = 2 * JOURNAL_COLUMNAR_BLOCK_RECORDS + 100;
+    for (size_t i = 0; i < records; i++)
+    {
+        journal_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.magic = JOURNAL_RECORD_MAGIC;
+        record.timestamp = 1700000000000LL + (int64_t)i * 10;
+        record.pid = (int32_t)i;
+        record.status = JOURNAL_RECORD_STATUS_OK;
+        record.cpu = 1.0;
+        CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_add(writer, &record), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL_FATAL(journal_columnar_writer_close(writer), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+
+    journal_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_reader_open(JOURNAL_READER_TEST_FILE, &reader), JOURNAL_READER_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(reader.format, JOURNAL_READER_FORMAT_COLUMNAR);
+
+    journal_reader_iterator_t* iterator = (journal_reader_iterator_t*)malloc(sizeof(journal_reader_iterator_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(iterator);
+    journal_reader_iterator_init(&reader, iterator);
+
+    journal_reader_record_t record;
+    size_t count = 0;
+    while (journal_reader_next(iterator, &record))
+    {
+        CU_ASSERT_EQUAL(record.pid, (int32_t)count);
+        CU_ASSERT_PTR_NULL(record.text);
+        count++;
+    }
+    CU_ASSERT_EQUAL(count, records);
+
+    // Time in second block, footer statistics skip the first one
+    size_t target = JOURNAL_COLUMNAR_BLOCK_RECORDS + 17;
+    journal_reader_iterator_init(&reader, iterator);
+    journal_reader_seek_time(iterator, 1700000000000LL + (int64_t)target * 10 - 5);
+    CU_ASSERT_TRUE_FATAL(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(record.pid, (int32_t)target);
+
+    uint64_t cursor = record.cursor;
+    CU_ASSERT_TRUE(journal_reader_next(iterator, &record));
+    journal_reader_seek_cursor(iterator, cursor);
+    CU_ASSERT_TRUE(journal_reader_next(iterator, &record));
+    CU_ASSERT_EQUAL(record.pid, (int32_t)target);
+
+    free(iterator);
+    journal_reader_close(&reader);
+    unlink(JOURNAL_READER_TEST_FILE);
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("JournalReaderTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "parse_line", test_journal_reader_parse_line)) || (NULL == CU_add_test(pSuite, "find_separator", test_journal_reader_find_separator))
+        || (NULL == CU_add_test(pSuite, "text", test_journal_reader_text)) || (NULL == CU_add_test(pSuite, "records", test_journal_reader_records))
+        || (NULL == CU_add_test(pSuite, "columnar", test_journal_reader_columnar)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -8,6 +8,8 @@
 #include <CUnit/Basic.h>
 
 #include "journal.h"
+#include "journal_columnar.h"
+#include "journal_reader.h"
 #include "journal_transfer.h"
 #include "utility.h"
 
@@ -61,6 +63,204 @@ void test_journal_transfer(void)
     CU_ASSERT_STRING_EQUAL(buffer, JOURNAL_TRANSFER_MES);
 }
 
+void test_journal_transfer_query(void)
+{
+    pid_t pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+
+    if (pid == 0)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_transfer_rcv_query_and_write_file(JOURNAL_TRANSFER_SOCKET_PATH, JOURNAL_FILE_PATH, "status=ok p=50"), 0);
+        exit(EXIT_SUCCESS);
+    }
+    else
+    {
+        journal_t* journal = journal_create(JOURNAL_BUFFER_SIZE);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+        journal_entry_t entry = {.pid = 42, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 2.0};
+        CU_ASSERT_EQUAL_FATAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+        entry.status = JOURNAL_RECORD_STATUS_NOT_FOUND;
+        CU_ASSERT_EQUAL_FATAL(journal_write_entry(journal, &entry, "x", 1), JOURNAL_STATUS_SUCCESS);
+
+        CU_ASSERT_EQUAL(journal_transfer_run_receiver(JOURNAL_TRANSFER_SOCKET_PATH, journal), 0);
+
+        journal_delete(journal);
+    }
+
+    wait(NULL);
+
+    FILE* file = fopen(JOURNAL_FILE_PATH, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    char buffer[100];
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fgets(buffer, sizeof(buffer), file));
+    CU_ASSERT_STRING_EQUAL(buffer, "pid count avg max p50\n");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fgets(buffer, sizeof(buffer), file));
+    CU_ASSERT_STRING_EQUAL(buffer, "42 1 2.000 2.000 2.000\n");
+    fclose(file);
+}
+
+void test_journal_transfer_columnar(void)
+{
+    pid_t pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+
+    if (pid == 0)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_transfer_rcv_columnar_and_write_file(JOURNAL_TRANSFER_SOCKET_PATH, JOURNAL_FILE_PATH, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX), 0);
+        exit(EXIT_SUCCESS);
+    }
+    else
+    {
+        journal_t* journal = journal_create(1024 * 1024);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+        // More than one transfer chunk, so records are split between chunks
+        for (int i = 0; i < 5000; i++)
+        {
+            journal_entry_t entry = {.pid = i, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.5};
+            CU_ASSERT_EQUAL_FATAL(journal_write_entry(journal, &entry, "payload", 7), JOURNAL_STATUS_SUCCESS);
+        }
+
+        CU_ASSERT_EQUAL(journal_transfer_run_receiver(JOURNAL_TRANSFER_SOCKET_PATH, journal), 0);
+
+        journal_delete(journal);
+    }
+
+    wait(NULL);
+
+    journal_columnar_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_columnar_reader_open(JOURNAL_FILE_PATH, &reader), JOURNAL_COLUMNAR_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL_FATAL(reader.block_count, 2);
+    CU_ASSERT_EQUAL(reader.blocks[0].record_count + reader.blocks[1].record_count, 5000);
+    CU_ASSERT_EQUAL(reader.blocks[1].pid_max, 4999);
+    journal_columnar_reader_close(&reader);
+}
+
+void test_journal_transfer_large(void)
+{
+    // Payloads of many transfer chunks, file is written by splice in several steps
+    size_t count = 20000;
+    size_t expected_size = 0;
+
+    journal_t* journal = journal_create(4 * 1024 * 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+    for (size_t i = 0; i < count; i++)
+    {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "line %zu\n", i);
+        CU_ASSERT_EQUAL_FATAL(journal_write(journal, text, (size_t)length), JOURNAL_STATUS_SUCCESS);
+        expected_size += (size_t)length;
+    }
+
+    pid_t pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+    if (pid == 0)
+    {
+        exit(journal_transfer_run_receiver(JOURNAL_TRANSFER_SOCKET_PATH, journal) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    CU_ASSERT_EQUAL(journal_transfer_rcv_and_write_file(JOURNAL_TRANSFER_SOCKET_PATH, JOURNAL_FILE_PATH), 0);
+    waitpid(pid, NULL, 0);
+    journal_delete(journal);
+
+    FILE* file = fopen(JOURNAL_FILE_PATH, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    char line[32];
+    size_t lines = 0, size = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "line %zu\n", lines);
+        CU_ASSERT_STRING_EQUAL(line, expected);
+        size += strlen(line);
+        lines++;
+    }
+    fclose(file);
+
+    CU_ASSERT_EQUAL(lines, count);
+    CU_ASSERT_EQUAL(size, expected_size);
+}
+
+void test_journal_transfer_merge(void)
+{
+    const char* socket_paths[] = {"/tmp/journal_merge_0", "/tmp/journal_merge_1"};
+    journal_t* journals[2];
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        journals[i] = journal_create(1024 * 1024);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(journals[i]);
+    }
+
+    // Instances write in turns, so merged journal alternates between them
+    for (int i = 0; i < 10; i++)
+    {
+        for (size_t j = 0; j < 2; j++)
+        {
+            char text[32];
+            snprintf(text, sizeof(text), "%c%d\n", j ? 'b' : 'a', i);
+            CU_ASSERT_EQUAL_FATAL(journal_write(journals[j], text, strlen(text) + 1), JOURNAL_STATUS_SUCCESS);
+            usleep(2000);
+        }
+    }
+
+    // Sampled entries of first instance end with a summary record without text, it is not written to merged journal
+    journal_entry_t entry = {.pid = 10, .status = JOURNAL_RECORD_STATUS_OK, .cpu = 1.0};
+    CU_ASSERT_EQUAL(journal_set_sample_rate(journals[0], 1), JOURNAL_STATUS_SUCCESS);
+    for (int i = 0; i < 3; i++)
+    {
+        CU_ASSERT_EQUAL_FATAL(journal_write_entry(journals[0], &entry, "a10\n", strlen("a10\n") + 1), JOURNAL_STATUS_SUCCESS);
+    }
+    CU_ASSERT_EQUAL(journal_set_sample_rate(journals[0], 0), JOURNAL_STATUS_SUCCESS);
+
+    pid_t receivers[2];
+    for (size_t i = 0; i < 2; i++)
+    {
+        receivers[i] = fork();
+        CU_ASSERT_NOT_EQUAL_FATAL(receivers[i], -1);
+        if (receivers[i] == 0)
+        {
+            exit(journal_transfer_run_receiver(socket_paths[i], journals[i]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    CU_ASSERT_EQUAL(journal_transfer_rcv_merge_and_write_file(socket_paths, 2, JOURNAL_FILE_PATH, JOURNAL_TIME_MIN, JOURNAL_TIME_MAX), 0);
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        int status = 0;
+        waitpid(receivers[i], &status, 0);
+        CU_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+        journal_delete(journals[i]);
+    }
+
+    journal_reader_t reader;
+    CU_ASSERT_EQUAL_FATAL(journal_reader_open(JOURNAL_FILE_PATH, &reader), JOURNAL_READER_STATUS_SUCCESS);
+    journal_reader_iterator_t* iterator = (journal_reader_iterator_t*)malloc(sizeof(journal_reader_iterator_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(iterator);
+    journal_reader_iterator_init(&reader, iterator);
+
+    journal_reader_record_t record;
+    int count = 0;
+    while (journal_reader_next(iterator, &record))
+    {
+        char expected[32];
+        int length = snprintf(expected, sizeof(expected), "[%d] %c%d", count % 2, count % 2 ? 'b' : 'a', count / 2);
+        CU_ASSERT_EQUAL(record.source, count % 2);
+        CU_ASSERT_EQUAL(record.text_size, (size_t)length);
+        CU_ASSERT_EQUAL(strncmp(record.text, expected, record.text_size), 0);
+        count++;
+    }
+    CU_ASSERT_EQUAL(count, 21);
+
+    free(iterator);
+    journal_reader_close(&reader);
+}
+
 int main(void)
 {
     CU_pSuite pSuite = NULL;
@@ -77,7 +277,11 @@ int main(void)
         return CU_get_error();
     }
 
-    if ((NULL == CU_add_test(pSuite, "test_journal_transfer", test_journal_transfer)))
+    if ((NULL == CU_add_test(pSuite, "test_journal_transfer", test_journal_transfer))
+        || (NULL == CU_add_test(pSuite, "test_journal_transfer_query", test_journal_transfer_query))
+        || (NULL == CU_add_test(pSuite, "test_journal_transfer_columnar", test_journal_transfer_columnar))
+        || (NULL == CU_add_test(pSuite, "test_journal_transfer_large", test_journal_transfer_large))
+        || (NULL == CU_add_test(pSuite, "test_journal_transfer_merge", test_journal_transfer_merge)))
     {
         CU_cleanup_registry();
         return CU_get_error();
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "journal_uring.h"
+#include "utility.h"
+
+#define JOURNAL_URING_TEST_FILE "JOURNAL_URING_TEST.bin"
+
+// Several chunks and an unaligned tail
+#define TEST_LENGTH (3 * JOURNAL_URING_CHUNK_SIZE + 1234)
+
+static unsigned char test_byte(size_t i)
+{
+    return (unsigned char)((i * 131) ^ (i >> 12));
+}
+
+// Child sends sent bytes of the stream in small pieces and exits, returns socket of parent
+static int test_journal_uring_sender(size_t sent, pid_t* pid)
+{
+    int sockets[2];
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    *pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(*pid, -1);
+    if (*pid == 0)
+    {
+        close(sockets[0]);
+        unsigned char piece[10000];
+        for (size_t offset = 0; offset < sent;)
+        {
+            size_t size = sent - offset < sizeof(piece) ? sent - offset : sizeof(piece);
+            for (size_t i = 0; i < size; i++)
+            {
+                piece[i] = test_byte(offset + i);
+            }
+            ssize_t written = write(sockets[1], piece, size);
+            if (written <= 0)
+            {
+                _exit(EXIT_FAILURE);
+            }
+            offset += (size_t)written;
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(sockets[1]);
+    return sockets[0];
+}
+
+static void test_journal_uring_check_file(size_t length)
+{
+    struct stat file_stat;
+    CU_ASSERT_EQUAL_FATAL(stat(JOURNAL_URING_TEST_FILE, &file_stat), 0);
+    CU_ASSERT_EQUAL_FATAL((size_t)file_stat.st_size, length);
+
+    FILE* file = fopen(JOURNAL_URING_TEST_FILE, "rb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    size_t mismatch = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        mismatch += fgetc(file) != test_byte(i);
+    }
+    fclose(file);
+    CU_ASSERT_EQUAL(mismatch, 0);
+}
+
+// Returns 1 if stream is received, 0 if io_uring is not available
+static int test_journal_uring_receive(int flags)
+{
+    pid_t pid;
+    int sockfd = test_journal_uring_sender(TEST_LENGTH, &pid);
+
+    int fd = open(JOURNAL_URING_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC | flags, 0644);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+
+    uint64_t received = 0;
+    int result = journal_uring_recv_to_file(sockfd, fd, &received, TEST_LENGTH);
+    close(fd);
+    close(sockfd);
+    waitpid(pid, NULL, 0);
+
+    if (result == 1)
+    {
+        DEBUG_LOG("io_uring is not available");
+        unlink(JOURNAL_URING_TEST_FILE);
+        return 0;
+    }
+
+    CU_ASSERT_EQUAL(result, 0);
+    CU_ASSERT_EQUAL(received, TEST_LENGTH);
+    test_journal_uring_check_file(TEST_LENGTH);
+    unlink(JOURNAL_URING_TEST_FILE);
+
+    return 1;
+}
+
+void test_journal_uring_recv_to_file(void)
+{
+    test_journal_uring_receive(0);
+}
+
+void test_journal_uring_recv_to_file_direct(void)
+{
+    // File system of test directory may not support O_DIRECT
+    int fd = open(JOURNAL_URING_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd == -1)
+    {
+        DEBUG_LOG("O_DIRECT is not supported");
+        return;
+    }
+    close(fd);
+
+    test_journal_uring_receive(O_DIRECT);
+}
+
+void test_journal_uring_connection_closed(void)
+{
+    // Sender stops in the middle of second chunk
+    pid_t pid;
+    int sockfd = test_journal_uring_sender(JOURNAL_URING_CHUNK_SIZE + 100, &pid);
+
+    int fd = open(JOURNAL_URING_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+
+    uint64_t received = 0;
+    int result = journal_uring_recv_to_file(sockfd, fd, &received, TEST_LENGTH);
+    close(fd);
+    close(sockfd);
+    waitpid(pid, NULL, 0);
+    unlink(JOURNAL_URING_TEST_FILE);
+
+    if (result == 1)
+    {
+        DEBUG_LOG("io_uring is not available");
+        return;
+    }
+
+    CU_ASSERT_EQUAL(result, -1);
+    CU_ASSERT(received <= JOURNAL_URING_CHUNK_SIZE);
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("JournalUringTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "recv_to_file", test_journal_uring_recv_to_file)) || (NULL == CU_add_test(pSuite, "recv_to_file_direct", test_journal_uring_recv_to_file_direct))
+        || (NULL == CU_add_test(pSuite, "connection_closed", test_journal_uring_connection_closed)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "process_cpu_cache.h"
+#include "process_cpu_usage.h"
+#include "server_stats.h"
+#include "utility.h"
+
+void test_process_cpu_cache_staleness()
+{
+    process_cpu_cache_t* cache = process_cpu_cache_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    double cpu_usage = -1.0;
+    CU_ASSERT_FALSE(process_cpu_cache_get(cache, 42, 1000, &cpu_usage));
+
+    process_cpu_cache_put(cache, 42, 12.5);
+    CU_ASSERT_TRUE(process_cpu_cache_get(cache, 42, 1000, &cpu_usage));
+    CU_ASSERT_DOUBLE_EQUAL(12.5, cpu_usage, 1e-9);
+
+    // Result older than bound is not returned
+    usleep(30000);
+    CU_ASSERT_FALSE(process_cpu_cache_get(cache, 42, 10, &cpu_usage));
+    CU_ASSERT_TRUE(process_cpu_cache_get(cache, 42, 1000, &cpu_usage));
+
+    process_cpu_cache_put(cache, 42, 20.0);
+    CU_ASSERT_TRUE(process_cpu_cache_get(cache, 42, 10, &cpu_usage));
+    CU_ASSERT_DOUBLE_EQUAL(20.0, cpu_usage, 1e-9);
+
+    CU_ASSERT_EQUAL(3, cache->hits);
+    CU_ASSERT_EQUAL(2, cache->misses);
+
+    process_cpu_cache_delete(cache);
+}
+
+void test_process_cpu_cache_bounded()
+{
+    process_cpu_cache_t* cache = process_cpu_cache_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    for (pid_t pid = 1; pid <= 1000; pid++)
+    {
+        process_cpu_cache_put(cache, pid, (double)pid);
+    }
+
+    size_t count = 0;
+    for (pid_t pid = 1; pid <= 1000; pid++)
+    {
+        double cpu_usage = -1.0;
+        if (process_cpu_cache_get(cache, pid, 60000, &cpu_usage))
+        {
+            CU_ASSERT_DOUBLE_EQUAL((double)pid, cpu_usage, 1e-9);
+            count++;
+        }
+    }
+    CU_ASSERT_EQUAL(16, count);
+
+    // Result of pid replaces its previous result in place
+    process_cpu_cache_put(cache, 1000, 1.0);
+    double cpu_usage = -1.0;
+    CU_ASSERT_TRUE(process_cpu_cache_get(cache, 1000, 60000, &cpu_usage));
+    CU_ASSERT_DOUBLE_EQUAL(1.0, cpu_usage, 1e-9);
+
+    process_cpu_cache_delete(cache);
+}
+
+void test_process_cpu_cache_shared()
+{
+    process_cpu_cache_t* cache = process_cpu_cache_create(1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    // Results published by forked processes are seen by parent and by each other
+    for (int child_index = 0; child_index < 2; child_index++)
+    {
+        pid_t child = fork();
+        if (child == 0)
+        {
+            for (pid_t pid = 1; pid <= 100; pid++)
+            {
+                process_cpu_cache_put(cache, pid + child_index * 100, (double)(pid + child_index * 100));
+            }
+
+            double cpu_usage = -1.0;
+            _exit(child_index == 1 && !process_cpu_cache_get(cache, 50, 60000, &cpu_usage) ? 1 : 0);
+        }
+        CU_ASSERT_TRUE_FATAL(child > 0);
+
+        int status = -1;
+        waitpid(child, &status, 0);
+        CU_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    size_t count = 0;
+    for (pid_t pid = 1; pid <= 200; pid++)
+    {
+        double cpu_usage = -1.0;
+        if (process_cpu_cache_get(cache, pid, 60000, &cpu_usage))
+        {
+            CU_ASSERT_DOUBLE_EQUAL((double)pid, cpu_usage, 1e-9);
+            count++;
+        }
+    }
+    CU_ASSERT_EQUAL(200, count);
+    CU_ASSERT_EQUAL(200, cache->hits);
+
+    process_cpu_cache_delete(cache);
+}
+
+// Pid of a child which has exited and is reaped, so the pid does not exist
+static pid_t test_process_cpu_cache_gone_pid(void)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+
+    return pid;
+}
+
+void test_process_cpu_cache_missing()
+{
+    process_cpu_cache_t* cache = process_cpu_cache_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    pid_t pid = test_process_cpu_cache_gone_pid();
+    CU_ASSERT_FATAL(pid > 0);
+    CU_ASSERT_FALSE(process_cpu_cache_missing(cache, pid, 1000));
+
+    process_cpu_cache_put(cache, pid, -1.0);
+    CU_ASSERT_TRUE(process_cpu_cache_missing(cache, pid, 1000));
+
+    // Missing pid is not a result for staleness bound
+    double cpu_usage = 0.0;
+    CU_ASSERT_FALSE(process_cpu_cache_get(cache, pid, 1000, &cpu_usage));
+
+    // Missing expires after ttl
+    usleep(30000);
+    CU_ASSERT_FALSE(process_cpu_cache_missing(cache, pid, 10));
+    CU_ASSERT_TRUE(process_cpu_cache_missing(cache, pid, 1000));
+
+    // Pid which appeared is not missing any more
+    process_cpu_cache_put(cache, pid, 3.0);
+    CU_ASSERT_FALSE(process_cpu_cache_missing(cache, pid, 1000));
+    CU_ASSERT_TRUE(process_cpu_cache_get(cache, pid, 1000, &cpu_usage));
+    CU_ASSERT_DOUBLE_EQUAL(3.0, cpu_usage, 1e-9);
+
+    process_cpu_cache_delete(cache);
+}
+
+void test_process_cpu_cache_missing_created()
+{
+    process_cpu_cache_t* cache = process_cpu_cache_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    int pipefd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(pipefd), 0);
+    pid_t pid = fork();
+    CU_ASSERT_FATAL(pid >= 0);
+    if (pid == 0)
+    {
+        char byte;
+        close(pipefd[1]);
+        read(pipefd[0], &byte, 1);
+        _exit(0);
+    }
+    close(pipefd[0]);
+
+    // Pid was not found before the process was created with it: it is dropped from cache and measured
+    process_cpu_cache_put(cache, pid, -1.0);
+    CU_ASSERT_FALSE(process_cpu_cache_missing(cache, pid, 1000));
+    CU_ASSERT_TRUE(get_process_cpu_usage(pid) >= 0.0);
+
+    close(pipefd[1]);
+    waitpid(pid, NULL, 0);
+
+    process_cpu_cache_put(cache, pid, -1.0);
+    CU_ASSERT_TRUE(process_cpu_cache_missing(cache, pid, 1000));
+
+    process_cpu_cache_delete(cache);
+}
+
+void test_server_stats_shared()
+{
+    CU_ASSERT_PTR_NULL(server_stats_create(0));
+    CU_ASSERT_PTR_NULL(server_stats_create(SERVER_STATS_MAX_WORKERS + 1));
+
+    server_stats_t* stats = server_stats_create(2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stats);
+    CU_ASSERT_PTR_NULL(server_stats_worker(stats, 2));
+
+    // Counters written by child process are seen by parent
+    pid_t child = fork();
+    if (child == 0)
+    {
+        server_stats_worker_t* worker = server_stats_worker(stats, 1);
+        server_stats_increment(&worker->cache_hits);
+        server_stats_increment(&worker->cache_hits);
+        server_stats_increment(&worker->cache_misses);
+        server_stats_set(&worker->coalesced, 5);
+        _exit(0);
+    }
+    CU_ASSERT_TRUE_FATAL(child > 0);
+    waitpid(child, NULL, 0);
+
+    server_stats_increment(&server_stats_worker(stats, 0)->cache_misses);
+
+    size_t length = 0;
+    char* text = server_stats_to_string(stats, &length);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+    CU_ASSERT_EQUAL(strlen(text), length);
+    CU_ASSERT_STRING_EQUAL("worker cache_hits cache_misses coalesced missing\n0 0 1 0 0\n1 2 1 5 0\ntotal 2 2 5 0\n", text);
+
+    SAFE_FREE(text);
+    server_stats_delete(stats);
+}
+
+int main(void)
+{
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    CU_pSuite suite = CU_add_suite("ProcessCPUCacheTest", NULL, NULL);
+    if (NULL == suite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(suite, "test_process_cpu_cache_staleness", test_process_cpu_cache_staleness))
+        || (NULL == CU_add_test(suite, "test_process_cpu_cache_bounded", test_process_cpu_cache_bounded))
+        || (NULL == CU_add_test(suite, "test_process_cpu_cache_shared", test_process_cpu_cache_shared))
+        || (NULL == CU_add_test(suite, "test_process_cpu_cache_missing", test_process_cpu_cache_missing))
+        || (NULL == CU_add_test(suite, "test_process_cpu_cache_missing_created", test_process_cpu_cache_missing_created))
+        || (NULL == CU_add_test(suite, "test_server_stats_shared", test_server_stats_shared)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,356 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "process_cpu_engine.h"
+#include "utility.h"
+
+#define TEST_MEASUREMENTS 100
+
+typedef struct test_results
+{
+    size_t count;
+    size_t failed;
+    unsigned window_ms;    // of last result
+} test_results_t;
+
+static void test_on_measured(void* context, pid_t pid, double cpu_usage, unsigned window_ms)
+{
+    test_results_t* results = (test_results_t*)context;
+
+    DEBUG_LOG("CPU usage for PID %d: %.2f%% over %u ms", pid, cpu_usage, window_ms);
+
+    results->count++;
+    results->window_ms = window_ms;
+    if (cpu_usage < 0.0 || pid != getpid())
+    {
+        results->failed++;
+    }
+}
+
+void test_process_cpu_engine_measure()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+    CU_ASSERT_TRUE(process_cpu_engine_fd(engine) >= 0);
+
+    test_results_t results = {0};
+    for (int i = 0; i < TEST_MEASUREMENTS; i++)
+    {
+        CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &results));
+    }
+    CU_ASSERT_EQUAL(TEST_MEASUREMENTS, engine->in_use);
+    CU_ASSERT_EQUAL(0, results.count);
+
+    // All measurements are in flight at once, they finish after one window and not one window each
+    for (int i = 0; i < 100 && results.count < TEST_MEASUREMENTS; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+
+    CU_ASSERT_EQUAL(TEST_MEASUREMENTS, results.count);
+    CU_ASSERT_EQUAL(0, results.failed);
+    CU_ASSERT_EQUAL(0, engine->pending);
+    CU_ASSERT_EQUAL(0, engine->in_use);
+
+    process_cpu_engine_delete(engine);
+}
+
+typedef struct test_coalesced
+{
+    size_t count;
+    double cpu_usage[TEST_MEASUREMENTS];
+} test_coalesced_t;
+
+static void test_on_coalesced(void* context, pid_t pid, double cpu_usage, unsigned window_ms)
+{
+    (void)pid;
+    (void)window_ms;
+    test_coalesced_t* results = (test_coalesced_t*)context;
+    results->cpu_usage[results->count++] = cpu_usage;
+}
+
+void test_process_cpu_engine_coalesce()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+
+    // Burst of the same pid is one measurement, every start gets its result
+    test_coalesced_t results = {0};
+    for (int i = 0; i < 50; i++)
+    {
+        CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_coalesced, &results));
+    }
+    test_coalesced_t other = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getppid(), test_on_coalesced, &other));
+    CU_ASSERT_EQUAL(2, engine->pending);
+    CU_ASSERT_EQUAL(51, engine->in_use);
+    CU_ASSERT_EQUAL(49, engine->coalesced);
+
+    size_t finished = 0;
+    for (int i = 0; i < 100 && results.count + other.count < 51; i++)
+    {
+        finished += process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(51, finished);
+    CU_ASSERT_EQUAL(50, results.count);
+    CU_ASSERT_EQUAL(1, other.count);
+    CU_ASSERT_EQUAL(0, engine->in_use);
+
+    // Coalesced starts get result of the same measurement
+    for (size_t i = 1; i < results.count; i++)
+    {
+        CU_ASSERT_EQUAL(results.cpu_usage[0], results.cpu_usage[i]);
+    }
+
+    // Pid is not in flight after its measurement, next start measures again
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_coalesced, &results));
+    CU_ASSERT_EQUAL(1, engine->pending);
+    CU_ASSERT_EQUAL(49, engine->coalesced);
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_schedstat()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+    process_cpu_engine_set_window(engine, PROCESS_CPU_BACKEND_SCHEDSTAT, 2);
+
+    // Backends of the same pid are not coalesced, schedstat measurement finishes after its short window
+    test_results_t ticks = {0};
+    test_results_t schedstat = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &ticks));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS,
+                    process_cpu_engine_start_backend(engine, getpid(), PROCESS_CPU_BACKEND_SCHEDSTAT, test_on_measured, &schedstat));
+    CU_ASSERT_EQUAL(2, engine->pending);
+    CU_ASSERT_EQUAL(0, engine->coalesced);
+
+    for (int i = 0; i < 100 && schedstat.count < 1; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(1, schedstat.count);
+    CU_ASSERT_EQUAL(0, schedstat.failed);
+    CU_ASSERT_EQUAL(0, ticks.count);
+
+    for (int i = 0; i < 100 && ticks.count < 1; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(1, ticks.count);
+    CU_ASSERT_EQUAL(0, ticks.failed);
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NOT_FOUND,
+                    process_cpu_engine_start_backend(engine, 999999999, PROCESS_CPU_BACKEND_SCHEDSTAT, test_on_measured, &schedstat));
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_adaptive_busy()
+{
+    // Server defaults: first sample after 5 ms, relative error target 50 percent (about 4 process ticks)
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+    process_cpu_engine_set_window(engine, PROCESS_CPU_BACKEND_TICKS, 5);
+    process_cpu_engine_set_accuracy(engine, 160, 50);
+
+    pid_t busy = fork();
+    CU_ASSERT_TRUE_FATAL(busy >= 0);
+    if (busy == 0)
+    {
+        for (;;)
+            ;
+    }
+
+    // Idle process has no ticks and is measured up to the cap
+    test_results_t idle = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getppid(), test_on_measured, &idle));
+
+    // Busy process collects enough ticks before the cap even if it runs on one of many cpus (80 ms window has 8 of them at 100 Hz)
+    usleep(15000);
+    test_results_t spinning = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, busy, test_on_measured, &spinning));
+    for (int i = 0; i < 1000 && (spinning.count == 0 || idle.count == 0); i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    kill(busy, SIGKILL);
+    waitpid(busy, NULL, 0);
+
+    CU_ASSERT_EQUAL(1, spinning.count);
+    CU_ASSERT_TRUE(spinning.window_ms >= 5 && spinning.window_ms < 160);
+    CU_ASSERT_EQUAL(1, idle.count);
+    CU_ASSERT_TRUE(idle.window_ms >= 160);
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_adaptive()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+    process_cpu_engine_set_window(engine, PROCESS_CPU_BACKEND_TICKS, 2);
+    process_cpu_engine_set_accuracy(engine, 120, 100);
+
+    pid_t busy = fork();
+    CU_ASSERT_TRUE_FATAL(busy >= 0);
+    if (busy == 0)
+    {
+        for (;;)
+            ;
+    }
+
+    // Idle process has no ticks to count and is measured over the whole max window, busy one gets enough ticks early
+    test_results_t idle = {0};
+    test_results_t spinning = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getppid(), test_on_measured, &idle));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, busy, test_on_measured, &spinning));
+
+    // Wait returns after every tick of the timer, loop is longer than max window
+    for (int i = 0; i < 1000 && idle.count + spinning.count < 2; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    kill(busy, SIGKILL);
+    waitpid(busy, NULL, 0);
+
+    CU_ASSERT_EQUAL(1, idle.count);
+    CU_ASSERT_EQUAL(1, spinning.count);
+    CU_ASSERT_TRUE(idle.window_ms >= 120);
+    CU_ASSERT_TRUE(spinning.window_ms >= 2 && spinning.window_ms < 120);
+    CU_ASSERT_EQUAL(0, engine->pending);
+
+    // Without accuracy target window is fixed
+    process_cpu_engine_set_accuracy(engine, 120, 0);
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &idle));
+    for (int i = 0; i < 100 && idle.count < 2; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(2, idle.count);
+    CU_ASSERT_TRUE(idle.window_ms >= 2 && idle.window_ms < 120);
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_taskstats()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(10, TEST_MEASUREMENTS);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+
+    // Without TASKSTATS interface measurement falls back to procfs and still gets result
+    test_results_t results = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS,
+                    process_cpu_engine_start_backend(engine, getpid(), PROCESS_CPU_BACKEND_TASKSTATS, test_on_measured, &results));
+    for (int i = 0; i < 100 && results.count < 1; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(1, results.count);
+    CU_ASSERT_EQUAL(0, results.failed);
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NOT_FOUND,
+                    process_cpu_engine_start_backend(engine, 999999999, PROCESS_CPU_BACKEND_TASKSTATS, test_on_measured, &results));
+
+    // Taskstats (or procfs it falls back to) has adaptive window: idle process is measured up to max window
+    process_cpu_engine_set_window(engine, PROCESS_CPU_BACKEND_TASKSTATS, 5);
+    process_cpu_engine_set_accuracy(engine, 40, 50);
+    test_results_t idle = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start_backend(engine, getppid(), PROCESS_CPU_BACKEND_TASKSTATS, test_on_measured, &idle));
+    for (int i = 0; i < 1000 && idle.count < 1; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(1, idle.count);
+    CU_ASSERT_TRUE(idle.window_ms >= 40);
+
+    long long procfs_ns = process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TICKS, getpid(), 10);
+    long long taskstats_ns = process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TASKSTATS, getpid(), 10);
+    DEBUG_LOG("Sample cost: procfs %lld ns, taskstats %lld ns", procfs_ns, taskstats_ns);
+
+    CU_ASSERT_TRUE(procfs_ns > 0);
+    CU_ASSERT_TRUE(taskstats_ns > 0 || (taskstats_ns == -1 && !engine->taskstats));
+    CU_ASSERT_EQUAL(-1, process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TICKS, 999999999, 10));
+    CU_ASSERT_EQUAL(-1, process_cpu_engine_sample_cost_ns(engine, PROCESS_CPU_BACKEND_TICKS, getpid(), 0));
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_invalid_pid()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(20, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+
+    test_results_t results = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NOT_FOUND, process_cpu_engine_start(engine, 999999999, test_on_measured, &results));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_PARAMS_NULL, process_cpu_engine_start(engine, getpid(), NULL, &results));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_PARAMS_NULL, process_cpu_engine_start(NULL, getpid(), test_on_measured, &results));
+    CU_ASSERT_EQUAL(0, engine->pending);
+
+    // Nothing is pending, wait returns without callbacks
+    CU_ASSERT_EQUAL(0, process_cpu_engine_wait(engine, 0));
+    CU_ASSERT_EQUAL(0, results.count);
+
+    process_cpu_engine_delete(engine);
+}
+
+void test_process_cpu_engine_full()
+{
+    process_cpu_engine_t* engine = process_cpu_engine_create(10, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(engine);
+    CU_ASSERT_PTR_NULL(process_cpu_engine_create(10, 0));
+
+    test_results_t results = {0};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &results));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &results));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_FULL, process_cpu_engine_start(engine, getpid(), test_on_measured, &results));
+
+    for (int i = 0; i < 100 && results.count < 2; i++)
+    {
+        process_cpu_engine_wait(engine, 100);
+    }
+    CU_ASSERT_EQUAL(2, results.count);
+
+    // Finished measurements are returned to pool
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_engine_start(engine, getpid(), test_on_measured, &results));
+
+    process_cpu_engine_delete(engine);
+}
+
+int main(void)
+{
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    CU_pSuite suite = CU_add_suite("ProcessCPUEngineTest", NULL, NULL);
+    if (NULL == suite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(suite, "test_process_cpu_engine_measure", test_process_cpu_engine_measure))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_coalesce", test_process_cpu_engine_coalesce))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_schedstat", test_process_cpu_engine_schedstat))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_adaptive", test_process_cpu_engine_adaptive))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_adaptive_busy", test_process_cpu_engine_adaptive_busy))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_taskstats", test_process_cpu_engine_taskstats))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_invalid_pid", test_process_cpu_engine_invalid_pid))
+        || (NULL == CU_add_test(suite, "test_process_cpu_engine_full", test_process_cpu_engine_full)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "process_cpu_samples.h"
+#include "utility.h"
+
+void test_process_cpu_samples_delta()
+{
+    process_cpu_samples_t* samples = process_cpu_samples_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(samples);
+
+    double cpu_usage = -1.0;
+    int64_t window_ms = -1;
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NO_SAMPLE, process_cpu_samples_delta(samples, getpid(), &cpu_usage, &window_ms));
+    CU_ASSERT_EQUAL(1, samples->count);
+
+    // Spin to have some cpu time in window
+    volatile unsigned long counter = 0;
+    for (unsigned long i = 0; i < 50000000UL; i++)
+    {
+        counter += i;
+    }
+    usleep(20000);
+
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_samples_delta(samples, getpid(), &cpu_usage, &window_ms));
+    DEBUG_LOG("CPU usage since previous request: %.2f%% over %lld ms", cpu_usage, (long long)window_ms);
+    CU_ASSERT_TRUE(cpu_usage >= 0.0);
+    CU_ASSERT_TRUE(window_ms >= 20);
+    CU_ASSERT_EQUAL(1, samples->count);
+
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NOT_FOUND, process_cpu_samples_delta(samples, 999999999, &cpu_usage, &window_ms));
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_PARAMS_NULL, process_cpu_samples_delta(NULL, getpid(), &cpu_usage, &window_ms));
+
+    process_cpu_samples_delete(samples);
+}
+
+void test_process_cpu_samples_bounded()
+{
+    process_cpu_samples_t* samples = process_cpu_samples_create(16);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(samples);
+
+    process_cpu_sample_t previous;
+    for (pid_t pid = 1; pid <= 1000; pid++)
+    {
+        process_cpu_sample_t sample = {.pid = pid, .process = pid, .total = 1000, .time_ms = pid};
+        CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_NO_SAMPLE, process_cpu_samples_exchange(samples, &sample, &previous));
+    }
+    CU_ASSERT_EQUAL(16, samples->count);
+
+    // Newest sample is kept, it is returned and replaced by exchange
+    process_cpu_sample_t sample = {.pid = 1000, .process = 2000, .total = 3000, .time_ms = 2000};
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_samples_exchange(samples, &sample, &previous));
+    CU_ASSERT_EQUAL(1000, previous.pid);
+    CU_ASSERT_EQUAL(1000, previous.process);
+    CU_ASSERT_EQUAL(1000, previous.time_ms);
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_SUCCESS, process_cpu_samples_exchange(samples, &sample, &previous));
+    CU_ASSERT_EQUAL(2000, previous.process);
+
+    sample.pid = 0;
+    CU_ASSERT_EQUAL(PROCESS_CPU_STATUS_ERROR_PARAMS_NULL, process_cpu_samples_exchange(samples, &sample, &previous));
+
+    process_cpu_samples_delete(samples);
+}
+
+int main(void)
+{
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    CU_pSuite suite = CU_add_suite("ProcessCPUSamplesTest", NULL, NULL);
+    if (NULL == suite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(suite, "test_process_cpu_samples_delta", test_process_cpu_samples_delta))
+        || (NULL == CU_add_test(suite, "test_process_cpu_samples_bounded", test_process_cpu_samples_bounded)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "process_cpu_taskstats.h"
+#include "process_cpu_usage.h"
+#include "utility.h"
+
+void test_process_cpu_taskstats_time()
+{
+    // Interface needs CONFIG_TASKSTATS and CAP_NET_ADMIN, without them create returns NULL and procfs is used
+    process_cpu_taskstats_t* taskstats = process_cpu_taskstats_create();
+    if (!taskstats)
+    {
+        DEBUG_LOG("TASKSTATS is not available");
+        CU_ASSERT_EQUAL(-1, process_cpu_taskstats_time(NULL, getpid()));
+        return;
+    }
+
+    // Burn some cpu, both sources count the same user and system time
+    volatile unsigned long counter = 0;
+    long long start = process_cpu_monotonic_ns();
+    while (process_cpu_monotonic_ns() - start < 50000000LL)
+    {
+        counter++;
+    }
+
+    long long time_us = process_cpu_taskstats_time(taskstats, getpid());
+    long long ticks = process_cpu_process_time(getpid());
+    long long ticks_us = ticks * 1000000LL / sysconf(_SC_CLK_TCK);
+    DEBUG_LOG("Taskstats time %lld us, procfs time %lld us", time_us, ticks_us);
+
+    CU_ASSERT_TRUE(time_us > 0);
+    CU_ASSERT_TRUE(llabs(time_us - ticks_us) < 100000);
+
+    CU_ASSERT_TRUE(process_cpu_taskstats_time(taskstats, getppid()) >= 0);
+    CU_ASSERT_EQUAL(-1, process_cpu_taskstats_time(taskstats, 999999999));
+    CU_ASSERT_EQUAL(-1, process_cpu_taskstats_time(taskstats, 0));
+
+    // Socket is kept open between samples
+    for (int i = 0; i < 100; i++)
+    {
+        CU_ASSERT_TRUE(process_cpu_taskstats_time(taskstats, getpid()) >= time_us);
+    }
+
+    process_cpu_taskstats_delete(taskstats);
+    process_cpu_taskstats_delete(NULL);
+}
+
+int main(void)
+{
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    CU_pSuite suite = CU_add_suite("ProcessCPUTaskstatsTest", NULL, NULL);
+    if (NULL == suite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (NULL == CU_add_test(suite, "test_process_cpu_taskstats_time", test_process_cpu_taskstats_time))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
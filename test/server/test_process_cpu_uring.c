@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <CUnit/CUnit.h>
+
+#include "process_cpu_uring.h"
+#include "process_cpu_usage.h"
+#include "utility.h"
+
+#define TEST_PIDS 300
+
+// Files in fixed slots of ring, listed in its fdinfo between UserFiles and UserBufs, -1 if fdinfo has no such list
+static int test_process_cpu_uring_fixed_files(const process_cpu_uring_t* uring)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", uring->fd);
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+
+    int files = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned slot;
+        if (strncmp(line, "UserFiles:", strlen("UserFiles:")) == 0)
+        {
+            files = 0;
+        }
+        else if (strncmp(line, "UserBufs:", strlen("UserBufs:")) == 0)
+        {
+            break;
+        }
+        else if (files >= 0 && sscanf(line, " %u:", &slot) == 1)
+        {
+            files++;
+        }
+    }
+    fclose(file);
+
+    return files;
+}
+
+void test_process_cpu_uring_process_times()
+{
+    // Without io_uring (old kernel, io_uring_disabled) create returns NULL and files are read one by one
+    process_cpu_uring_t* uring = process_cpu_uring_create();
+    if (!uring)
+    {
+        DEBUG_LOG("io_uring is not available");
+        return;
+    }
+
+    // More pids than one batch, every second one does not exist
+    pid_t pids[TEST_PIDS];
+    long long times[TEST_PIDS];
+    for (int i = 0; i < TEST_PIDS; i++)
+    {
+        pids[i] = i % 2 == 0 ? getpid() : 999999999 - i;
+    }
+
+    CU_ASSERT_EQUAL(TEST_PIDS / 2, process_cpu_uring_process_times(uring, pids, TEST_PIDS, times));
+    CU_ASSERT_EQUAL(0, uring->failed);
+
+    long long now = process_cpu_process_time(getpid());
+    for (int i = 0; i < TEST_PIDS; i++)
+    {
+        if (i % 2 == 0)
+        {
+            CU_ASSERT_TRUE(times[i] >= 0 && times[i] <= now);
+        }
+        else
+        {
+            CU_ASSERT_EQUAL(-1, times[i]);
+        }
+    }
+
+    // Fixed file slots are closed by chains, the ring is reused
+    for (int i = 0; i < 10; i++)
+    {
+        CU_ASSERT_EQUAL(TEST_PIDS / 2, process_cpu_uring_process_times(uring, pids, TEST_PIDS, times));
+    }
+    CU_ASSERT_EQUAL(0, uring->failed);
+
+    // Close of every chain has run, no file is left in fixed slots, also after short read (stat of init is usually shorter than buffer)
+    pid_t short_pids[2] = {1, getpid()};
+    process_cpu_uring_process_times(uring, short_pids, 2, times);
+    int files = test_process_cpu_uring_fixed_files(uring);
+    CU_ASSERT_TRUE(files == 0 || files == -1);
+
+    // Batch of pids that are all gone is not a failure of the ring
+    pid_t gone_pids[2] = {999999999, 999999998};
+    CU_ASSERT_EQUAL(0, process_cpu_uring_process_times(uring, gone_pids, 2, times));
+    CU_ASSERT_EQUAL(0, uring->failed);
+
+    CU_ASSERT_EQUAL(0, process_cpu_uring_process_times(NULL, pids, TEST_PIDS, times));
+
+    process_cpu_uring_delete(uring);
+    process_cpu_uring_delete(NULL);
+}
+
+int main(void)
+{
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    CU_pSuite suite = CU_add_suite("ProcessCPUUringTest", NULL, NULL);
+    if (NULL == suite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if (NULL == CU_add_test(suite, "test_process_cpu_uring_process_times", test_process_cpu_uring_process_times))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -1,6 +1,10 @@
+#include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <CUnit/Basic.h>
@@ -43,6 +47,123 @@ void test_get_process_cpu_usage_zero_elapsed_time()
     }
 }
 
+void test_get_process_cpu_usage_schedstat()
+{
+    pid_t pid = getpid();
+    double cpu_usage = get_process_cpu_usage_backend(pid, PROCESS_CPU_BACKEND_SCHEDSTAT);
+
+    DEBUG_LOG("Schedstat CPU usage for PID %d: %.2f%%", pid, cpu_usage);
+
+    CU_ASSERT_TRUE(cpu_usage >= 0.0);
+    CU_ASSERT_TRUE(process_cpu_schedstat_time(pid) >= 0);
+    CU_ASSERT_EQUAL(-1, process_cpu_schedstat_time(999999999));
+    CU_ASSERT_EQUAL(-1.0, get_process_cpu_usage_backend(999999999, PROCESS_CPU_BACKEND_SCHEDSTAT));
+}
+
+static void* test_spin_thread(void* arg)
+{
+    volatile int* stop = (volatile int*)arg;
+    while (!*stop)
+    {
+    }
+    return NULL;
+}
+
+void test_process_cpu_schedstat_threads()
+{
+    // Time of a busy thread is counted while the main thread sleeps
+    volatile int stop = 0;
+    long long start = process_cpu_schedstat_time(getpid());
+    pthread_t thread;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, test_spin_thread, (void*)&stop), 0);
+    usleep(50000);
+    long long end = process_cpu_schedstat_time(getpid());
+    stop = 1;
+    pthread_join(thread, NULL);
+
+    CU_ASSERT_TRUE(start >= 0);
+    CU_ASSERT_TRUE(end - start >= 30000000LL);
+    CU_ASSERT_DOUBLE_EQUAL(0.0, process_cpu_ns_usage(-1000, 2000000), 0.0001);
+}
+
+void test_process_cpu_ns_usage()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // One cpu busy for the whole window is 100% of one cpu out of all of them
+    CU_ASSERT_DOUBLE_EQUAL(100.0 / (double)cpus, process_cpu_ns_usage(2000000, 2000000), 0.0001);
+    CU_ASSERT_DOUBLE_EQUAL(0.0, process_cpu_ns_usage(0, 2000000), 0.0001);
+    CU_ASSERT_DOUBLE_EQUAL(0.0, process_cpu_ns_usage(1000, 0), 0.0001);
+}
+
+void test_process_cpu_process_times()
+{
+    pid_t pids[] = {getpid(), 999999999, getppid(), 1};
+    long long times[4];
+
+    // Batch is read with io_uring where kernel has it, result is the same as of one by one reads
+    CU_ASSERT_EQUAL(3, process_cpu_process_times(pids, 4, times));
+    CU_ASSERT_TRUE(times[0] >= 0 && times[0] <= process_cpu_process_time(getpid()));
+    CU_ASSERT_EQUAL(-1, times[1]);
+    CU_ASSERT_TRUE(times[2] >= 0 && times[2] <= process_cpu_process_time(getppid()));
+    CU_ASSERT_TRUE(times[3] >= 0 && times[3] <= process_cpu_process_time(1));
+    CU_ASSERT_EQUAL(0, process_cpu_process_times(pids, 0, times));
+
+    CU_ASSERT_EQUAL(5, process_cpu_parse_process_time("1 (init) S 0 1 1 0 -1 4194560 100 0 0 0 2 3 0 0 20 0 1 0"));
+    CU_ASSERT_EQUAL(-1, process_cpu_parse_process_time("1 (init) S"));
+}
+
+// Open io_uring instances of this process
+static int test_uring_fds(void)
+{
+    DIR* fds = opendir("/proc/self/fd");
+    if (!fds)
+    {
+        return -1;
+    }
+
+    int count = 0;
+    struct dirent* fd;
+    while ((fd = readdir(fds)) != NULL)
+    {
+        char path[300];
+        char target[64] = {0};
+        snprintf(path, sizeof(path), "/proc/self/fd/%s", fd->d_name);
+        if (readlink(path, target, sizeof(target) - 1) > 0 && strcmp(target, "anon_inode:[io_uring]") == 0)
+        {
+            count++;
+        }
+    }
+    closedir(fds);
+
+    return count;
+}
+
+void test_process_cpu_process_times_fork()
+{
+    pid_t self = getpid();
+    long long time;
+    CU_ASSERT_EQUAL(1, process_cpu_process_times(&self, 1, &time));
+    int parent_fds = test_uring_fds();
+
+    // Child replaces the ring it inherited with its own instead of keeping both open
+    pid_t child = fork();
+    CU_ASSERT_TRUE_FATAL(child >= 0);
+    if (child == 0)
+    {
+        pid_t pid = getpid();
+        int found = process_cpu_process_times(&pid, 1, &time);
+        _exit(found == 1 && test_uring_fds() == parent_fds ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    CU_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+    CU_ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+    // Ring of parent still works
+    CU_ASSERT_EQUAL(1, process_cpu_process_times(&self, 1, &time));
+}
+
 int main(void)
 {
     if (CUE_SUCCESS != CU_initialize_registry())
@@ -59,7 +180,12 @@ int main(void)
 
     if ((NULL == CU_add_test(suite, "test_get_process_cpu_usage_valid_pid", test_get_process_cpu_usage_valid_pid))
         || (NULL == CU_add_test(suite, "test_get_process_cpu_usage_invalid_pid", test_get_process_cpu_usage_invalid_pid))
-        || (NULL == CU_add_test(suite, "test_get_process_cpu_usage_zero_elapsed_time", test_get_process_cpu_usage_zero_elapsed_time)))
+        || (NULL == CU_add_test(suite, "test_get_process_cpu_usage_zero_elapsed_time", test_get_process_cpu_usage_zero_elapsed_time))
+        || (NULL == CU_add_test(suite, "test_get_process_cpu_usage_schedstat", test_get_process_cpu_usage_schedstat))
+        || (NULL == CU_add_test(suite, "test_process_cpu_schedstat_threads", test_process_cpu_schedstat_threads))
+        || (NULL == CU_add_test(suite, "test_process_cpu_ns_usage", test_process_cpu_ns_usage))
+        || (NULL == CU_add_test(suite, "test_process_cpu_process_times", test_process_cpu_process_times))
+        || (NULL == CU_add_test(suite, "test_process_cpu_process_times_fork", test_process_cpu_process_times_fork)))
     {
         CU_cleanup_registry();
         return CU_get_error();
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+
+#include "crc32c.h"
+
+// Bitwise CRC-32C to check table and hardware implementations against
+static uint32_t crc32c_reference(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void test_crc32c_known_values(void)
+{
+    CU_ASSERT_EQUAL(crc32c(0, "", 0), 0);
+    CU_ASSERT_EQUAL(crc32c(0, "123456789", 9), 0xE3069283u);
+
+    uint8_t zeros[32];
+    memset(zeros, 0, sizeof(zeros));
+    CU_ASSERT_EQUAL(crc32c(0, zeros, sizeof(zeros)), 0x8A9136AAu);
+
+    printf("crc32c hardware: %d\n", crc32c_hardware());
+}
+
+void test_crc32c_lengths_and_alignment(void)
+{
+    uint8_t data[300];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    for (size_t start = 0; start < 8; start++)
+    {
+        for (size_t length = 0; start + length <= sizeof(data); length += 13)
+        {
+            CU_ASSERT_EQUAL(crc32c(0, data + start, length), crc32c_reference(data + start, length));
+        }
+    }
+}
+
+void test_crc32c_continue(void)
+{
+    const char* text = "The quick brown fox jumps over the lazy dog";
+    size_t length = strlen(text);
+
+    uint32_t crc = crc32c(0, text, 10);
+    crc = crc32c(crc, text + 10, length - 10);
+    CU_ASSERT_EQUAL(crc, crc32c(0, text, length));
+}
+
+int main(void)
+{
+    CU_pSuite pSuite = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry())
+    {
+        return CU_get_error();
+    }
+
+    pSuite = CU_add_suite("CRC32CTest", NULL, NULL);
+    if (NULL == pSuite)
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(pSuite, "known_values", test_crc32c_known_values))
+        || (NULL == CU_add_test(pSuite, "lengths_and_alignment", test_crc32c_lengths_and_alignment))
+        || (NULL == CU_add_test(pSuite, "continue", test_crc32c_continue)))
+    {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+
+    return CU_get_error();
+}
@@ -0,0 +1,144 @@
+#include "crc32c.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_X86_64 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM64 1
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82F63B78u
+
+typedef uint32_t (*crc32c_function_t)(uint32_t crc, const uint8_t* data, size_t length);
+
+static uint32_t crc32c_table[8][256];
+static crc32c_function_t crc32c_function;
+static int crc32c_is_hardware;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+// Process 8 bytes per step with 8 tables
+static uint32_t crc32c_software(uint32_t crc, const uint8_t* data, size_t length)
+{
+    while (length > 0 && ((uintptr_t)data & 7) != 0)
+    {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = crc32c_table[7][word & 0xFF] ^ crc32c_table[6][(word >> 8) & 0xFF] ^ crc32c_table[5][(word >> 16) & 0xFF] ^ crc32c_table[4][(word >> 24) & 0xFF]
+              ^ crc32c_table[3][(word >> 32) & 0xFF] ^ crc32c_table[2][(word >> 40) & 0xFF] ^ crc32c_table[1][(word >> 48) & 0xFF] ^ crc32c_table[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0)
+    {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+
+    return crc;
+}
+
+#if defined(CRC32C_X86_64)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t length)
+{
+    uint64_t crc64 = crc;
+
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while (length > 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+
+    return crc;
+}
+#elif defined(CRC32C_ARM64)
+static uint32_t crc32c_arm64(uint32_t crc, const uint8_t* data, size_t length)
+{
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0)
+    {
+        crc = __crc32cb(crc, *data++);
+        length--;
+    }
+
+    return crc;
+}
+#endif
+
+static void crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int table = 1; table < 8; table++)
+        {
+            uint32_t previous = crc32c_table[table - 1][i];
+            crc32c_table[table][i] = crc32c_table[0][previous & 0xFF] ^ (previous >> 8);
+        }
+    }
+
+    crc32c_function = crc32c_software;
+
+#if defined(CRC32C_X86_64)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_function = crc32c_sse42;
+        crc32c_is_hardware = 1;
+    }
+#elif defined(CRC32C_ARM64)
+    crc32c_function = crc32c_arm64;
+    crc32c_is_hardware = 1;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+
+    return ~crc32c_function(~crc, (const uint8_t*)data, length);
+}
+
+int crc32c_hardware(void)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+
+    return crc32c_is_hardware;
+}
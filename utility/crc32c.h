@@ -0,0 +1,14 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) of data, continue previous checksum by passing it as crc (0 to start)
+// Uses SSE4.2 or ARMv8 CRC instructions when available, slicing-by-8 tables otherwise
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+// Non-zero if crc32c uses CPU instructions
+int crc32c_hardware(void);
+
+#endif    // CRC32C_H